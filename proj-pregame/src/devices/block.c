@@ -1,9 +1,28 @@
 #include "devices/block.h"
 #include <list.h>
+#include <round.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of log2 buckets in a latency histogram.  Bucket I
+   counts requests that took [2**I, 2**(I+1)) TSC cycles. */
+#define BLOCK_HIST_CNT 40
+
+/* Per-direction I/O statistics. */
+struct block_io_stats {
+  unsigned long long cnt;             /* Number of sectors. */
+  unsigned long long seq_cnt;         /* Sectors that followed the previous one. */
+  uint64_t cycles;                    /* Total latency in TSC cycles. */
+  uint64_t max_cycles;                /* Worst single-sector latency. */
+  unsigned long long hist[BLOCK_HIST_CNT]; /* Log2 latency histogram. */
+};
 
 /* A block device. */
 struct block {
@@ -18,8 +37,28 @@ struct block {
 
   unsigned long long read_cnt;  /* Number of sectors read. */
   unsigned long long write_cnt; /* Number of sectors written. */
+
+  struct block_io_stats read_stats;  /* Read latency statistics. */
+  struct block_io_stats write_stats; /* Write latency statistics. */
+  block_sector_t next_sector;        /* Sector following the last access. */
 };
 
+/* One record in the I/O trace ring. */
+struct block_trace_rec {
+  uint64_t tsc;          /* TSC at completion. */
+  struct block* block;   /* Device accessed. */
+  block_sector_t sector; /* Sector accessed. */
+  uint32_t cycles;       /* Latency in TSC cycles (saturated). */
+  tid_t tid;             /* Thread that issued the request. */
+  char op;               /* 'R' or 'W'. */
+};
+
+/* I/O trace ring, enabled by block_trace_init().  Once full,
+   the oldest records are overwritten. */
+static struct block_trace_rec* trace_ring;
+static size_t trace_cnt;          /* Capacity of trace_ring. */
+static unsigned long long trace_seq; /* Total records ever logged. */
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 
@@ -27,6 +66,9 @@ static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 static struct block* block_by_role[BLOCK_ROLE_CNT];
 
 static struct block* list_elem_to_block(struct list_elem*);
+static void account_io(struct block*, struct block_io_stats*, block_sector_t, uint64_t start,
+                       char op);
+static void print_io_stats(const char* what, const struct block_io_stats*);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -95,9 +137,13 @@ static void check_sector(struct block* block, block_sector_t sector) {
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void block_read(struct block* block, block_sector_t sector, void* buffer) {
+  uint64_t start;
+
   check_sector(block, sector);
+  start = timer_cycles();
   block->ops->read(block->aux, sector, buffer);
   block->read_cnt++;
+  account_io(block, &block->read_stats, sector, start, 'R');
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -106,10 +152,14 @@ void block_read(struct block* block, block_sector_t sector, void* buffer) {
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void block_write(struct block* block, block_sector_t sector, const void* buffer) {
+  uint64_t start;
+
   check_sector(block, sector);
   ASSERT(block->type != BLOCK_FOREIGN);
+  start = timer_cycles();
   block->ops->write(block->aux, sector, buffer);
   block->write_cnt++;
+  account_io(block, &block->write_stats, sector, start, 'W');
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -130,10 +180,95 @@ void block_print_stats(void) {
     if (block != NULL) {
       printf("%s (%s): %llu reads, %llu writes\n", block->name, block_type_name(block->type),
              block->read_cnt, block->write_cnt);
+      print_io_stats("read", &block->read_stats);
+      print_io_stats("write", &block->write_stats);
     }
   }
 }
 
+/* Prints the latency summary and non-empty histogram buckets of
+   S, labelled WHAT. */
+static void print_io_stats(const char* what, const struct block_io_stats* s) {
+  int i;
+
+  if (s->cnt == 0)
+    return;
+
+  printf("  %s: %llu seq, %llu random, avg %llu cycles, max %llu cycles\n", what, s->seq_cnt,
+         s->cnt - s->seq_cnt, s->cycles / s->cnt, s->max_cycles);
+  for (i = 0; i < BLOCK_HIST_CNT; i++)
+    if (s->hist[i] != 0)
+      printf("    [2^%d, 2^%d) cycles: %llu\n", i, i + 1, s->hist[i]);
+}
+
+/* Enables the I/O trace ring with room for CNT records.  Older
+   records are overwritten once the ring is full, so the dump
+   always shows the last CNT requests. */
+void block_trace_init(size_t cnt) {
+  size_t page_cnt;
+
+  ASSERT(cnt > 0);
+  page_cnt = DIV_ROUND_UP(cnt * sizeof *trace_ring, PGSIZE);
+  trace_ring = palloc_get_multiple(PAL_ZERO, page_cnt);
+  if (trace_ring == NULL) {
+    printf("block: no memory for %zu-record I/O trace\n", cnt);
+    return;
+  }
+  trace_cnt = page_cnt * PGSIZE / sizeof *trace_ring;
+}
+
+/* Dumps the I/O trace ring to the console, oldest record first,
+   one "iotrace: TSC DEV SECTOR OP TID CYCLES" line per request. */
+void block_trace_dump(void) {
+  unsigned long long first, i;
+
+  if (trace_ring == NULL)
+    return;
+
+  first = trace_seq > trace_cnt ? trace_seq - trace_cnt : 0;
+  printf("I/O trace: %llu requests, %llu recorded\n", trace_seq, trace_seq - first);
+  for (i = first; i < trace_seq; i++) {
+    const struct block_trace_rec* r = &trace_ring[i % trace_cnt];
+    printf("iotrace: %llu %s %" PRDSNu " %c %d %" PRIu32 "\n", r->tsc, r->block->name, r->sector,
+           r->op, r->tid, r->cycles);
+  }
+}
+
+/* Records the completion of an OP ('R' or 'W') on SECTOR of
+   BLOCK that started at TSC value START into S and, if enabled,
+   the trace ring. */
+static void account_io(struct block* block, struct block_io_stats* s, block_sector_t sector,
+                       uint64_t start, char op) {
+  uint64_t now = timer_cycles();
+  uint64_t cycles = now - start;
+  enum intr_level old_level;
+  int bucket;
+
+  for (bucket = 0; bucket < BLOCK_HIST_CNT - 1 && cycles >> (bucket + 1) != 0; bucket++)
+    continue;
+
+  old_level = intr_disable();
+  s->cnt++;
+  if (sector == block->next_sector)
+    s->seq_cnt++;
+  block->next_sector = sector + 1;
+  s->cycles += cycles;
+  if (cycles > s->max_cycles)
+    s->max_cycles = cycles;
+  s->hist[bucket]++;
+
+  if (trace_ring != NULL) {
+    struct block_trace_rec* r = &trace_ring[trace_seq++ % trace_cnt];
+    r->tsc = now;
+    r->block = block;
+    r->sector = sector;
+    r->cycles = cycles > UINT32_MAX ? UINT32_MAX : cycles;
+    r->tid = thread_current()->tid;
+    r->op = op;
+  }
+  intr_set_level(old_level);
+}
+
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
@@ -153,6 +288,9 @@ struct block* block_register(const char* name, enum block_type type, const char*
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  memset(&block->read_stats, 0, sizeof block->read_stats);
+  memset(&block->write_stats, 0, sizeof block->write_stats);
+  block->next_sector = 0;
 
   printf("%s: %'" PRDSNu " sectors (", block->name, block->size);
   print_human_readable_size((uint64_t)block->size * BLOCK_SECTOR_SIZE);
@@ -58,6 +58,11 @@ enum block_type block_type(struct block*);
 /* Statistics. */
 void block_print_stats(void);
 
+/* I/O tracing. */
+#define BLOCK_TRACE_DEFAULT 4096 /* Default trace ring capacity. */
+void block_trace_init(size_t cnt);
+void block_trace_dump(void);
+
 /* Lower-level interface to block device drivers. */
 
 struct block_operations {
@@ -0,0 +1,182 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
+
+/* Local APIC support.  We use the local APIC for its timer,
+   which gives us one-shot interrupts with far better resolution
+   than the 8254's periodic tick, and for interprocessor
+   interrupts (IPIs) between CPUs.  External interrupts still
+   arrive from the 8259A PICs through the BSP's LINT0 ("virtual
+   wire" mode).  See [IA32-v3a] chapter 10 "Advanced
+   Programmable Interrupt Controller (APIC)". */
+
+/* Default physical address of the local APIC's registers. */
+#define LAPIC_PHYS 0xfee00000
+
+/* IA32_APIC_BASE model-specific register. */
+#define MSR_APIC_BASE 0x1b
+#define APIC_BASE_ENABLE 0x800 /* Global APIC enable. */
+
+/* Register offsets, in bytes. */
+#define REG_ID 0x020         /* Local APIC ID. */
+#define REG_EOI 0x0b0        /* End Of Interrupt. */
+#define REG_SVR 0x0f0        /* Spurious Interrupt Vector. */
+#define REG_ICR_LO 0x300     /* Interrupt Command, low half. */
+#define REG_ICR_HI 0x310     /* Interrupt Command, high half. */
+#define REG_LVT_TIMER 0x320  /* LVT timer. */
+#define REG_LVT_LINT0 0x350  /* LVT LINT0 pin. */
+#define REG_LVT_LINT1 0x360  /* LVT LINT1 pin. */
+#define REG_TIMER_INIT 0x380 /* Timer initial count. */
+#define REG_TIMER_CUR 0x390  /* Timer current count. */
+#define REG_TIMER_DIV 0x3e0  /* Timer divide configuration. */
+
+/* Register bits. */
+#define SVR_ENABLE 0x100      /* Software enable. */
+#define LVT_MASKED 0x10000    /* Interrupt masked. */
+#define LVT_EXTINT 0x700      /* Delivery mode ExtINT. */
+#define LVT_NMI 0x400         /* Delivery mode NMI. */
+#define TIMER_DIV_16 0x3      /* Timer counts at bus clock / 16. */
+#define ICR_INIT 0x500        /* Delivery mode INIT. */
+#define ICR_STARTUP 0x600     /* Delivery mode Start-Up. */
+#define ICR_PENDING 0x1000    /* Delivery status: send pending. */
+#define ICR_ASSERT 0x4000     /* Level assert. */
+#define ICR_LEVEL 0x8000      /* Level triggered. */
+#define ICR_OTHERS 0xc0000    /* Shorthand: all but self. */
+
+/* Registers, mapped by lapic_init(), or null if there is no
+   usable local APIC. */
+static volatile uint32_t* lapic;
+
+static intr_handler_func spurious_interrupt;
+static void lapic_setup(bool bsp);
+static void lapic_send(uint8_t apic_id, uint32_t icr);
+
+/* Reads local APIC register REG. */
+static inline uint32_t lapic_read(int reg) { return lapic[reg / 4]; }
+
+/* Writes VALUE to local APIC register REG. */
+static inline void lapic_write(int reg, uint32_t value) { lapic[reg / 4] = value; }
+
+/* Returns true if CPUID reports an on-chip APIC.
+   See [IA32-v2a] "CPUID". */
+static bool cpu_has_apic(void) {
+  uint32_t eax = 1, ebx, ecx = 0, edx;
+  asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+  return (edx & (1 << 9)) != 0;
+}
+
+/* Initializes the local APIC, if there is one, and returns true
+   if successful.  The timer is left stopped.  Must be called
+   after paging_init() and intr_init(). */
+bool lapic_init(void) {
+  uint32_t lo, hi;
+
+  if (!cpu_has_apic())
+    return false;
+
+  /* Make sure the APIC is globally enabled at its default
+     address.  See [IA32-v2b] "RDMSR" and "WRMSR". */
+  asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(MSR_APIC_BASE));
+  if ((lo & 0xfffff000) != LAPIC_PHYS)
+    return false;
+  lo |= APIC_BASE_ENABLE;
+  asm volatile("wrmsr" : : "a"(lo), "d"(hi), "c"(MSR_APIC_BASE));
+
+  lapic = paging_map_mmio(LAPIC_PHYS);
+  lapic_setup(true);
+
+  intr_register_ext(LAPIC_SPURIOUS_VEC, spurious_interrupt, "APIC spurious");
+  printf("lapic: local APIC %" PRIu8 " enabled\n", lapic_id());
+  return true;
+}
+
+/* Initializes the local APIC of an application processor.  The
+   BSP must already have called lapic_init() successfully. */
+void lapic_ap_init(void) {
+  uint32_t lo, hi;
+
+  ASSERT(lapic != NULL);
+
+  asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(MSR_APIC_BASE));
+  lo |= APIC_BASE_ENABLE;
+  asm volatile("wrmsr" : : "a"(lo), "d"(hi), "c"(MSR_APIC_BASE));
+  lapic_setup(false);
+}
+
+/* Programs the local APIC's local vector table and enables it.
+   Only the BSP takes the PICs' interrupts through LINT0 and NMIs
+   through LINT1; if every CPU did, each would get a copy. */
+static void lapic_setup(bool bsp) {
+  lapic_write(REG_LVT_LINT0, bsp ? LVT_EXTINT : LVT_MASKED);
+  lapic_write(REG_LVT_LINT1, bsp ? LVT_NMI : LVT_MASKED);
+  lapic_write(REG_LVT_TIMER, LVT_MASKED | LAPIC_TIMER_VEC);
+  lapic_write(REG_TIMER_DIV, TIMER_DIV_16);
+  lapic_write(REG_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+}
+
+/* Returns true if lapic_init() found a usable local APIC. */
+bool lapic_present(void) { return lapic != NULL; }
+
+/* Returns the running CPU's local APIC ID. */
+uint8_t lapic_id(void) {
+  ASSERT(lapic != NULL);
+  return lapic_read(REG_ID) >> 24;
+}
+
+/* Signals end of interrupt to the local APIC. */
+void lapic_eoi(void) { lapic_write(REG_EOI, 0); }
+
+/* Writes ICR to the interrupt command register to send an IPI to
+   the CPU with APIC_ID, then waits for it to be sent.  See
+   [IA32-v3a] 10.6 "Issuing Interprocessor Interrupts". */
+static void lapic_send(uint8_t apic_id, uint32_t icr) {
+  ASSERT(lapic != NULL);
+
+  lapic_write(REG_ICR_HI, (uint32_t)apic_id << 24);
+  lapic_write(REG_ICR_LO, icr);
+  while (lapic_read(REG_ICR_LO) & ICR_PENDING)
+    asm volatile("pause");
+}
+
+/* Sends interrupt VEC to the CPU with APIC_ID. */
+void lapic_send_ipi(uint8_t apic_id, uint8_t vec) { lapic_send(apic_id, ICR_ASSERT | vec); }
+
+/* Sends interrupt VEC to every CPU but this one. */
+void lapic_broadcast_ipi(uint8_t vec) { lapic_send(0, ICR_OTHERS | ICR_ASSERT | vec); }
+
+/* Sends an INIT IPI to the CPU with APIC_ID, resetting it into
+   its wait-for-startup state. */
+void lapic_send_init(uint8_t apic_id) {
+  lapic_send(apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  lapic_send(apic_id, ICR_INIT | ICR_LEVEL);
+}
+
+/* Sends a Start-Up IPI to the CPU with APIC_ID, which makes it
+   begin executing in real mode at PADDR.  PADDR must be
+   page-aligned and below 1 MB. */
+void lapic_send_startup(uint8_t apic_id, uintptr_t paddr) {
+  ASSERT(paddr % 4096 == 0 && paddr < 0x100000);
+  lapic_send(apic_id, ICR_STARTUP | ICR_ASSERT | (paddr >> 12));
+}
+
+/* Arms the timer to interrupt once, on LAPIC_TIMER_VEC, after
+   COUNT timer clocks.  A COUNT of 0 stops the timer. */
+void lapic_timer_oneshot(uint32_t count) {
+  ASSERT(lapic != NULL);
+  lapic_write(REG_LVT_TIMER, (count != 0 ? 0 : LVT_MASKED) | LAPIC_TIMER_VEC);
+  lapic_write(REG_TIMER_INIT, count);
+}
+
+/* Returns the timer's current count, which decreases from the
+   value given to lapic_timer_oneshot() to 0. */
+uint32_t lapic_timer_count(void) {
+  ASSERT(lapic != NULL);
+  return lapic_read(REG_TIMER_CUR);
+}
+
+/* Spurious interrupt handler.  Spurious interrupts must not be
+   acknowledged, so there is nothing to do. */
+static void spurious_interrupt(struct intr_frame* f UNUSED) {}
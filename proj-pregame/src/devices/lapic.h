@@ -0,0 +1,31 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt vectors delivered by the local APIC.  Like the
+   PIC's vectors 0x20...0x2f, these are treated as external
+   interrupts. */
+#define LAPIC_VEC_BASE 0xf0     /* First local APIC vector. */
+#define LAPIC_TIMER_VEC 0xf0    /* One-shot timer. */
+#define LAPIC_TICK_VEC 0xf1     /* Timer tick, forwarded to the APs. */
+#define LAPIC_RESCHED_VEC 0xf2  /* Asks a CPU to reschedule. */
+#define LAPIC_TLB_VEC 0xf3      /* Asks a CPU to flush its TLB. */
+#define LAPIC_SPURIOUS_VEC 0xff /* Spurious interrupt, never EOI'd. */
+
+bool lapic_init(void);
+void lapic_ap_init(void);
+bool lapic_present(void);
+uint8_t lapic_id(void);
+void lapic_eoi(void);
+
+void lapic_send_ipi(uint8_t apic_id, uint8_t vec);
+void lapic_broadcast_ipi(uint8_t vec);
+void lapic_send_init(uint8_t apic_id);
+void lapic_send_startup(uint8_t apic_id, uintptr_t paddr);
+
+void lapic_timer_oneshot(uint32_t count);
+uint32_t lapic_timer_count(void);
+
+#endif /* devices/lapic.h */
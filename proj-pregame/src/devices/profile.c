@@ -0,0 +1,180 @@
+#include "devices/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#endif
+
+/* One timer-tick sample: where the interrupted code was and a
+   short frame-pointer backtrace of how it got there. */
+struct profile_sample {
+  uint32_t eip;                 /* Interrupted instruction. */
+  uint32_t ret[PROFILE_DEPTH];  /* Return addresses, innermost first. */
+  tid_t tid;                    /* Interrupted thread. */
+  int pid;                      /* Its process, or 0 for none. */
+  uint8_t depth;                /* Number of entries in RET. */
+  char mode;                    /* 'K' for kernel, 'U' for user. */
+};
+
+/* Sample ring, enabled by profile_init().  Once full, the
+   oldest samples are overwritten. */
+static struct profile_sample* sample_ring;
+static size_t sample_cnt;             /* Capacity of sample_ring. */
+static unsigned long long sample_seq; /* Total samples ever taken. */
+
+/* Names of the processes seen in samples, so that the host side
+   can tell which binary a user address belongs to. */
+#define PROFILE_PROCS 32
+struct profile_proc {
+  int pid;
+  char name[16];
+};
+static struct profile_proc procs[PROFILE_PROCS];
+static size_t proc_cnt;
+
+static size_t walk_kernel(const struct intr_frame*, uint32_t* ret);
+#ifdef USERPROG
+static size_t walk_user(const struct intr_frame*, uint32_t* pd, uint32_t* ret);
+static void note_process(struct process*);
+#endif
+
+/* Enables sampling on every timer tick with room for CNT
+   samples.  Older samples are overwritten once the ring is full,
+   so the dump always covers the last CNT ticks. */
+void profile_init(size_t cnt) {
+  size_t page_cnt;
+
+  ASSERT(cnt > 0);
+  page_cnt = DIV_ROUND_UP(cnt * sizeof *sample_ring, PGSIZE);
+  sample_ring = palloc_get_multiple(PAL_ZERO, page_cnt);
+  if (sample_ring == NULL) {
+    printf("profile: no memory for %zu samples\n", cnt);
+    return;
+  }
+  sample_cnt = page_cnt * PGSIZE / sizeof *sample_ring;
+}
+
+/* Records a sample of the code interrupted by timer interrupt
+   frame F.  Called from the timer handlers with interrupts off,
+   which also serializes CPUs. */
+void profile_sample(const struct intr_frame* f) {
+  struct thread* t = thread_current();
+  struct profile_sample* s;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (sample_ring == NULL)
+    return;
+
+  s = &sample_ring[sample_seq++ % sample_cnt];
+  s->eip = (uint32_t)f->eip;
+  s->tid = t->tid;
+  s->pid = 0;
+  s->mode = is_user_vaddr(f->eip) ? 'U' : 'K';
+#ifdef USERPROG
+  if (t->pcb != NULL) {
+    s->pid = t->pcb->pid;
+    note_process(t->pcb);
+  }
+  if (s->mode == 'U') {
+    s->depth = t->pcb != NULL ? walk_user(f, t->pcb->pagedir, s->ret) : 0;
+    return;
+  }
+#endif
+  s->depth = walk_kernel(f, s->ret);
+}
+
+/* Follows the saved frame pointers of kernel code interrupted by
+   F into RET[], staying within the current thread's stack page.
+   Returns the number of return addresses found. */
+static size_t walk_kernel(const struct intr_frame* f, uint32_t* ret) {
+  uintptr_t lo = (uintptr_t)pg_round_down(f);
+  uintptr_t hi = lo + PGSIZE - 2 * sizeof(uint32_t);
+  uintptr_t fp = f->ebp;
+  size_t depth = 0;
+
+  while (depth < PROFILE_DEPTH && fp >= lo && fp <= hi && fp % sizeof(uint32_t) == 0) {
+    const uint32_t* frame = (const uint32_t*)fp;
+    if (frame[1] == 0)
+      break;
+    ret[depth++] = frame[1];
+    if (frame[0] <= fp)
+      break;
+    fp = frame[0];
+  }
+  return depth;
+}
+
+#ifdef USERPROG
+/* Follows the saved frame pointers of user code interrupted by F
+   into RET[], reading user memory through page directory PD so
+   that an unmapped or swapped-out frame just ends the walk.
+   Returns the number of return addresses found. */
+static size_t walk_user(const struct intr_frame* f, uint32_t* pd, uint32_t* ret) {
+  uintptr_t fp = f->ebp;
+  size_t depth = 0;
+
+  if (pd == NULL)
+    return 0;
+  while (depth < PROFILE_DEPTH && fp != 0 && fp % sizeof(uint32_t) == 0 &&
+         is_user_vaddr((void*)(fp + sizeof(uint32_t)))) {
+    const uint32_t* next = pagedir_get_page(pd, (void*)fp);
+    const uint32_t* pc = pagedir_get_page(pd, (void*)(fp + sizeof(uint32_t)));
+    if (next == NULL || pc == NULL || *pc == 0)
+      break;
+    ret[depth++] = *pc;
+    if (*next <= fp)
+      break;
+    fp = *next;
+  }
+  return depth;
+}
+
+/* Remembers the name of process P the first time it is seen. */
+static void note_process(struct process* p) {
+  size_t i;
+
+  for (i = proc_cnt; i-- > 0;)
+    if (procs[i].pid == p->pid)
+      return;
+  if (proc_cnt < PROFILE_PROCS) {
+    procs[proc_cnt].pid = p->pid;
+    strlcpy(procs[proc_cnt].name, p->process_name, sizeof procs[proc_cnt].name);
+    proc_cnt++;
+  }
+}
+#endif
+
+/* Dumps the sample ring to the console for utils/pintos-profile,
+   oldest sample first: one "profile: proc PID NAME" line per
+   process seen, then one "profile: K|U TID PID EIP [RET...]" line
+   per sample. */
+void profile_dump(void) {
+  unsigned long long first, i;
+  size_t j;
+
+  if (sample_ring == NULL)
+    return;
+
+  first = sample_seq > sample_cnt ? sample_seq - sample_cnt : 0;
+  printf("Profile: %llu samples, %llu recorded, %d Hz\n", sample_seq, sample_seq - first,
+         TIMER_FREQ);
+  for (j = 0; j < proc_cnt; j++)
+    printf("profile: proc %d %s\n", procs[j].pid, procs[j].name);
+  for (i = first; i < sample_seq; i++) {
+    const struct profile_sample* s = &sample_ring[i % sample_cnt];
+    printf("profile: %c %d %d %#" PRIx32, s->mode, s->tid, s->pid, s->eip);
+    for (j = 0; j < s->depth; j++)
+      printf(" %#" PRIx32, s->ret[j]);
+    printf("\n");
+  }
+}
@@ -0,0 +1,16 @@
+#ifndef DEVICES_PROFILE_H
+#define DEVICES_PROFILE_H
+
+#include <stddef.h>
+
+struct intr_frame;
+
+/* Sampling profiler driven by the timer tick. */
+#define PROFILE_DEFAULT 4096 /* Default sample ring capacity. */
+#define PROFILE_DEPTH 8      /* Return addresses kept per sample. */
+
+void profile_init(size_t cnt);
+void profile_sample(const struct intr_frame*);
+void profile_dump(void);
+
+#endif /* devices/profile.h */
@@ -1,7 +1,7 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <string.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -33,6 +33,11 @@
 #define MCR_REG (IO_BASE + 4) /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5) /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01   /* Enable receive and transmit FIFOs. */
+#define FCR_CLEAR_RX 0x02 /* Clear receive FIFO. */
+#define FCR_CLEAR_TX 0x04 /* Clear transmit FIFO. */
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01 /* Interrupt when data received. */
 #define IER_XMIT 0x02 /* Interrupt when transmit finishes. */
@@ -51,11 +56,28 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Size of the transmit ring, in bytes.  Must be a power of 2.
+   Large enough that a process writing to stdout can hand over
+   whole buffers and go on computing while the UART drains them. */
+#define TXQ_SIZE 16384
+
+/* Bytes the 16550A transmit FIFO accepts once it reports THR
+   empty. */
+#define TX_FIFO_DEPTH 16
+
+/* Data to be transmitted.  TXQ_HEAD and TXQ_TAIL are free-running
+   counters; new data is written at TXQ_HEAD and old data read at
+   TXQ_TAIL, both modulo TXQ_SIZE. */
+static uint8_t txq[TXQ_SIZE];
+static size_t txq_head, txq_tail;
+
+/* Thread waiting for room in txq, if any. */
+static struct thread* txq_waiter;
 
 static void set_serial(int bps);
 static void putc_poll(uint8_t);
+static void txq_push(const uint8_t*, size_t);
+static void txq_make_room(enum intr_level);
 static void write_ier(void);
 static intr_handler_func serial_interrupt;
 
@@ -69,7 +91,6 @@ static void init_poll(void) {
   outb(FCR_REG, 0);        /* Disable FIFO. */
   set_serial(9600);        /* 9.6 kbps, N-8-1. */
   outb(MCR_REG, MCR_OUT2); /* Required to enable interrupts. */
-  intq_init(&txq);
   mode = POLL;
 }
 
@@ -86,34 +107,48 @@ void serial_init_queue(void) {
   intr_register_ext(0x20 + 4, serial_interrupt, "serial");
   mode = QUEUE;
   old_level = intr_disable();
+
+  /* Turn on the FIFOs once the last polled byte has left the
+     holding register, so that each transmit interrupt can hand
+     the UART TX_FIFO_DEPTH bytes instead of one. */
+  while ((inb(LSR_REG) & LSR_THRE) == 0)
+    continue;
+  outb(FCR_REG, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX);
   write_ier();
   intr_set_level(old_level);
 }
 
 /* Sends BYTE to the serial port. */
-void serial_putc(uint8_t byte) {
+void serial_putc(uint8_t byte) { serial_putbuf(&byte, 1); }
+
+/* Sends the N bytes in BUFFER to the serial port.  In queued
+   mode the bytes are copied into the transmit ring in as few
+   chunks as possible and sent by the interrupt handler. */
+void serial_putbuf(const void* buffer, size_t n) {
+  const uint8_t* p = buffer;
   enum intr_level old_level = intr_disable();
 
   if (mode != QUEUE) {
     /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit. */
     if (mode == UNINIT)
       init_poll();
-    putc_poll(byte);
+    while (n-- > 0)
+      putc_poll(*p++);
   } else {
-    /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-    if (old_level == INTR_OFF && intq_full(&txq)) {
-      /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-      putc_poll(intq_getc(&txq));
+    while (n > 0) {
+      size_t room = TXQ_SIZE - (txq_head - txq_tail);
+      size_t chunk = n < room ? n : room;
+
+      if (chunk == 0) {
+        txq_make_room(old_level);
+        continue;
+      }
+      txq_push(p, chunk);
+      p += chunk;
+      n -= chunk;
+      write_ier();
     }
-
-    intq_putc(&txq, byte);
-    write_ier();
   }
 
   intr_set_level(old_level);
@@ -123,11 +158,44 @@ void serial_putc(uint8_t byte) {
    mode. */
 void serial_flush(void) {
   enum intr_level old_level = intr_disable();
-  while (!intq_empty(&txq))
-    putc_poll(intq_getc(&txq));
+  while (txq_tail != txq_head)
+    putc_poll(txq[txq_tail++ % TXQ_SIZE]);
   intr_set_level(old_level);
 }
 
+/* Copies the N bytes at P into the transmit ring, which must
+   have room for them. */
+static void txq_push(const uint8_t* p, size_t n) {
+  size_t ofs = txq_head % TXQ_SIZE;
+  size_t first = TXQ_SIZE - ofs < n ? TXQ_SIZE - ofs : n;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(n <= TXQ_SIZE - (txq_head - txq_tail));
+
+  memcpy(txq + ofs, p, first);
+  memcpy(txq, p + first, n - first);
+  txq_head += n;
+}
+
+/* Waits for room in the full transmit ring.  OLD_LEVEL is the
+   interrupt level of our caller: if interrupts were on we sleep
+   until the interrupt handler has drained half the ring.
+   Otherwise, or if another thread is already waiting, sleeping
+   is impossible or impolite, so we push out a FIFO's worth of
+   bytes by polling instead. */
+static void txq_make_room(enum intr_level old_level) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (old_level == INTR_ON && !intr_context() && txq_waiter == NULL) {
+    txq_waiter = thread_current();
+    thread_block();
+  } else {
+    int i;
+    for (i = 0; i < TX_FIFO_DEPTH && txq_tail != txq_head; i++)
+      putc_poll(txq[txq_tail++ % TXQ_SIZE]);
+  }
+}
+
 /* The fullness of the input buffer may have changed.  Reassess
    whether we should block receive interrupts.
    Called by the input buffer routines when characters are added
@@ -164,7 +232,7 @@ static void write_ier(void) {
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty(&txq))
+  if (txq_tail != txq_head)
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -196,10 +264,20 @@ static void serial_interrupt(struct intr_frame* f UNUSED) {
   while (!input_full() && (inb(LSR_REG) & LSR_DR) != 0)
     input_putc(inb(RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty(&txq) && (inb(LSR_REG) & LSR_THRE) != 0)
-    outb(THR_REG, intq_getc(&txq));
+  /* Once the transmit FIFO is empty, refill it with up to
+     TX_FIFO_DEPTH bytes at once. */
+  if ((inb(LSR_REG) & LSR_THRE) != 0) {
+    int i;
+    for (i = 0; i < TX_FIFO_DEPTH && txq_tail != txq_head; i++)
+      outb(THR_REG, txq[txq_tail++ % TXQ_SIZE]);
+  }
+
+  /* Wake a writer waiting for room once half the ring is free,
+     so that it can refill it in one large chunk. */
+  if (txq_waiter != NULL && txq_head - txq_tail <= TXQ_SIZE / 2) {
+    thread_unblock(txq_waiter);
+    txq_waiter = NULL;
+  }
 
   /* Update interrupt enable register based on queue status. */
   write_ier();
@@ -2,10 +2,15 @@
 #include <console.h>
 #include <stdio.h>
 #include "devices/kbd.h"
+#include "devices/profile.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
@@ -116,12 +121,19 @@ void shutdown_power_off(void) {
 static void print_stats(void) {
   timer_print_stats();
   thread_print_stats();
+  palloc_print_stats();
+  kmem_cache_print_stats();
+  lock_print_stats();
+  intr_print_stats();
+  workqueue_print_stats();
 #ifdef FILESYS
   block_print_stats();
+  block_trace_dump();
 #endif
   console_print_stats();
   kbd_print_stats();
 #ifdef USERPROG
   exception_print_stats();
 #endif
+  profile_dump();
 }
@@ -4,7 +4,10 @@
 #include <round.h>
 #include <stdio.h>
 #include <lib/kernel/list.h>
+#include "devices/lapic.h"
 #include "devices/pit.h"
+#include "devices/profile.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
@@ -25,18 +28,79 @@ static int64_t ticks;
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
-static struct sleep_list sleep_list;
+
+/* Hierarchical timer wheel holding every pending timer_event.
+   Level 0 has one slot per tick for the next WHEEL_SIZE ticks;
+   each slot of level N covers WHEEL_SIZE^N ticks.  When level
+   0 wraps around, the next slot of level 1 is cascaded down into
+   it, and so on up the levels, so that insertion is O(1) and
+   each timer is moved at most WHEEL_LEVELS - 1 times. */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN ((int64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static int64_t wheel_time; /* Next tick whose level-0 slot is due. */
+
+/* TSC clocksource, calibrated against the PIT by
+   timer_calibrate().  Until then TSC_HZ is 0 and timer_ns()
+   falls back to ticks. */
+#define CALIBRATE_TICKS 4       /* Ticks to measure the TSC over. */
+static uint64_t tsc_hz;         /* TSC cycles per second. */
+static uint32_t tsc_mult;       /* ns = cycles * tsc_mult >> tsc_shift. */
+static int tsc_shift;
+static uint64_t tsc_base;       /* TSC at calibration. */
+static int64_t ns_base;         /* timer_ns() at calibration. */
+
+/* Local APIC timer clocks per second, or 0 if sub-tick one-shot
+   timers are unavailable. */
+static uint64_t lapic_timer_hz;
+
+/* Tickless idle.  While the idle thread runs with no sleeper due
+   for a while, IRQ0 is masked and the APIC timer is armed for
+   the next wakeup instead; the skipped ticks are replayed by
+   timer_irq_enter() on the next interrupt. */
+#define TICK_NS (NSEC_PER_SEC / TIMER_FREQ)
+#define TICKLESS_MAX_TICKS TIMER_FREQ /* Longest stop, in ticks. */
+#define TICKLESS_SLACK_NS 50000       /* Wake this long after the tick. */
+bool timer_tickless;                  /* Enabled by -tickless. */
+static bool tick_stopped;             /* IRQ0 masked by timer_idle_enter()? */
+static int64_t idle_deadline;         /* timer_ns() to end the stop, or 0. */
+static int64_t last_tick_ns;          /* timer_ns() at the last IRQ0. */
+static int64_t tickless_stops;        /* # of times the tick was stopped. */
+static int64_t ticks_avoided;         /* # of IRQ0s that never happened. */
+
+/* Threads in hr_sleep_until(), soonest deadline first. */
+static struct list hr_sleepers;
+
+/* A thread sleeping for less than a tick. */
+struct hr_sleeper {
+  struct list_elem elem; /* Element in hr_sleepers. */
+  int64_t deadline;      /* timer_ns() at which to wake. */
+  struct thread* thread; /* Sleeping thread. */
+};
 
 static intr_handler_func timer_interrupt;
+static intr_handler_func timer_ap_interrupt;
+static void timer_tick(void);
+static void timer_softirq(void);
 static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
 static void real_time_delay(int64_t num, int32_t denom);
+static void clock_calibrate(void);
+static int64_t cycles_to_ns(uint64_t cycles);
+static void hr_sleep_until(int64_t deadline);
+static void hr_arm(void);
+static intr_handler_func hr_interrupt;
 
-/* 睡眠函数 */
-static void sleep_list_into(int64_t wakeup_time);
-static void sleep_list_init(void);
-static void sleep_list_pop(void);
+static void wheel_init(void);
+static void wheel_insert(struct timer_event*);
+static void wheel_cascade(int level);
+static void wheel_run_tick(void);
+static int64_t wheel_next_expiry(int64_t limit);
+static void wake_sleeper(void* thread);
 
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
@@ -44,13 +108,23 @@ static void sleep_list_pop(void);
 void timer_init(void) {
   pit_configure_channel(0, 2, TIMER_FREQ);                           //TIMER_FREQ   一秒多少中断次数
   intr_register_ext(0x20, timer_interrupt, "8254 Timer");            //注册时间中断
-  sleep_list_init();
+  wheel_init();
+  softirq_register(SOFTIRQ_TIMER, timer_softirq, "timer");
+  list_init(&hr_sleepers);
+  if (lapic_init()) {
+    intr_register_ext(LAPIC_TIMER_VEC, hr_interrupt, "APIC Timer");
+    intr_register_ext(LAPIC_TICK_VEC, timer_ap_interrupt, "APIC Tick");
+  }
 }
 
-/* 初始化休眠链表 */
-void sleep_list_init(void){
-  list_init(&sleep_list.thread_list);
-  list_init(&sleep_list.wakeup_list);
+/* Initializes the timer wheel. */
+static void wheel_init(void) {
+  int level, slot;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SIZE; slot++)
+      list_init(&wheel[level][slot]);
+  wheel_time = ticks;
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -75,6 +149,54 @@ void timer_calibrate(void) {
       loops_per_tick |= test_bit;
 
   printf("%'" PRIu64 " loops/s.\n", (uint64_t)loops_per_tick * TIMER_FREQ);
+
+  clock_calibrate();
+}
+
+/* Measures the TSC, and the local APIC timer if we have one,
+   against CALIBRATE_TICKS ticks of the PIT. */
+static void clock_calibrate(void) {
+  int64_t start;
+  uint64_t tsc_start, tsc_end;
+  uint32_t lapic_left = 0;
+
+  ASSERT(intr_get_level() == INTR_ON);
+
+  /* Wait for a timer tick, then start counting. */
+  start = ticks;
+  while (ticks == start)
+    barrier();
+  start = ticks;
+  tsc_start = timer_cycles();
+  if (lapic_present())
+    lapic_timer_oneshot(UINT32_MAX);
+
+  while (ticks < start + CALIBRATE_TICKS)
+    barrier();
+  tsc_end = timer_cycles();
+  if (lapic_present()) {
+    lapic_left = lapic_timer_count();
+    lapic_timer_oneshot(0);
+    lapic_timer_hz = (uint64_t)(UINT32_MAX - lapic_left) * TIMER_FREQ / CALIBRATE_TICKS;
+  }
+
+  /* Pick the largest shift for which the cycles-to-ns multiplier
+     still fits in 32 bits, for the best precision. */
+  tsc_hz = (tsc_end - tsc_start) * TIMER_FREQ / CALIBRATE_TICKS;
+  for (tsc_shift = 32; tsc_shift > 0; tsc_shift--) {
+    uint64_t mult = (NSEC_PER_SEC << tsc_shift) / tsc_hz;
+    if (mult <= UINT32_MAX) {
+      tsc_mult = mult;
+      break;
+    }
+  }
+  ns_base = (start + CALIBRATE_TICKS) * (NSEC_PER_SEC / TIMER_FREQ);
+  tsc_base = tsc_end;
+
+  printf("TSC: %'" PRIu64 " Hz", tsc_hz);
+  if (lapic_timer_hz != 0)
+    printf(", APIC timer: %'" PRIu64 " Hz", lapic_timer_hz);
+  printf(".\n");
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -89,16 +211,94 @@ int64_t timer_ticks(void) {
    should be a value once returned by timer_ticks(). */
 int64_t timer_elapsed(int64_t then) { return timer_ticks() - then; }
 
+/* Returns the CPU's time-stamp counter, which counts cycles
+   since reset.  Usable before timer_init(), even in early boot.
+   See [IA32-v2b] "RDTSC". */
+uint64_t timer_cycles(void) {
+  uint64_t tsc;
+  asm volatile("rdtsc" : "=A"(tsc));
+  return tsc;
+}
+
+/* Returns the number of nanoseconds since the OS booted.  The
+   value never decreases.  Resolution is one TSC cycle once
+   timer_calibrate() has run, one timer tick before that. */
+int64_t timer_ns(void) {
+  if (tsc_hz == 0)
+    return timer_ticks() * (NSEC_PER_SEC / TIMER_FREQ);
+  return ns_base + cycles_to_ns(timer_cycles() - tsc_base);
+}
+
+/* Returns the frequency of the TSC in Hz, or 0 if it has not
+   been calibrated yet. */
+uint64_t timer_cycles_hz(void) { return tsc_hz; }
+
+/* Converts a TSC cycle count into nanoseconds. */
+static int64_t cycles_to_ns(uint64_t cycles) {
+  uint64_t lo = (uint32_t)cycles, hi = cycles >> 32;
+  return ((lo * tsc_mult) >> tsc_shift) + ((hi * tsc_mult) << (32 - tsc_shift));
+}
+
+
+/* Initializes T as a timer that will call FUNC(AUX) when it
+   expires.  T is not pending until passed to timer_add(). */
+void timer_event_init(struct timer_event* t, timer_func* func, void* aux) {
+  ASSERT(t != NULL);
+  ASSERT(func != NULL);
+
+  t->func = func;
+  t->aux = aux;
+  t->pending = false;
+}
+
+/* Arms T to fire at timer tick EXPIRES.  If EXPIRES has already
+   passed, T fires at the next tick.  T must not be pending. */
+void timer_add(struct timer_event* t, int64_t expires) {
+  enum intr_level old_level;
+
+  ASSERT(!t->pending);
+
+  old_level = intr_disable();
+  t->expires = expires;
+  t->pending = true;
+  wheel_insert(t);
+  intr_set_level(old_level);
+}
+
+/* Disarms T.  Returns true if T was pending, false if it had
+   already fired or was never added. */
+bool timer_cancel(struct timer_event* t) {
+  enum intr_level old_level = intr_disable();
+  bool was_pending = t->pending;
+
+  if (was_pending) {
+    list_remove(&t->elem);
+    t->pending = false;
+  }
+  intr_set_level(old_level);
+  return was_pending;
+}
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void timer_sleep(int64_t ticks) {
+  struct timer_event t;
+  enum intr_level old_level;
 
-  int64_t start = timer_ticks();
   ASSERT(intr_get_level() == INTR_ON);
-  sleep_list_into(start + ticks);
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable();
+  timer_event_init(&t, wake_sleeper, thread_current());
+  timer_add(&t, timer_ticks() + ticks);
+  thread_block();
+  intr_set_level(old_level);
 }
 
+/* Timer callback for timer_sleep(). */
+static void wake_sleeper(void* thread) { thread_unblock(thread); }
+
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
    turned on. */
@@ -140,24 +340,117 @@ void timer_udelay(int64_t us) { real_time_delay(us, 1000 * 1000); }
 void timer_ndelay(int64_t ns) { real_time_delay(ns, 1000 * 1000 * 1000); }
 
 /* Prints timer statistics. */
-void timer_print_stats(void) { printf("Timer: %" PRId64 " ticks\n", timer_ticks()); }
+void timer_print_stats(void) {
+  printf("Timer: %" PRId64 " ticks\n", timer_ticks());
+  if (timer_tickless)
+    printf("Tickless: %" PRId64 " ticks avoided in %" PRId64 " idle stops\n", ticks_avoided,
+           tickless_stops);
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts.  If tickless idle is enabled and no sleeper is due
+   within the next tick, masks the periodic timer interrupt and
+   arms the APIC timer for the earliest wakeup instead.  The
+   other CPUs get their ticks from the BSP's, so with more than
+   one CPU the tick never stops. */
+void timer_idle_enter(void) {
+  int64_t next = ticks + TICKLESS_MAX_TICKS;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (!timer_tickless || lapic_timer_hz == 0 || tick_stopped || cpu_cnt > 1)
+    return;
+
+  next = wheel_next_expiry(next);
+  if (next <= ticks + 1)
+    return;
+
+  tick_stopped = true;
+  tickless_stops++;
+  intr_mask_irq(0x20, true);
+  idle_deadline = last_tick_ns + (next - ticks) * TICK_NS + TICKLESS_SLACK_NS;
+  hr_arm();
+}
+
+/* Called on entry to every external interrupt handler.  If the
+   tick was stopped, replays the ticks that were skipped and
+   restarts the periodic timer interrupt. */
+void timer_irq_enter(void) {
+  int64_t missed;
+
+  if (!tick_stopped)
+    return;
+  tick_stopped = false;
+  idle_deadline = 0;
+  hr_arm();
+
+  /* IRQ0 was latched by the PIC at the first tick we missed and
+     will be delivered as soon as it is unmasked, so replay all
+     but one of them here. */
+  missed = (timer_ns() - last_tick_ns) / TICK_NS;
+  if (missed > 1) {
+    ticks_avoided += missed - 1;
+    while (--missed > 0)
+      timer_tick();
+  }
+  intr_mask_irq(0x20, false);
+}
 
-/* Timer interrupt handler. */
-static void timer_interrupt(struct intr_frame* args UNUSED) {
+/* Timer interrupt handler.  Only the BSP gets IRQ0, so it
+   forwards each tick to the other CPUs. */
+static void timer_interrupt(struct intr_frame* args) {
+  profile_sample(args);
+  if (tsc_hz != 0)
+    last_tick_ns = timer_ns();
+  if (cpu_cnt > 1)
+    lapic_broadcast_ipi(LAPIC_TICK_VEC);
+  timer_tick();
+}
+
+/* Handler for a tick forwarded by the BSP to another CPU.  Only
+   the BSP counts ticks and runs timers; the others just account
+   for and preempt the threads they are running. */
+static void timer_ap_interrupt(struct intr_frame* args) {
+  profile_sample(args);
+  thread_tick();
+}
+
+/* Advances the tick count by one.  Only accounting for the
+   running thread happens here; everything else that hangs off
+   the tick is left to the timer softirq. */
+static void timer_tick(void) {
   ticks++;
   thread_tick();           /* 判断现在的线程是否需要切换、tick + 1、cur->recent_cpu + 1 */
-  sleep_list_pop();        //睡眠唤醒
+  softirq_raise(SOFTIRQ_TIMER);
+}
 
-  if (active_sched_policy == SCHED_MLFQS){
-    if(ticks % TIMER_FREQ == 0){ 
-      load_avg_calc();         
-      recent_cpu_update();
-    }
-    if(ticks % 4 == 0){
-      mlfqs_priority_update();
-      intr_yield_on_return();
+/* Timer softirq.  Catches the timer wheel and the MLFQS
+   bookkeeping up with the tick count one tick at a time, turning
+   interrupts back on in between, so that a burst of work does
+   not keep them off for long. */
+static void timer_softirq(void) {
+  for (;;) {
+    enum intr_level old_level = intr_disable();
+    int64_t now = wheel_time;
+    bool due = now <= ticks;
+
+    if (due) {
+      wheel_run_tick();    //到期的定时器（睡眠唤醒等）
+
+      if (active_sched_policy == SCHED_MLFQS){
+        if(now % TIMER_FREQ == 0){
+          load_avg_calc();
+          recent_cpu_update();
+        }
+        if(now % MLFQS_PRIORITY_INTERVAL == 0){
+          mlfqs_priority_update();
+          intr_yield_on_return();
+        }
+      }
     }
-    
+    intr_set_level(old_level);
+    if (!due)
+      return;
   }
 }
 
@@ -203,7 +496,15 @@ static void real_time_sleep(int64_t num, int32_t denom) {
   int64_t ticks = num * TIMER_FREQ / denom;
 
   ASSERT(intr_get_level() == INTR_ON);
-  if (ticks > 0) {
+  if (lapic_timer_hz != 0) {
+    /* Sleep through all but the last partial tick on the tick
+         clock, then wake at the exact deadline with a one-shot
+         APIC timer interrupt. */
+    int64_t deadline = timer_ns() + num * (NSEC_PER_SEC / denom);
+    if (ticks > 1)
+      timer_sleep(ticks - 1);
+    hr_sleep_until(deadline);
+  } else if (ticks > 0) {
     /* We're waiting for at least one full timer tick.  Use
          timer_sleep() because it will yield the CPU to other
          processes. */
@@ -217,53 +518,168 @@ static void real_time_sleep(int64_t num, int32_t denom) {
 
 /* Busy-wait for approximately NUM/DENOM seconds. */
 static void real_time_delay(int64_t num, int32_t denom) {
+  if (tsc_hz != 0) {
+    /* Spin on the calibrated TSC, which is exact and does not
+         depend on code alignment. */
+    int64_t deadline = timer_ns() + num * (NSEC_PER_SEC / denom);
+    while (timer_ns() < deadline)
+      barrier();
+    return;
+  }
+
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT(denom % 1000 == 0);
   busy_wait(loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
 }
 
+/* Returns true if hr_sleeper A's deadline is earlier than B's. */
+static bool hr_less(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED) {
+  return list_entry(a, struct hr_sleeper, elem)->deadline <
+         list_entry(b, struct hr_sleeper, elem)->deadline;
+}
 
+/* Blocks the current thread until timer_ns() reaches DEADLINE,
+   using the local APIC's one-shot timer. */
+static void hr_sleep_until(int64_t deadline) {
+  struct hr_sleeper s;
+  enum intr_level old_level;
 
-/* 弹出第一个到达时间的线程 */
-static void sleep_list_pop(){
-  struct list_elem* thread_first;
-  struct list_elem* wakeup_first;
-  while(true){
-    thread_first = list_begin(&sleep_list.thread_list);
-    wakeup_first = list_begin(&sleep_list.wakeup_list);
-    if(thread_first == list_end(&sleep_list.thread_list) || wakeup_first == list_end(&sleep_list.wakeup_list))
-      return;
-    if(list_entry(wakeup_first,struct wakeup,elem)->wakeup_time <= ticks){
-      list_pop_front(&sleep_list.thread_list);
-      list_pop_front(&sleep_list.wakeup_list);
-      thread_unblock(list_entry(thread_first,struct thread,elem));
-    }else
-      return;
+  ASSERT(lapic_timer_hz != 0);
+
+  old_level = intr_disable();
+  s.deadline = deadline;
+  s.thread = thread_current();
+  list_insert_ordered(&hr_sleepers, &s.elem, hr_less, NULL);
+  if (list_front(&hr_sleepers) == &s.elem)
+    hr_arm();
+  thread_block();
+  intr_set_level(old_level);
+}
+
+/* Programs the APIC timer for the earliest deadline in
+   hr_sleepers or the end of a tickless idle stop, or stops it if
+   there is neither. */
+static void hr_arm(void) {
+  int64_t deadline = idle_deadline;
+  int64_t delta;
+  uint64_t count;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (!list_empty(&hr_sleepers)) {
+    int64_t first = list_entry(list_front(&hr_sleepers), struct hr_sleeper, elem)->deadline;
+    if (deadline == 0 || first < deadline)
+      deadline = first;
+  }
+  if (deadline == 0) {
+    lapic_timer_oneshot(0);
+    return;
   }
+
+  delta = deadline - timer_ns();
+  count = delta > 0 ? (uint64_t)delta * lapic_timer_hz / NSEC_PER_SEC : 0;
+  lapic_timer_oneshot(count == 0 ? 1 : count > UINT32_MAX ? UINT32_MAX : count);
 }
 
+/* APIC timer interrupt handler.  Wakes every sub-tick sleeper
+   whose deadline has passed and re-arms for the next one. */
+static void hr_interrupt(struct intr_frame* args UNUSED) {
+  int64_t now = timer_ns();
+
+  while (!list_empty(&hr_sleepers)) {
+    struct hr_sleeper* s = list_entry(list_front(&hr_sleepers), struct hr_sleeper, elem);
+    if (s->deadline > now)
+      break;
+    list_pop_front(&hr_sleepers);
+    thread_unblock(s->thread);
+  }
+  hr_arm();
+}
 
-/* 队列头是wakeup_time苏醒时间最小的线程*/
-static void sleep_list_into(int64_t wakeup_time){
-  enum intr_level old_level;
-  struct list_elem* e1,*e2;
-  struct thread* cur = thread_current();
-  struct wakeup new_e;
-  new_e.wakeup_time = wakeup_time;
-
-  old_level = intr_disable();  //关闭中断
-  //找到new_e合适的插入位置
-  for (e1 = list_begin(&sleep_list.thread_list),e2 = list_begin(&sleep_list.wakeup_list);
-    e1 != list_end(&sleep_list.thread_list) && e2 != list_end(&sleep_list.wakeup_list);
-    e1 = list_next(e1), e2 = list_next(e2)
-  ){
-    if(list_entry(e2,struct wakeup,elem)->wakeup_time > wakeup_time) break;
+
+
+/* Puts T into the wheel slot that covers T->expires. */
+static void wheel_insert(struct timer_event* t) {
+  int64_t expires = t->expires;
+  int64_t delta = expires - wheel_time;
+  int level;
+
+  if (delta < 0) {
+    /* Already due: fire at the next tick. */
+    expires = wheel_time;
+    delta = 0;
+  } else if (delta >= WHEEL_SPAN) {
+    /* Too far out: park in the last slot of the top level.
+         wheel_run_tick() re-inserts it if it comes due early. */
+    expires = wheel_time + WHEEL_SPAN - 1;
+    delta = WHEEL_SPAN - 1;
   }
 
-  list_insert(e1,&cur->elem);
-  list_insert(e2,&new_e.elem);
+  for (level = 0; delta >= (int64_t)1 << (WHEEL_BITS * (level + 1)); level++)
+    continue;
+  list_push_back(&wheel[level][(expires >> (WHEEL_BITS * level)) & WHEEL_MASK], &t->elem);
+}
+
+/* Moves the timers in the current slot of LEVEL down into the
+   lower levels, first cascading the level above if this slot is
+   the first one of a new round. */
+static void wheel_cascade(int level) {
+  int slot = (wheel_time >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  struct list* l = &wheel[level][slot];
 
-  thread_block();            
-  intr_set_level(old_level);
-}
\ No newline at end of file
+  if (slot == 0 && level + 1 < WHEEL_LEVELS)
+    wheel_cascade(level + 1);
+
+  while (!list_empty(l))
+    wheel_insert(list_entry(list_pop_front(l), struct timer_event, elem));
+}
+
+/* Fires every timer in the slot for tick WHEEL_TIME and moves on
+   to the next tick.  Runs in the timer softirq, with interrupts
+   off.
+
+   The slot is moved to a local list and WHEEL_TIME advanced
+   before any callback runs, so that a callback that re-arms its
+   timer for a tick that has already passed puts it in the next
+   tick's slot instead of the one being drained. */
+static void wheel_run_tick(void) {
+  int64_t now = wheel_time;
+  struct list* l = &wheel[0][now & WHEEL_MASK];
+  struct list due;
+
+  ASSERT(now <= ticks);
+
+  if ((now & WHEEL_MASK) == 0)
+    wheel_cascade(1);
+
+  list_init(&due);
+  list_splice(list_end(&due), list_begin(l), list_end(l));
+  wheel_time++;
+
+  while (!list_empty(&due)) {
+    struct timer_event* t = list_entry(list_pop_front(&due), struct timer_event, elem);
+    if (t->expires > now) {
+      wheel_insert(t);
+      continue;
+    }
+    t->pending = false;
+    t->func(t->aux);
+  }
+}
+
+/* Returns the earliest tick, no later than LIMIT, at which the
+   wheel may have a timer to fire.  Only level 0 is searched; if
+   it is empty up to the next cascade, that cascade's tick is
+   returned, since the levels above must be looked at then. */
+static int64_t wheel_next_expiry(int64_t limit) {
+  int64_t t;
+
+  for (t = wheel_time; t < limit; t++) {
+    if (t != wheel_time && (t & WHEEL_MASK) == 0)
+      return t;
+    if (!list_empty(&wheel[0][t & WHEEL_MASK]))
+      return t;
+  }
+  return limit;
+}
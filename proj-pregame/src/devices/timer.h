@@ -9,24 +9,34 @@
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
-struct sleep_list{
-    struct list thread_list;
-    struct list wakeup_list;
-
-};
-
-struct wakeup{
-    struct list_elem elem;
-    int64_t wakeup_time;
+/* Nanoseconds per second. */
+#define NSEC_PER_SEC 1000000000LL
+
+/* A kernel timer.  Once timer_ticks() reaches EXPIRES, FUNC is
+   called with AUX from the timer softirq, with interrupts off,
+   so it must not sleep. */
+typedef void timer_func(void* aux);
+struct timer_event {
+  struct list_elem elem; /* Element in a timer wheel slot. */
+  int64_t expires;       /* Tick at which to fire. */
+  timer_func* func;      /* Called on expiry. */
+  void* aux;             /* Argument to FUNC. */
+  bool pending;          /* Added and not yet fired or cancelled? */
 };
 
-
-
 void timer_init(void);
 void timer_calibrate(void);
 
 int64_t timer_ticks(void);
 int64_t timer_elapsed(int64_t);
+uint64_t timer_cycles(void);
+uint64_t timer_cycles_hz(void);
+int64_t timer_ns(void);
+
+/* Kernel timers. */
+void timer_event_init(struct timer_event*, timer_func*, void* aux);
+void timer_add(struct timer_event*, int64_t expires);
+bool timer_cancel(struct timer_event*);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep(int64_t ticks);
@@ -39,6 +49,11 @@ void timer_mdelay(int64_t milliseconds);
 void timer_udelay(int64_t microseconds);
 void timer_ndelay(int64_t nanoseconds);
 
+/* Tickless idle. */
+extern bool timer_tickless;
+void timer_idle_enter(void);
+void timer_irq_enter(void);
+
 void timer_print_stats(void);
 
 #endif /* devices/timer.h */
@@ -26,6 +26,7 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+static void putc_at_cursor(int c, enum intr_level);
 static void clear_row(size_t y);
 static void cls(void);
 static void newline(void);
@@ -51,7 +52,31 @@ void vga_putc(int c) {
   enum intr_level old_level = intr_disable();
 
   init();
+  putc_at_cursor(c, old_level);
 
+  /* Update cursor position. */
+  move_cursor();
+
+  intr_set_level(old_level);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display,
+   updating the hardware cursor only once at the end. */
+void vga_putbuf(const char* buffer, size_t n) {
+  enum intr_level old_level = intr_disable();
+
+  init();
+  while (n-- > 0)
+    putc_at_cursor(*buffer++, old_level);
+  move_cursor();
+
+  intr_set_level(old_level);
+}
+
+/* Writes C at the cursor position and advances the cursor, but
+   does not move the hardware cursor.  Interrupts must be off;
+   OLD_LEVEL is the level to restore while beeping. */
+static void putc_at_cursor(int c, enum intr_level old_level) {
   switch (c) {
     case '\n':
       newline();
@@ -89,11 +114,6 @@ void vga_putc(int c) {
         newline();
       break;
   }
-
-  /* Update cursor position. */
-  move_cursor();
-
-  intr_set_level(old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
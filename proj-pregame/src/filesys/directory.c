@@ -4,7 +4,13 @@
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
+
+/* Cache for open directories. */
+static struct kmem_cache* dir_cache;
+
+/* Initializes the directory module. */
+void dir_init(void) { dir_cache = kmem_cache_create("dir", sizeof(struct dir), NULL); }
 
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
@@ -15,14 +21,14 @@ bool dir_create(block_sector_t sector, size_t entry_cnt){
 /* Opens and returns the directory for the given INODE, of which
    it takes ownership.  Returns a null pointer on failure. */
 struct dir* dir_open(struct inode* inode) {
-  struct dir* dir = calloc(1, sizeof *dir);
+  struct dir* dir = kmem_cache_zalloc(dir_cache);
   if (inode != NULL && dir != NULL) {
     dir->inode = inode;
     dir->pos = 0;
     return dir;
   } else {
     inode_close(inode);
-    free(dir);
+    kmem_cache_free(dir_cache, dir);
     return NULL;
   }
 }
@@ -45,10 +51,14 @@ struct dir* dir_reopen(struct dir* dir) {
 void dir_close(struct dir* dir) {
   if (dir != NULL) {
     inode_close(dir->inode);
-    free(dir);
+    kmem_cache_free(dir_cache, dir);
   }
 }
 
+/* Frees DIR without closing its inode, for a caller that has
+   taken over the reference. */
+void dir_free(struct dir* dir) { kmem_cache_free(dir_cache, dir); }
+
 /* Returns the inode encapsulated by DIR. */
 struct inode* dir_get_inode(struct dir* dir) {
   return dir->inode;
@@ -2,25 +2,32 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "filesys/directory.h"
-#include "threads/malloc.h"
+#include "threads/interrupt.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
+/* Cache for open files. */
+static struct kmem_cache* file_cache;
+
+/* Initializes the file module. */
+void file_init(void) { file_cache = kmem_cache_create("file", sizeof(struct file), NULL); }
 
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file* file_open(struct inode* inode) {
 
-  struct file* file = calloc(1, sizeof *file);
+  struct file* file = kmem_cache_zalloc(file_cache);
   if (inode != NULL && file != NULL) {
     file->inode = inode;
     file->pos = 0;
     file->deny_write = false;
+    file->ref_cnt = 1;
     return file;
   } else {
     inode_close(inode);
-    free(file);
+    kmem_cache_free(file_cache, file);
     return NULL;
   }
 }
@@ -31,12 +38,31 @@ struct file* file_reopen(struct file* file) {
   return file_open(inode_reopen(file->inode));
 }
 
-/* Closes FILE. */
+/* Returns FILE with one more reference, to be dropped with
+   file_close().  Unlike file_reopen(), the new reference shares
+   FILE's position.  Returns a null pointer if FILE is null. */
+struct file* file_dup(struct file* file) {
+  if (file != NULL) {
+    enum intr_level old_level = intr_disable();
+    file->ref_cnt++;
+    intr_set_level(old_level);
+  }
+  return file;
+}
+
+/* Drops a reference to FILE, and closes it if that was the
+   last one. */
 void file_close(struct file* file) {
   if (file != NULL) {
+    enum intr_level old_level = intr_disable();
+    bool last = --file->ref_cnt == 0;
+    intr_set_level(old_level);
+    if (!last)
+      return;
+
     file_allow_write(file);
     inode_close(file->inode);
-    free(file);
+    kmem_cache_free(file_cache, file);
   }
 }
 
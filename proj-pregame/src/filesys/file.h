@@ -10,11 +10,14 @@ struct file {
   struct inode* inode; /* File's inode. */
   off_t pos;           /* Current position. */
   bool deny_write;     /* Has file_deny_write() been called? */
+  int ref_cnt;         /* References; file_close() frees at 0. */
 };
 
 /* Opening and closing files. */
+void file_init(void);
 struct file* file_open(struct inode*);
 struct file* file_reopen(struct file*);
+struct file* file_dup(struct file*);
 void file_close(struct file*);
 struct inode* file_get_inode(struct file*);
 
@@ -63,6 +63,8 @@ void filesys_init(bool format) {
 
   lock_init(&temporary);
   inode_init();
+  file_init();
+  dir_init();
   free_map_init();
 
   if (format)
@@ -251,7 +253,7 @@ done:
   if(root && cur_dir)
     dir_close(cur_dir);
   /* 释放在目录中遍历的dir，由于需要返回*inode 不能使用dir_close()*/
-  free(dir);
+  dir_free(dir);
   if(!success){
     inode_close(*inode);
     *inode = NULL;
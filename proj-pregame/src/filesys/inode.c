@@ -8,6 +8,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 
 /* Identifies an inode. */
@@ -78,8 +79,16 @@ static block_sector_t byte_to_sector(const struct inode* inode, off_t pos) {
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Caches for in-memory inodes and their on-disk blocks. */
+static struct kmem_cache* inode_cache;
+static struct kmem_cache* inode_disk_cache;
+
 /* Initializes the inode module. */
-void inode_init(void) { list_init(&open_inodes); }
+void inode_init(void) {
+  list_init(&open_inodes);
+  inode_cache = kmem_cache_create("inode", sizeof(struct inode), NULL);
+  inode_disk_cache = kmem_cache_create("inode_disk", sizeof(struct inode_disk), NULL);
+}
 
 /*  需提供一个空闲扇区SECTOR作为该文件的管理块，LOAD标志该文件是否需要实
   加载，IS_DIR标志该新建的文件是否是一个目录文件   */
@@ -93,11 +102,11 @@ bool inode_create(block_sector_t sector, off_t length, bool load, bool is_dir) {
      one sector in size, and you should fix that. */
   ASSERT(sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
-  disk_inode = calloc(1, sizeof *disk_inode);
+  disk_inode = kmem_cache_zalloc(inode_disk_cache);
   if (disk_inode != NULL) {
     disk_inode->magic = INODE_MAGIC;
     bool success = false;
-    struct inode* inode = calloc(1, sizeof(struct inode));
+    struct inode* inode = kmem_cache_zalloc(inode_cache);
     if(inode == NULL)
       return false;
 
@@ -116,9 +125,9 @@ bool inode_create(block_sector_t sector, off_t length, bool load, bool is_dir) {
     }
     disk_inode->is_dir = is_dir;
 
-    free(inode);
+    kmem_cache_free(inode_cache, inode);
     block_write(fs_device, sector, disk_inode);
-    free(disk_inode);
+    kmem_cache_free(inode_disk_cache, disk_inode);
     return success;
   }
   return false;
@@ -141,7 +150,7 @@ struct inode* inode_open(block_sector_t sector) {
   }
 
   /* Allocate memory. */
-  inode = malloc(sizeof *inode);
+  inode = kmem_cache_alloc(inode_cache);
   if (inode == NULL){
     return NULL;
   }
@@ -154,7 +163,7 @@ struct inode* inode_open(block_sector_t sector) {
   inode->removed = false;
 
   /* 初始化第一个inode_disk */
-  struct inode_disk* i_d = malloc(sizeof(struct inode_disk));
+  struct inode_disk* i_d = kmem_cache_alloc(inode_disk_cache);
   struct inode_disk* i_d_next;
   if(i_d == NULL)
     return NULL;
@@ -164,7 +173,7 @@ struct inode* inode_open(block_sector_t sector) {
 
   /* 初始化后续的inode_disk */
   while(i_d->next_sector != 0){
-    i_d_next = malloc(sizeof(struct inode_disk));
+    i_d_next = kmem_cache_alloc(inode_disk_cache);
     if(i_d_next == NULL){
       inode_release_inner(inode, false);         /* 释放已经打开的页 */
       return NULL;
@@ -212,7 +221,7 @@ void inode_close(struct inode* inode) {
 
     /* 如果要删除就不写回，不删除就写回*/
     inode_release_inner(inode, !inode->removed);
-    free(inode);
+    kmem_cache_free(inode_cache, inode);
   }
 
 }
@@ -335,11 +344,11 @@ static bool inode_write_expand(struct inode* inode, off_t size, off_t offset){
 error:
     if(lazy_sector > 0){
       free_map_release(lazy_sector, 1);
-      free(i_d_lazy);
+      kmem_cache_free(inode_disk_cache, i_d_lazy);
     }
     if(load_sector > 0){
       free_map_release(load_sector, 1);
-      free(i_d_load);
+      kmem_cache_free(inode_disk_cache, i_d_load);
     }
     i_d_end->next_inode_disk = NULL;
     i_d_end->next_sector = 0;
@@ -462,7 +471,7 @@ static struct inode_disk* inode_create_inner(size_t cnt, struct inode* i, block_
   /* 从磁盘中新分配一个i_d */
   if(!free_map_allocate(1, sector))
     return NULL;
-  struct inode_disk* inode_disk = calloc(1, sizeof(struct inode_disk));
+  struct inode_disk* inode_disk = kmem_cache_zalloc(inode_disk_cache);
   if(inode_disk){
     i_d->next_sector = *sector;
     i_d->next_inode_disk = inode_disk;
@@ -640,7 +649,7 @@ static void inode_release_inner(struct inode* inode, bool write_back){
     sector_cur = i_d_cur->next_sector;
     i_d_cur = next;
 
-    free(i_d_free);
+    kmem_cache_free(inode_disk_cache, i_d_free);
   }
 } 
 
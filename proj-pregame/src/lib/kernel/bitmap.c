@@ -26,6 +26,7 @@ typedef unsigned long elem_type;
    simulates an array of bits. */
 struct bitmap {
   size_t bit_cnt;  /* Number of bits. */
+  size_t next;     /* Next-fit cursor, see bitmap_scan_next(). */
   elem_type* bits; /* Elements that represent bits. */
 };
 
@@ -52,6 +53,48 @@ static inline elem_type last_mask(const struct bitmap* b) {
   return last_bits ? ((elem_type)1 << last_bits) - 1 : (elem_type)-1;
 }
 
+/* Returns a mask of the bits numbered BIT_IDX and up within
+   BIT_IDX's element. */
+static inline elem_type from_mask(size_t bit_idx) { return (elem_type)-1 << (bit_idx % ELEM_BITS); }
+
+/* Returns the index of the lowest set bit in nonzero ELEM. */
+static inline size_t lowest_bit(elem_type elem) {
+  elem_type idx;
+
+  ASSERT(elem != 0);
+  asm("bsfl %1, %0" : "=r"(idx) : "rm"(elem) : "cc");
+  return idx;
+}
+
+/* Returns the number of set bits in ELEM. */
+static inline size_t popcount(elem_type elem) {
+  elem = elem - ((elem >> 1) & 0x55555555);
+  elem = (elem & 0x33333333) + ((elem >> 2) & 0x33333333);
+  elem = (elem + (elem >> 4)) & 0x0f0f0f0f;
+  return (elem * 0x01010101) >> 24;
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or B's size if there is none.  Skips whole
+   elements that hold no such bit. */
+static size_t find_next(const struct bitmap* b, size_t start, bool value) {
+  size_t idx = elem_idx(start);
+  size_t cnt = elem_cnt(b->bit_cnt);
+  elem_type flip = value ? 0 : (elem_type)-1;
+  elem_type elem;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+  elem = (b->bits[idx] ^ flip) & from_mask(start);
+  while (elem == 0) {
+    if (++idx >= cnt)
+      return b->bit_cnt;
+    elem = b->bits[idx] ^ flip;
+  }
+  start = idx * ELEM_BITS + lowest_bit(elem);
+  return start < b->bit_cnt ? start : b->bit_cnt;
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -62,6 +105,7 @@ struct bitmap* bitmap_create(size_t bit_cnt) {
   struct bitmap* b = malloc(sizeof *b);
   if (b != NULL) {
     b->bit_cnt = bit_cnt;
+    b->next = 0;
     b->bits = malloc(byte_cnt(bit_cnt));
     if (b->bits != NULL || bit_cnt == 0) {
       bitmap_set_all(b, false);
@@ -81,6 +125,7 @@ struct bitmap* bitmap_create_in_buf(size_t bit_cnt, void* block, size_t block_si
   ASSERT(block_size >= bitmap_buf_size(bit_cnt));
 
   b->bit_cnt = bit_cnt;
+  b->next = 0;
   b->bits = (elem_type*)(b + 1);
   bitmap_set_all(b, false);
   return b;
@@ -170,47 +215,59 @@ void bitmap_set_all(struct bitmap* b, bool value) {
   bitmap_set_multiple(b, 0, bitmap_size(b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE, a whole
+   element at a time where possible. */
 void bitmap_set_multiple(struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i;
+  size_t end = start + cnt;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set(b, start + i, value);
+  while (start < end) {
+    size_t idx = elem_idx(start);
+    elem_type mask = from_mask(start);
+
+    if (end - idx * ELEM_BITS < ELEM_BITS)
+      mask &= ~from_mask(end);
+    if (value)
+      asm("orl %1, %0" : "=m"(b->bits[idx]) : "r"(mask) : "cc");
+    else
+      asm("andl %1, %0" : "=m"(b->bits[idx]) : "r"(~mask) : "cc");
+    start = (idx + 1) * ELEM_BITS;
+  }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t bitmap_count(const struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t set_cnt = 0;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test(b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  while (start < end) {
+    size_t idx = elem_idx(start);
+    elem_type mask = from_mask(start);
+
+    if (end - idx * ELEM_BITS < ELEM_BITS)
+      mask &= ~from_mask(end);
+    set_cnt += popcount(b->bits[idx] & mask);
+    start = (idx + 1) * ELEM_BITS;
+  }
+  return value ? set_cnt : cnt - set_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool bitmap_contains(const struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i;
-
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test(b, start + i) == value)
-      return true;
-  return false;
+  return cnt > 0 && find_next(b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -236,19 +293,47 @@ bool bitmap_all(const struct bitmap* b, size_t start, size_t cnt) {
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Jumps from run to run of VALUE bits rather than testing one
+   bit at a time. */
 size_t bitmap_scan(const struct bitmap* b, size_t start, size_t cnt, bool value) {
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) {
-    size_t last = b->bit_cnt - cnt;
-    size_t i;
-    for (i = start; i <= last; i++)
-      if (!bitmap_contains(b, i, cnt, !value))
-        return i;
+  if (cnt > b->bit_cnt || start > b->bit_cnt - cnt)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+
+  for (;;) {
+    size_t end;
+
+    start = find_next(b, start, value);
+    if (start >= b->bit_cnt || start > b->bit_cnt - cnt)
+      return BITMAP_ERROR;
+    end = find_next(b, start, !value);
+    if (end - start >= cnt)
+      return start;
+    start = end;
   }
-  return BITMAP_ERROR;
+}
+
+/* Like bitmap_scan() from the bit after the group that the last
+   bitmap_scan_next() on B found, wrapping around to the start of
+   B if need be, so that repeated allocations do not rescan the
+   groups they already took.  Returns BITMAP_ERROR if there is no
+   such group anywhere in B. */
+size_t bitmap_scan_next(struct bitmap* b, size_t cnt, bool value) {
+  size_t idx;
+
+  ASSERT(b != NULL);
+
+  idx = b->next < b->bit_cnt ? bitmap_scan(b, b->next, cnt, value) : BITMAP_ERROR;
+  if (idx == BITMAP_ERROR)
+    idx = bitmap_scan(b, 0, cnt, value);
+  if (idx != BITMAP_ERROR)
+    b->next = idx + cnt;
+  return idx;
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -266,6 +351,15 @@ size_t bitmap_scan_and_flip(struct bitmap* b, size_t start, size_t cnt, bool val
   return idx;
 }
 
+/* Like bitmap_scan_and_flip(), but with bitmap_scan_next()'s
+   next-fit search. */
+size_t bitmap_scan_and_flip_next(struct bitmap* b, size_t cnt, bool value) {
+  size_t idx = bitmap_scan_next(b, cnt, value);
+  if (idx != BITMAP_ERROR)
+    bitmap_set_multiple(b, idx, cnt, !value);
+  return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -306,32 +400,21 @@ void bitmap_dump(const struct bitmap* b) { hex_dump(0, b->bits, byte_cnt(b->bit_
 size_t bitmap_longest(struct bitmap *b, size_t *out_start, bool value) {
     ASSERT(b != NULL);
     ASSERT(out_start != NULL);
-    
+
     size_t max_length = 0;
-    size_t current_length = 0;
     size_t max_start = BITMAP_ERROR;
-    size_t current_start = BITMAP_ERROR;
-    
-    for (size_t i = 0; i < b->bit_cnt; i++) {
-        if (bitmap_test(b, i) == value) {
-            if (current_start == BITMAP_ERROR) {
-                current_start = i;
-                current_length = 1;
-            } else 
-                current_length++;
-              
-            /* 检查是否找到更长的连续块 */
-            if (current_length > max_length) {
-                max_length = current_length;
-                max_start = current_start;
-            }
-        } else {
-            /* 当前位不符合要求，重置当前连续块 */
-            current_start = BITMAP_ERROR;
-            current_length = 0;
+    size_t start = 0;
+
+    /* 按字跳过，逐段比较连续块的长度 */
+    while ((start = find_next(b, start, value)) < b->bit_cnt) {
+        size_t end = find_next(b, start, !value);
+        if (end - start > max_length) {
+            max_length = end - start;
+            max_start = start;
         }
+        start = end;
     }
-    
+
     *out_start = max_start;
     return max_length;
 }
@@ -37,6 +37,8 @@ size_t bitmap_longest(struct bitmap *b, size_t *out_start, bool); //新增
 #define BITMAP_ERROR SIZE_MAX
 size_t bitmap_scan(const struct bitmap*, size_t start, size_t cnt, bool);
 size_t bitmap_scan_and_flip(struct bitmap*, size_t start, size_t cnt, bool);
+size_t bitmap_scan_next(struct bitmap*, size_t cnt, bool);
+size_t bitmap_scan_and_flip_next(struct bitmap*, size_t cnt, bool);
 
 /* File input and output. */
 #ifdef FILESYS
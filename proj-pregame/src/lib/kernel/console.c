@@ -124,11 +124,14 @@ int puts(const char* s) {
   return 0;
 }
 
-/* Writes the N characters in BUFFER to the console. */
+/* Writes the N characters in BUFFER to the console.
+   The whole buffer is handed to the serial and vga layers at
+   once rather than a character at a time. */
 void putbuf(const char* buffer, size_t n) {
   acquire_console();
-  while (n-- > 0)
-    putchar_have_lock(*buffer++);
+  write_cnt += n;
+  serial_putbuf(buffer, n);
+  vga_putbuf(buffer, n);
   release_console();
 }
 
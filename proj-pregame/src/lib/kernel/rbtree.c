@@ -0,0 +1,278 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree, following [CLRS] chapter 13, with NULL in
+   place of the sentinel leaf. */
+
+static void rotate_left(struct rb_tree*, struct rb_elem*);
+static void rotate_right(struct rb_tree*, struct rb_elem*);
+static void transplant(struct rb_tree*, struct rb_elem* u, struct rb_elem* v);
+static void insert_fixup(struct rb_tree*, struct rb_elem*);
+static void remove_fixup(struct rb_tree*, struct rb_elem* x, struct rb_elem* parent);
+static struct rb_elem* subtree_min(struct rb_elem*);
+
+/* Returns true if E is a red node.  NULL leaves are black. */
+static inline bool is_red(const struct rb_elem* e) { return e != NULL && e->red; }
+
+/* Initializes TREE as an empty tree that orders its elements
+   with LESS given auxiliary data AUX. */
+void rb_init(struct rb_tree* tree, rb_less_func* less, void* aux) {
+  ASSERT(tree != NULL);
+  ASSERT(less != NULL);
+
+  tree->root = tree->min = NULL;
+  tree->elem_cnt = 0;
+  tree->less = less;
+  tree->aux = aux;
+}
+
+/* Inserts E into TREE.  E is placed after any elements that
+   compare equal to it. */
+void rb_insert(struct rb_tree* tree, struct rb_elem* e) {
+  struct rb_elem* parent = NULL;
+  struct rb_elem** link = &tree->root;
+  bool leftmost = true;
+
+  ASSERT(tree != NULL);
+  ASSERT(e != NULL);
+
+  while (*link != NULL) {
+    parent = *link;
+    if (tree->less(e, parent, tree->aux))
+      link = &parent->left;
+    else {
+      link = &parent->right;
+      leftmost = false;
+    }
+  }
+
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+  if (leftmost)
+    tree->min = e;
+  tree->elem_cnt++;
+
+  insert_fixup(tree, e);
+}
+
+/* Removes E, which must be in TREE, from TREE. */
+void rb_remove(struct rb_tree* tree, struct rb_elem* e) {
+  struct rb_elem *x, *x_parent;
+  bool removed_red = e->red;
+
+  ASSERT(tree != NULL);
+  ASSERT(e != NULL);
+  ASSERT(tree->elem_cnt > 0);
+
+  if (tree->min == e)
+    tree->min = rb_next(e);
+
+  if (e->left == NULL) {
+    x = e->right;
+    x_parent = e->parent;
+    transplant(tree, e, e->right);
+  } else if (e->right == NULL) {
+    x = e->left;
+    x_parent = e->parent;
+    transplant(tree, e, e->left);
+  } else {
+    /* Replace E by its successor Y, which has no left child. */
+    struct rb_elem* y = subtree_min(e->right);
+    removed_red = y->red;
+    x = y->right;
+    if (y->parent == e)
+      x_parent = y;
+    else {
+      x_parent = y->parent;
+      transplant(tree, y, y->right);
+      y->right = e->right;
+      y->right->parent = y;
+    }
+    transplant(tree, e, y);
+    y->left = e->left;
+    y->left->parent = y;
+    y->red = e->red;
+  }
+  tree->elem_cnt--;
+
+  if (!removed_red)
+    remove_fixup(tree, x, x_parent);
+}
+
+/* Returns the smallest element in TREE, or NULL if TREE is
+   empty. */
+struct rb_elem* rb_min(const struct rb_tree* tree) {
+  return tree->min;
+}
+
+/* Returns the element that follows E in its tree, or NULL if E
+   is the largest. */
+struct rb_elem* rb_next(const struct rb_elem* e) {
+  ASSERT(e != NULL);
+
+  if (e->right != NULL)
+    return subtree_min(e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in TREE. */
+size_t rb_size(const struct rb_tree* tree) { return tree->elem_cnt; }
+
+/* Returns true if TREE contains no elements, false otherwise. */
+bool rb_empty(const struct rb_tree* tree) { return tree->elem_cnt == 0; }
+
+/* Returns the leftmost node in the subtree rooted at E. */
+static struct rb_elem* subtree_min(struct rb_elem* e) {
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Rotates the subtree rooted at X to the left, so that X's
+   right child takes its place. */
+static void rotate_left(struct rb_tree* tree, struct rb_elem* x) {
+  struct rb_elem* y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  transplant(tree, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Rotates the subtree rooted at X to the right, so that X's
+   left child takes its place. */
+static void rotate_right(struct rb_tree* tree, struct rb_elem* x) {
+  struct rb_elem* y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  transplant(tree, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Puts V, which may be NULL, in U's place in its parent. */
+static void transplant(struct rb_tree* tree, struct rb_elem* u, struct rb_elem* v) {
+  if (u->parent == NULL)
+    tree->root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if (v != NULL)
+    v->parent = u->parent;
+}
+
+/* Restores the red-black properties after inserting red node
+   E. */
+static void insert_fixup(struct rb_tree* tree, struct rb_elem* e) {
+  struct rb_elem* parent;
+
+  while (is_red(parent = e->parent)) {
+    /* A red node is never the root, so GRANDPARENT exists. */
+    struct rb_elem* grandparent = parent->parent;
+
+    if (parent == grandparent->left) {
+      struct rb_elem* uncle = grandparent->right;
+      if (is_red(uncle)) {
+        parent->red = uncle->red = false;
+        grandparent->red = true;
+        e = grandparent;
+        continue;
+      }
+      if (e == parent->right) {
+        rotate_left(tree, parent);
+        e = parent;
+        parent = e->parent;
+      }
+      parent->red = false;
+      grandparent->red = true;
+      rotate_right(tree, grandparent);
+    } else {
+      struct rb_elem* uncle = grandparent->left;
+      if (is_red(uncle)) {
+        parent->red = uncle->red = false;
+        grandparent->red = true;
+        e = grandparent;
+        continue;
+      }
+      if (e == parent->left) {
+        rotate_right(tree, parent);
+        e = parent;
+        parent = e->parent;
+      }
+      parent->red = false;
+      grandparent->red = true;
+      rotate_left(tree, grandparent);
+    }
+  }
+  tree->root->red = false;
+}
+
+/* Restores the red-black properties after removing a black
+   node.  X, which may be NULL, took the removed node's place
+   under PARENT and carries an extra black. */
+static void remove_fixup(struct rb_tree* tree, struct rb_elem* x, struct rb_elem* parent) {
+  while (x != tree->root && !is_red(x)) {
+    if (x == parent->left) {
+      struct rb_elem* sibling = parent->right;
+      if (is_red(sibling)) {
+        sibling->red = false;
+        parent->red = true;
+        rotate_left(tree, parent);
+        sibling = parent->right;
+      }
+      if (!is_red(sibling->left) && !is_red(sibling->right)) {
+        sibling->red = true;
+        x = parent;
+        parent = x->parent;
+      } else {
+        if (!is_red(sibling->right)) {
+          sibling->left->red = false;
+          sibling->red = true;
+          rotate_right(tree, sibling);
+          sibling = parent->right;
+        }
+        sibling->red = parent->red;
+        parent->red = false;
+        sibling->right->red = false;
+        rotate_left(tree, parent);
+        x = tree->root;
+      }
+    } else {
+      struct rb_elem* sibling = parent->left;
+      if (is_red(sibling)) {
+        sibling->red = false;
+        parent->red = true;
+        rotate_right(tree, parent);
+        sibling = parent->left;
+      }
+      if (!is_red(sibling->left) && !is_red(sibling->right)) {
+        sibling->red = true;
+        x = parent;
+        parent = x->parent;
+      } else {
+        if (!is_red(sibling->left)) {
+          sibling->right->red = false;
+          sibling->red = true;
+          rotate_left(tree, sibling);
+          sibling = parent->left;
+        }
+        sibling->red = parent->red;
+        parent->red = false;
+        sibling->left->red = false;
+        rotate_right(tree, parent);
+        x = tree->root;
+      }
+    }
+  }
+  if (x != NULL)
+    x->red = false;
+}
@@ -1,22 +1,68 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
 // GCC erroneously emits a nonnull-compare error in the expansion of the ASSERT
 // macro in many places where it is used in this file, even though nothing is
 // marked as nonnull.
 #pragma GCC diagnostic ignored "-Wnonnull-compare"
 
-/* Copies SIZE bytes from SRC to DST, which must not overlap.
-   Returns DST. */
-void* memcpy(void* dst_, const void* src_, size_t size) {
-  unsigned char* dst = dst_;
-  const unsigned char* src = src_;
+/* The block functions below move the bulk of a block 32 bits at
+   a time, with "rep movsl" and "rep stosl" where they go upward,
+   and handle the unaligned head and tail a byte at a time.  Blocks
+   shorter than WORD_MIN bytes are not worth the setup.  There is
+   no SSE variant: the kernel does not save FPU or SSE state
+   across interrupts, so it may not touch those registers. */
+#define WORD_MIN 16
+
+/* A 32-bit word that may alias any other type. */
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+
+/* Copies SIZE bytes upward from SRC to DST, which may overlap
+   only if DST is below SRC. */
+static void copy_up(unsigned char* dst, const unsigned char* src, size_t size) {
+  if (size >= WORD_MIN) {
+    size_t head = -(uintptr_t)dst & (sizeof(word_t) - 1);
+    size_t words;
+
+    size -= head;
+    while (head-- > 0)
+      *dst++ = *src++;
+    words = size / sizeof(word_t);
+    size %= sizeof(word_t);
+    asm volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(words) : : "memory");
+  }
+  while (size-- > 0)
+    *dst++ = *src++;
+}
 
-  ASSERT(dst != NULL || size == 0);
-  ASSERT(src != NULL || size == 0);
+/* Copies SIZE bytes downward from SRC to DST, starting with the
+   last byte, for a DST that overlaps SRC from above. */
+static void copy_down(unsigned char* dst, const unsigned char* src, size_t size) {
+  dst += size;
+  src += size;
+  if (size >= WORD_MIN) {
+    size_t tail = (uintptr_t)dst & (sizeof(word_t) - 1);
 
+    size -= tail;
+    while (tail-- > 0)
+      *--dst = *--src;
+    for (; size >= sizeof(word_t); size -= sizeof(word_t)) {
+      dst -= sizeof(word_t);
+      src -= sizeof(word_t);
+      *(word_t*)dst = *(const word_t*)src;
+    }
+  }
   while (size-- > 0)
-    *dst++ = *src++;
+    *--dst = *--src;
+}
+
+/* Copies SIZE bytes from SRC to DST, which must not overlap.
+   Returns DST. */
+void* memcpy(void* dst_, const void* src_, size_t size) {
+  ASSERT(dst_ != NULL || size == 0);
+  ASSERT(src_ != NULL || size == 0);
 
+  copy_up(dst_, src_, size);
   return dst_;
 }
 
@@ -29,17 +75,12 @@ void* memmove(void* dst_, const void* src_, size_t size) {
   ASSERT(dst != NULL || size == 0);
   ASSERT(src != NULL || size == 0);
 
-  if (dst < src) {
-    while (size-- > 0)
-      *dst++ = *src++;
-  } else {
-    dst += size;
-    src += size;
-    while (size-- > 0)
-      *--dst = *--src;
-  }
+  if (dst <= src || dst >= src + size)
+    copy_up(dst, src, size);
+  else
+    copy_down(dst, src, size);
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -53,6 +94,20 @@ int memcmp(const void* a_, const void* b_, size_t size) {
   ASSERT(a != NULL || size == 0);
   ASSERT(b != NULL || size == 0);
 
+  /* Skip equal words, then find the differing byte. */
+  if (size >= WORD_MIN) {
+    size_t head = -(uintptr_t)a & (sizeof(word_t) - 1);
+
+    for (; head > 0; head--, size--, a++, b++)
+      if (*a != *b)
+        return *a > *b ? +1 : -1;
+    for (; size >= sizeof(word_t); size -= sizeof(word_t)) {
+      if (*(const word_t*)a != *(const word_t*)b)
+        break;
+      a += sizeof(word_t);
+      b += sizeof(word_t);
+    }
+  }
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -251,6 +306,18 @@ void* memset(void* dst_, int value, size_t size) {
 
   ASSERT(dst != NULL || size == 0);
 
+  if (size >= WORD_MIN) {
+    size_t head = -(uintptr_t)dst & (sizeof(word_t) - 1);
+    uint32_t word = (unsigned char)value * 0x01010101u;
+    size_t words;
+
+    size -= head;
+    while (head-- > 0)
+      *dst++ = value;
+    words = size / sizeof(word_t);
+    size %= sizeof(word_t);
+    asm volatile("rep stosl" : "+D"(dst), "+c"(words) : "a"(word) : "memory");
+  }
   while (size-- > 0)
     *dst++ = value;
 
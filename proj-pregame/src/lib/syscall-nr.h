@@ -39,7 +39,12 @@ enum {
   SYS_MKDIR,   /* Create a directory. */
   SYS_READDIR, /* Reads a directory entry. */
   SYS_ISDIR,   /* Tests if a fd represents a directory. */
-  SYS_INUMBER  /* Returns the inode number for a fd. */
+  SYS_INUMBER, /* Returns the inode number for a fd. */
+
+  /* Extensions. */
+  SYS_CLOCK_GETTIME, /* Reads a high-resolution clock. */
+  SYS_FUTEX_WAIT,    /* Sleeps while a user word holds a value. */
+  SYS_FUTEX_WAKE     /* Wakes threads sleeping on a user word. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,16 @@
+#ifndef __LIB_TIME_H
+#define __LIB_TIME_H
+
+#include <stdint.h>
+
+/* Clocks for clock_gettime(). */
+#define CLOCK_REALTIME 0  /* Wall-clock time since the Unix epoch. */
+#define CLOCK_MONOTONIC 1 /* Time since boot; never goes backward. */
+
+/* A time value with nanosecond resolution. */
+struct timespec {
+  int32_t tv_sec;  /* Seconds. */
+  int32_t tv_nsec; /* Nanoseconds, 0...999,999,999. */
+};
+
+#endif /* lib/time.h */
@@ -1,4 +1,5 @@
 #include <pthread.h>
+#include <stddef.h>
 #include <syscall.h>
 
 void _pthread_start_stub(pthread_fun fun, void* arg);
@@ -27,3 +28,154 @@ void _pthread_start_stub(pthread_fun fun, void* arg) {
   (*fun)(arg);    // Invoke the thread function
   pthread_exit(); // Call pthread_exit
 }
+
+/* User locks and semaphores.
+
+   The uncontended paths are a single atomic instruction in user
+   mode.  A thread that finds the lock held or the semaphore at
+   zero spins for a short while, in case the holder is about to
+   let go on another CPU, and only then sleeps in the kernel with
+   futex_wait().  Releasers call futex_wake() only when someone
+   may be asleep. */
+
+#define LOCK_MAGIC 0x4c4f434b /* Marks an initialized lock_t. */
+#define SEMA_MAGIC 0x53454d41 /* Marks an initialized sema_t. */
+#define SPIN_CNT 100          /* Tries before sleeping. */
+
+/* The kernel gives the main thread the top 8 MB of user memory for
+   its stack, and every other thread a one-page stack below it. */
+#define MAIN_STACK_BOTTOM (0xc0000000 - (8 << 20))
+#define STACK_PAGE_MASK (~(uintptr_t)0xfff)
+
+/* Returns a nonzero value that identifies the running thread
+   among the threads of this process, without a system call. */
+static uintptr_t self_id(void) {
+  uintptr_t sp = (uintptr_t)&sp;
+  return sp >= MAIN_STACK_BOTTOM ? 1 : sp & STACK_PAGE_MASK;
+}
+
+/* Atomically sets *P to NEW and returns its old value. */
+static inline int32_t atomic_xchg(volatile int32_t* p, int32_t new) {
+  asm volatile("xchgl %0, %1" : "+r"(new), "+m"(*p) : : "memory");
+  return new;
+}
+
+/* Atomically sets *P to NEW if it is OLD.  Returns the value *P
+   had, which is OLD on success. */
+static inline int32_t atomic_cmpxchg(volatile int32_t* p, int32_t old, int32_t new) {
+  int32_t prev;
+  asm volatile("lock cmpxchgl %2, %1" : "=a"(prev), "+m"(*p) : "r"(new), "0"(old) : "memory");
+  return prev;
+}
+
+/* Atomically adds N to *P and returns the old value. */
+static inline int32_t atomic_add(volatile int32_t* p, int32_t n) {
+  asm volatile("lock xaddl %0, %1" : "+r"(n), "+m"(*p) : : "memory");
+  return n;
+}
+
+/* Initializes LOCK.  Returns false if LOCK is a null pointer. */
+bool lock_init(lock_t* lock) {
+  if (lock == NULL)
+    return false;
+  lock->state = 0;
+  lock->owner = 0;
+  lock->magic = LOCK_MAGIC;
+  return true;
+}
+
+/* Acquires LOCK, sleeping until it is free if need be.  Exits the
+   process if LOCK is not initialized or is already held by the
+   running thread. */
+void lock_acquire(lock_t* lock) {
+  uintptr_t self = self_id();
+  int32_t c;
+  int i;
+
+  if (lock->magic != LOCK_MAGIC || lock->owner == self)
+    exit(1);
+
+  for (i = 0; i < SPIN_CNT; i++) {
+    c = atomic_cmpxchg(&lock->state, 0, 1);
+    if (c == 0)
+      goto acquired;
+    asm volatile("pause");
+  }
+
+  /* Mark the lock contended, so that the holder wakes us, and
+     sleep until we are the ones who took it from free. */
+  while (atomic_xchg(&lock->state, 2) != 0)
+    futex_wait(&lock->state, 2);
+
+acquired:
+  lock->owner = self;
+}
+
+/* Releases LOCK, waking one sleeper if there may be any.  Exits
+   the process if the running thread does not hold LOCK. */
+void lock_release(lock_t* lock) {
+  if (lock->magic != LOCK_MAGIC || lock->owner != self_id())
+    exit(1);
+
+  lock->owner = 0;
+  if (atomic_xchg(&lock->state, 0) == 2)
+    futex_wake(&lock->state, 1);
+}
+
+/* Initializes SEMA to VAL.  Returns false if SEMA is a null
+   pointer or VAL is negative. */
+bool sema_init(sema_t* sema, int val) {
+  if (sema == NULL || val < 0)
+    return false;
+  sema->value = val;
+  sema->waiters = 0;
+  sema->magic = SEMA_MAGIC;
+  return true;
+}
+
+/* Tries to decrement SEMA without sleeping.  Returns true if
+   successful. */
+static bool sema_try_down(sema_t* sema) {
+  int32_t v = sema->value;
+
+  while (v > 0) {
+    int32_t prev = atomic_cmpxchg(&sema->value, v, v - 1);
+    if (prev == v)
+      return true;
+    v = prev;
+  }
+  return false;
+}
+
+/* Waits for SEMA to become positive and decrements it.  Exits the
+   process if SEMA is not initialized. */
+void sema_down(sema_t* sema) {
+  int i;
+
+  if (sema->magic != SEMA_MAGIC)
+    exit(1);
+
+  for (i = 0; i < SPIN_CNT; i++) {
+    if (sema_try_down(sema))
+      return;
+    asm volatile("pause");
+  }
+
+  /* Count ourselves as a waiter before the last check, so that an
+     sema_up() after it knows to wake us. */
+  atomic_add(&sema->waiters, 1);
+  while (!sema_try_down(sema))
+    futex_wait(&sema->value, 0);
+  atomic_add(&sema->waiters, -1);
+}
+
+/* Increments SEMA and wakes one sleeper if there may be any.
+   Exits the process if SEMA is not initialized. */
+void sema_up(sema_t* sema) {
+  if (sema->magic != SEMA_MAGIC)
+    exit(1);
+
+  atomic_add(&sema->value, 1);
+  if (sema->waiters > 0)
+    futex_wake(&sema->value, 1);
+}
@@ -3,6 +3,7 @@
 
 #include <debug.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Thread identifiers and thread function */
 typedef void (*pthread_fun)(void*);
@@ -14,4 +15,26 @@ tid_t pthread_create(pthread_fun fun, void* arg);
 void pthread_exit(void) NO_RETURN;
 bool pthread_join(tid_t);
 
+/* Synchronization types.  Both live entirely in user memory and
+   only enter the kernel, through futex_wait() and futex_wake(),
+   when a thread has to sleep or wake a sleeper. */
+typedef struct {
+  int32_t state;   /* 0 if free, 1 if held, 2 if held and contended. */
+  uintptr_t owner; /* Identifies the holding thread, 0 if free. */
+  uint32_t magic;  /* Set by lock_init(). */
+} lock_t;
+
+typedef struct {
+  int32_t value;   /* Current value. */
+  int32_t waiters; /* Threads in or on their way to sema_down()'s sleep. */
+  uint32_t magic;  /* Set by sema_init(). */
+} sema_t;
+
+bool lock_init(lock_t* lock);
+void lock_acquire(lock_t* lock);
+void lock_release(lock_t* lock);
+bool sema_init(sema_t* sema, int val);
+void sema_down(sema_t* sema);
+void sema_up(sema_t* sema);
+
 #endif /* lib/user/pthread.h */
@@ -129,32 +129,10 @@ void sys_pthread_exit() {
 
 tid_t sys_pthread_join(tid_t tid) { return syscall1(SYS_PT_JOIN, tid); }
 
-bool lock_init(lock_t* lock) { return syscall1(SYS_LOCK_INIT, lock); }
-
-void lock_acquire(lock_t* lock) {
-  bool success = syscall1(SYS_LOCK_ACQUIRE, lock);
-  if (!success)
-    exit(1);
-}
-
-void lock_release(lock_t* lock) {
-  bool success = syscall1(SYS_LOCK_RELEASE, lock);
-  if (!success)
-    exit(1);
-}
-
-bool sema_init(sema_t* sema, int val) { return syscall2(SYS_SEMA_INIT, sema, val); }
+tid_t get_tid(void) { return syscall0(SYS_GET_TID); }
 
-void sema_down(sema_t* sema) {
-  bool success = syscall1(SYS_SEMA_DOWN, sema);
-  if (!success)
-    exit(1);
-}
+int clock_gettime(int clock, struct timespec* ts) { return syscall2(SYS_CLOCK_GETTIME, clock, ts); }
 
-void sema_up(sema_t* sema) {
-  bool success = syscall1(SYS_SEMA_UP, sema);
-  if (!success)
-    exit(1);
-}
+int futex_wait(int32_t* addr, int32_t expected) { return syscall2(SYS_FUTEX_WAIT, addr, expected); }
 
-tid_t get_tid(void) { return syscall0(SYS_GET_TID); }
+int futex_wake(int32_t* addr, int cnt) { return syscall2(SYS_FUTEX_WAKE, addr, cnt); }
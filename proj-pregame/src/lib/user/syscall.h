@@ -4,15 +4,12 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <pthread.h>
+#include <time.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t)-1)
 
-/* Synchronization Types */
-typedef char lock_t;
-typedef char sema_t;
-
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t)-1)
@@ -43,12 +40,6 @@ double compute_e(int n);
 tid_t sys_pthread_create(stub_fun sfun, pthread_fun tfun, const void* arg);
 void sys_pthread_exit(void) NO_RETURN;
 tid_t sys_pthread_join(tid_t tid);
-bool lock_init(lock_t* lock);
-void lock_acquire(lock_t* lock);
-void lock_release(lock_t* lock);
-bool sema_init(sema_t* sema, int val);
-void sema_down(sema_t* sema);
-void sema_up(sema_t* sema);
 tid_t get_tid(void);
 
 /* Project 3 and optionally project 4. */
@@ -62,4 +53,9 @@ bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
 
+/* Extensions. */
+int clock_gettime(int clock, struct timespec* ts);
+int futex_wait(int32_t* addr, int32_t expected);
+int futex_wake(int32_t* addr, int cnt);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Like check_expected, but for benchmarks.  Requires at least one
+# "(TEST) bench: ..." line in the output and then ignores all of
+# them, since the numbers they report vary from run to run.
+sub check_bench {
+    my ($expected) = pop @_;
+    my (@options) = @_;
+    our ($test);
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+    fail "Run didn't report any benchmark results\n"
+      if !grep (/^\([^)]+\) bench: /, @output);
+    @output = grep (!/^\([^)]+\) bench: /, @output);
+    compare_output ("run", @options, \@output, $expected);
+}
+
+1;
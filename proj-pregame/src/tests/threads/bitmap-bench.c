@@ -0,0 +1,231 @@
+/* Checks the word-at-a-time bitmap operations against bit loops
+   on a small map, on ranges that start and end partway through
+   an element.  Then times bitmap scans on a 1M-bit map at several
+   fill ratios, against a bit-at-a-time scan like the one
+   bitmap_scan() used to do, and compares first-fit with next-fit
+   allocation.
+
+   "Prefix" maps have their first RATIO% of bits set, as a
+   first-fit allocator leaves them.  "Random" maps have each bit
+   set with probability RATIO%. */
+
+#include <bitmap.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "devices/timer.h"
+
+#define BIT_CNT (1024 * 1024)
+#define ALLOC_CNT 1000
+
+/* Size of the map for the checks: a few elements and a partial
+   one. */
+#define CHECK_CNT 301
+/* Longest range checked, from each start bit. */
+#define CHECK_RANGE 70
+
+/* Returns the first group of CNT bits in B set to VALUE, testing
+   one bit at a time. */
+static size_t bitwise_scan(const struct bitmap* b, size_t cnt, bool value) {
+  size_t i, j;
+
+  for (i = 0; i + cnt <= bitmap_size(b); i++) {
+    for (j = 0; j < cnt && bitmap_test(b, i + j) == value; j++)
+      continue;
+    if (j == cnt)
+      return i;
+  }
+  return BITMAP_ERROR;
+}
+
+/* Returns the number of bits in REF[START...START+CNT) that are
+   VALUE. */
+static size_t bitwise_count(const bool ref[], size_t start, size_t cnt, bool value) {
+  size_t i, n = 0;
+
+  for (i = start; i < start + cnt; i++)
+    n += ref[i] == value;
+  return n;
+}
+
+/* Returns the length of the first longest run of VALUE bits in
+   REF, storing its start in *START, or BITMAP_ERROR if none. */
+static size_t bitwise_longest(const bool ref[], size_t* start, bool value) {
+  size_t i, run = 0, longest = 0;
+
+  *start = BITMAP_ERROR;
+  for (i = 0; i < CHECK_CNT; i++) {
+    run = ref[i] == value ? run + 1 : 0;
+    if (run > longest) {
+      longest = run;
+      *start = i + 1 - run;
+    }
+  }
+  return longest;
+}
+
+/* Fills B and REF alike with runs of random lengths from 1 to
+   MAX_RUN, alternately set and clear. */
+static void fill_runs(struct bitmap* b, bool ref[], size_t max_run) {
+  bool value = random_ulong() % 2;
+  size_t i = 0;
+
+  while (i < CHECK_CNT) {
+    size_t run = random_ulong() % max_run + 1;
+    for (; run > 0 && i < CHECK_CNT; run--, i++) {
+      bitmap_set(b, i, value);
+      ref[i] = value;
+    }
+    value = !value;
+  }
+}
+
+/* Fails unless B holds the same bits as REF. */
+static void check_bits(const struct bitmap* b, const bool ref[], const char* after) {
+  size_t i;
+
+  for (i = 0; i < CHECK_CNT; i++)
+    if (bitmap_test(b, i) != ref[i])
+      fail("bit %zu is %d after %s, expected %d", i, bitmap_test(b, i), after, ref[i]);
+}
+
+/* Returns the first bit of the CNT-bit range numbered START in
+   PASS: on pass 0, ranges start START bits into the map; on pass
+   1, they end START bits before its end, which is partway through
+   its last element. */
+static size_t range_start(int pass, size_t start, size_t cnt) {
+  return pass == 0 ? start : CHECK_CNT - start - cnt;
+}
+
+/* Checks bitmap_count(), bitmap_contains(), bitmap_set_multiple()
+   and bitmap_longest() against bit loops. */
+static void check_ops(void) {
+  static const size_t max_runs[] = {1, 3, 40, 200};
+  static bool ref[CHECK_CNT];
+  struct bitmap* b = bitmap_create(CHECK_CNT);
+  size_t i, j, start, cnt, got, expected, got_start, expected_start;
+  int value, pass;
+
+  if (b == NULL)
+    fail("out of memory for %d-bit map", CHECK_CNT);
+
+  for (j = 0; j < sizeof max_runs / sizeof *max_runs; j++) {
+    fill_runs(b, ref, max_runs[j]);
+    for (value = 0; value <= 1; value++) {
+      expected = bitwise_longest(ref, &expected_start, value);
+      got = bitmap_longest(b, &got_start, value);
+      if (got != expected || got_start != expected_start)
+        fail("longest run of %d is %zu at %zu, expected %zu at %zu", value, got, got_start,
+             expected, expected_start);
+
+      for (pass = 0; pass < 2; pass++)
+        for (start = 0; start < CHECK_RANGE; start++)
+          for (cnt = 0; cnt <= CHECK_RANGE; cnt++) {
+            size_t first = range_start(pass, start, cnt);
+
+            expected = bitwise_count(ref, first, cnt, value);
+            got = bitmap_count(b, first, cnt, value);
+            if (got != expected)
+              fail("count of %d in %zu bits from %zu is %zu, expected %zu", value, cnt, first,
+                   got, expected);
+            if (bitmap_contains(b, first, cnt, value) != (expected > 0))
+              fail("contains %d in %zu bits from %zu is wrong", value, cnt, first);
+          }
+    }
+
+    /* Set and clear ranges of every length at every start. */
+    for (pass = 0; pass < 2; pass++)
+      for (start = 0; start < CHECK_RANGE; start++)
+        for (cnt = 0; cnt <= CHECK_RANGE; cnt++) {
+          size_t first = range_start(pass, start, cnt);
+
+          value = (start + cnt) % 2;
+          bitmap_set_multiple(b, first, cnt, value);
+          for (i = first; i < first + cnt; i++)
+            ref[i] = value;
+          check_bits(b, ref, "bitmap_set_multiple");
+        }
+  }
+  bitmap_destroy(b);
+}
+
+/* Times a scan of B for CNT clear bits both ways. */
+static void time_scan(struct bitmap* b, const char* layout, int ratio, size_t cnt) {
+  uint64_t start, old_cycles, new_cycles;
+  size_t old_idx, new_idx;
+
+  start = timer_cycles();
+  old_idx = bitwise_scan(b, cnt, false);
+  old_cycles = timer_cycles() - start;
+
+  start = timer_cycles();
+  new_idx = bitmap_scan(b, 0, cnt, false);
+  new_cycles = timer_cycles() - start;
+
+  if (old_idx != new_idx)
+    fail("%s %d%%: scan for %zu found %zu, expected %zu", layout, ratio, cnt, new_idx, old_idx);
+  msg("bench: %s %2d%% full, scan for %2zu: %" PRIu64 " cycles bit loop, %" PRIu64
+      " cycles word scan",
+      layout, ratio, cnt, old_cycles, new_cycles);
+}
+
+/* Fills B with its first RATIO% of bits set. */
+static void fill_prefix(struct bitmap* b, int ratio) {
+  bitmap_set_all(b, false);
+  bitmap_set_multiple(b, 0, (size_t)BIT_CNT / 100 * ratio, true);
+}
+
+void test_bitmap_bench(void) {
+  static const int ratios[] = {0, 50, 90, 99};
+  struct bitmap* b = bitmap_create(BIT_CNT);
+  size_t i, j;
+
+  if (b == NULL)
+    fail("out of memory for %d-bit map", BIT_CNT);
+  random_init(0);
+
+  msg("Checking bitmap operations against bit loops...");
+  check_ops();
+
+  msg("Timing scans of a %d-bit map...", BIT_CNT);
+  for (i = 0; i < sizeof ratios / sizeof *ratios; i++) {
+    int ratio = ratios[i];
+
+    fill_prefix(b, ratio);
+    time_scan(b, "prefix", ratio, 1);
+    time_scan(b, "prefix", ratio, 16);
+
+    for (j = 0; j < BIT_CNT; j++)
+      bitmap_set(b, j, random_ulong() % 100 < (unsigned)ratio);
+    time_scan(b, "random", ratio, 1);
+    time_scan(b, "random", ratio, 8);
+  }
+
+  msg("Timing %d single-bit allocations...", ALLOC_CNT);
+  for (i = 0; i < sizeof ratios / sizeof *ratios; i++) {
+    int ratio = ratios[i];
+    uint64_t start, first_cycles, next_cycles;
+
+    fill_prefix(b, ratio);
+    start = timer_cycles();
+    for (j = 0; j < ALLOC_CNT; j++)
+      if (bitmap_scan_and_flip(b, 0, 1, false) == BITMAP_ERROR)
+        fail("first-fit allocation %zu failed", j);
+    first_cycles = timer_cycles() - start;
+
+    fill_prefix(b, ratio);
+    start = timer_cycles();
+    for (j = 0; j < ALLOC_CNT; j++)
+      if (bitmap_scan_and_flip_next(b, 1, false) == BITMAP_ERROR)
+        fail("next-fit allocation %zu failed", j);
+    next_cycles = timer_cycles() - start;
+
+    msg("bench: prefix %2d%% full: %" PRIu64 " cycles/alloc first-fit, %" PRIu64
+        " cycles/alloc next-fit",
+        ratio, first_cycles / ALLOC_CNT, next_cycles / ALLOC_CNT);
+  }
+
+  bitmap_destroy(b);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench ([<<'EOF']);
+(bitmap-bench) begin
+(bitmap-bench) Checking bitmap operations against bit loops...
+(bitmap-bench) Timing scans of a 1048576-bit map...
+(bitmap-bench) Timing 1000 single-bit allocations...
+(bitmap-bench) end
+EOF
+pass;
@@ -0,0 +1,53 @@
+/* Measures how fast kernel threads can be created, run to exit,
+   and joined.  First creates and joins BENCH_ROUNDS threads one
+   at a time, then BENCH_ROUNDS in batches of BATCH_SIZE that all
+   exist at once.  Dying threads' pages are recycled, so after the
+   first few creations neither loop should need to allocate or
+   zero a page. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define BENCH_ROUNDS 1000
+#define BATCH_SIZE 10
+
+static thread_func exit_thread;
+
+static struct semaphore done_sema;
+
+void test_create_bench(void) {
+  uint64_t start, serial_cycles, batch_cycles;
+  int i, j;
+
+  sema_init(&done_sema, 0);
+
+  msg("Creating and joining %d threads one at a time...", BENCH_ROUNDS);
+  start = timer_cycles();
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    if (thread_create("exit", PRI_DEFAULT, exit_thread, NULL) == TID_ERROR)
+      fail("thread_create() failed after %d threads", i);
+    sema_down(&done_sema);
+  }
+  serial_cycles = timer_cycles() - start;
+
+  msg("Creating and joining %d threads in batches of %d...", BENCH_ROUNDS, BATCH_SIZE);
+  start = timer_cycles();
+  for (i = 0; i < BENCH_ROUNDS; i += BATCH_SIZE) {
+    for (j = 0; j < BATCH_SIZE; j++)
+      if (thread_create("exit", PRI_DEFAULT, exit_thread, NULL) == TID_ERROR)
+        fail("thread_create() failed after %d threads", i + j);
+    for (j = 0; j < BATCH_SIZE; j++)
+      sema_down(&done_sema);
+  }
+  batch_cycles = timer_cycles() - start;
+
+  msg("bench: %" PRIu64 " cycles per create/join, one at a time", serial_cycles / BENCH_ROUNDS);
+  msg("bench: %" PRIu64 " cycles per create/join, in batches", batch_cycles / BENCH_ROUNDS);
+}
+
+static void exit_thread(void* aux UNUSED) { sema_up(&done_sema); }
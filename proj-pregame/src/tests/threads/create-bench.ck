@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench ([<<'EOF']);
+(create-bench) begin
+(create-bench) Creating and joining 1000 threads one at a time...
+(create-bench) Creating and joining 1000 threads in batches of 10...
+(create-bench) end
+EOF
+pass;
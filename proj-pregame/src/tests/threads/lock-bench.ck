@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench ([<<'EOF']);
+(lock-bench) begin
+(lock-bench) Acquiring an uncontended lock 10000 times...
+(lock-bench) Handing a contended lock back and forth 10000 times...
+(lock-bench) end
+EOF
+pass;
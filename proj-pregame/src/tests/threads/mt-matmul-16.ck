@@ -2,7 +2,8 @@
 use strict;
 use warnings;
 use tests::tests;
-check_expected ([<<'EOF']);
+use tests::threads::bench;
+check_bench ([<<'EOF']);
 (mt-matmul-16) begin
 (mt-matmul-16) Executing blocked matmul with 16 threads...
 (mt-matmul-16) Matrix results match expected values.
@@ -2,7 +2,8 @@
 use strict;
 use warnings;
 use tests::tests;
-check_expected ([<<'EOF']);
+use tests::threads::bench;
+check_bench ([<<'EOF']);
 (mt-matmul-2) begin
 (mt-matmul-2) Executing blocked matmul with 2 threads...
 (mt-matmul-2) Matrix results match expected values.
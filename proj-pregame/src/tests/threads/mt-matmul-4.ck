@@ -2,7 +2,8 @@
 use strict;
 use warnings;
 use tests::tests;
-check_expected ([<<'EOF']);
+use tests::threads::bench;
+check_bench ([<<'EOF']);
 (mt-matmul-4) begin
 (mt-matmul-4) Executing blocked matmul with 4 threads...
 (mt-matmul-4) Matrix results match expected values.
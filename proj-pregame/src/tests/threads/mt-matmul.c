@@ -7,9 +7,11 @@
 #include <stdio.h>
 #include "tests/threads/tests.h"
 #include "tests/threads/matmul_data.h"
+#include "threads/cpu.h"
 #include "threads/init.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "devices/timer.h"
 
 void __attribute__((noinline)) matmul(const int tid, const int nthreads, const int lda,
                                       const short A[], const short B[], short C[]);
@@ -21,6 +23,7 @@ static short results_data[ARRAY_SIZE];
 struct thread_args {
   int tid;
   int n_threads;
+  struct semaphore* done; /* Upped when this thread finishes. */
 };
 
 void __attribute__((noinline)) matmul(const int tid, const int nthreads, const int lda,
@@ -39,6 +42,7 @@ void thread_entry(void* aux) {
   struct thread_args* args = (struct thread_args*)aux;
 
   matmul(args->tid, args->n_threads, DIM_SIZE, input1_data, input2_data, results_data);
+  sema_up(args->done);
 }
 
 void test_mt_matmul(size_t num_threads) {
@@ -48,15 +52,26 @@ void test_mt_matmul(size_t num_threads) {
   ASSERT(thread_get_priority() == PRI_DEFAULT);
 
   struct thread_args args[num_threads];
+  struct semaphore done;
+  int64_t start;
+
+  sema_init(&done, 0);
+  start = timer_ns();
   for (size_t i = 0; i < num_threads; i++) {
     args[i].tid = i;
     args[i].n_threads = num_threads;
+    args[i].done = &done;
 
     thread_create("matmul", PRI_DEFAULT - 1, thread_entry, (void*)&args[i]);
   }
 
-  /* Let other threads run to completion */
+  /* Let other threads run to completion.  With more than one
+     CPU, lowering our priority is not enough: wait for them. */
   thread_set_priority(PRI_DEFAULT - 2);
+  for (size_t i = 0; i < num_threads; i++)
+    sema_down(&done);
+  msg("bench: %zu threads on %d CPUs took %lld us", num_threads, cpu_cnt,
+      (timer_ns() - start) / 1000);
 
   int res = verifyDouble(ARRAY_SIZE, results_data, verify_data);
 
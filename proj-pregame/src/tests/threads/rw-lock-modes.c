@@ -0,0 +1,112 @@
+/* Checks the admission order of each readers-writers lock mode,
+   and its contention statistics.
+
+   Scenario A: we hold the lock as a reader, a writer starts
+   waiting, and then another reader arrives.  Only a lock that
+   prefers readers lets the new reader in ahead of the writer.
+
+   Scenario B: we hold the lock as a writer, a reader starts
+   waiting, and then another writer.  Only a lock that prefers
+   writers lets the second writer in ahead of the reader; a
+   phase-fair lock hands over to the readers that waited on us. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* A thread that takes the lock once, then records its entry. */
+struct rw_thread {
+  const char* name;          /* Written to the log on entry. */
+  bool reader;               /* Reader or writer? */
+  bool done;                 /* Has it entered and left? */
+  struct semaphore exited;   /* Upped when it is done. */
+};
+
+static struct rw_lock rw;
+static char entry_log[64];
+
+static void rw_thread_func(void* aux) {
+  struct rw_thread* t = aux;
+  enum intr_level old_level;
+
+  rw_lock_acquire(&rw, t->reader);
+  old_level = intr_disable();
+  if (entry_log[0] != '\0')
+    strlcat(entry_log, " ", sizeof entry_log);
+  strlcat(entry_log, t->name, sizeof entry_log);
+  intr_set_level(old_level);
+  rw_lock_release(&rw, t->reader);
+  t->done = true;
+  sema_up(&t->exited);
+}
+
+/* Starts thread T. */
+static void start(struct rw_thread* t, const char* name, bool reader) {
+  t->name = name;
+  t->reader = reader;
+  t->done = false;
+  sema_init(&t->exited, 0);
+  thread_create(name, PRI_DEFAULT, rw_thread_func, t);
+}
+
+/* Returns the number of readers or writers waiting on RW. */
+static int waiting(bool reader) {
+  int cnt;
+
+  lock_acquire(&rw.lock);
+  cnt = reader ? rw.WR : rw.WW;
+  lock_release(&rw.lock);
+  return cnt;
+}
+
+static void scenario_a(void) {
+  struct rw_thread w1, r2;
+
+  entry_log[0] = '\0';
+  rw_lock_acquire(&rw, RW_READER);
+  start(&w1, "W1", RW_WRITER);
+  while (waiting(RW_WRITER) < 1)
+    thread_yield();
+  start(&r2, "R2", RW_READER);
+  while (!r2.done && waiting(RW_READER) < 1)
+    thread_yield();
+  rw_lock_release(&rw, RW_READER);
+  sema_down(&w1.exited);
+  sema_down(&r2.exited);
+}
+
+static void scenario_b(void) {
+  struct rw_thread r1, w2;
+
+  entry_log[0] = '\0';
+  rw_lock_acquire(&rw, RW_WRITER);
+  start(&r1, "R1", RW_READER);
+  while (waiting(RW_READER) < 1)
+    thread_yield();
+  start(&w2, "W2", RW_WRITER);
+  while (waiting(RW_WRITER) < 1)
+    thread_yield();
+  rw_lock_release(&rw, RW_WRITER);
+  sema_down(&r1.exited);
+  sema_down(&w2.exited);
+}
+
+static void check_mode(enum rw_mode mode, const char* name) {
+  rw_lock_init_mode(&rw, mode);
+
+  scenario_a();
+  msg("%s, reader active: %s", name, entry_log);
+  scenario_b();
+  msg("%s, writer active: %s", name, entry_log);
+  msg("%s: %lld acquires, %lld contended", name, rw.stats.acquires, rw.stats.contended);
+}
+
+void test_rw_lock_modes(void) {
+  check_mode(RW_PREFER_WRITERS, "prefer writers");
+  check_mode(RW_PREFER_READERS, "prefer readers");
+  check_mode(RW_PHASE_FAIR, "phase fair");
+}
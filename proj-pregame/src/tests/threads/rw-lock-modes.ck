@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rw-lock-modes) begin
+(rw-lock-modes) prefer writers, reader active: W1 R2
+(rw-lock-modes) prefer writers, writer active: W2 R1
+(rw-lock-modes) prefer writers: 6 acquires, 4 contended
+(rw-lock-modes) prefer readers, reader active: R2 W1
+(rw-lock-modes) prefer readers, writer active: R1 W2
+(rw-lock-modes) prefer readers: 6 acquires, 3 contended
+(rw-lock-modes) phase fair, reader active: W1 R2
+(rw-lock-modes) phase fair, writer active: R1 W2
+(rw-lock-modes) phase fair: 6 acquires, 4 contended
+(rw-lock-modes) end
+EOF
+pass;
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench ([<<'EOF']);
+(sched-bench-mlfqs) begin
+(sched-bench-mlfqs) Spawning 1000 threads...
+(sched-bench-mlfqs) Waiting for threads to finish...
+(sched-bench-mlfqs) end
+EOF
+pass;
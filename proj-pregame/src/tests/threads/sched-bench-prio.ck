@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench ([<<'EOF']);
+(sched-bench-prio) begin
+(sched-bench-prio) Spawning 1000 threads...
+(sched-bench-prio) Waiting for threads to finish...
+(sched-bench-prio) end
+EOF
+pass;
@@ -0,0 +1,67 @@
+/* Measures the cost of scheduling with many runnable threads.
+   Spawns BENCH_THREADS threads spread over every priority below
+   our own, lets each of them yield BENCH_YIELDS times, and
+   reports the average number of TSC cycles per thread_create()
+   and per thread_yield().  With a constant-time run queue
+   neither number should grow with the thread count. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define BENCH_THREADS 1000
+#define BENCH_YIELDS 10
+
+static thread_func yield_thread;
+static void sched_bench(void);
+
+static struct semaphore done_sema;
+
+void test_sched_bench_prio(void) {
+  ASSERT(active_sched_policy == SCHED_PRIO);
+  sched_bench();
+}
+
+void test_sched_bench_mlfqs(void) {
+  ASSERT(active_sched_policy == SCHED_MLFQS);
+  sched_bench();
+}
+
+static void sched_bench(void) {
+  uint64_t start, create_cycles, run_cycles;
+  int i;
+
+  sema_init(&done_sema, 0);
+
+  msg("Spawning %d threads...", BENCH_THREADS);
+  start = timer_cycles();
+  for (i = 0; i < BENCH_THREADS; i++) {
+    /* Under MLFQS the priority argument is ignored. */
+    int priority = PRI_MIN + i % (thread_get_priority() - PRI_MIN);
+    if (thread_create("yielder", priority, yield_thread, NULL) == TID_ERROR)
+      fail("thread_create() failed after %d threads", i);
+  }
+  create_cycles = timer_cycles() - start;
+
+  msg("Waiting for threads to finish...");
+  start = timer_cycles();
+  for (i = 0; i < BENCH_THREADS; i++)
+    sema_down(&done_sema);
+  run_cycles = timer_cycles() - start;
+
+  msg("bench: %" PRIu64 " cycles per thread_create()", create_cycles / BENCH_THREADS);
+  msg("bench: %" PRIu64 " cycles per thread_yield()",
+      run_cycles / (BENCH_THREADS * BENCH_YIELDS));
+}
+
+static void yield_thread(void* aux UNUSED) {
+  int i;
+
+  for (i = 0; i < BENCH_YIELDS; i++)
+    thread_yield();
+  sema_up(&done_sema);
+}
@@ -0,0 +1,76 @@
+/* Checks the object caches: objects from one cache do not
+   overlap, a constructor runs when a slab is created rather than
+   on every allocation, a freed object comes back in its
+   constructed state, and kmem_cache_zalloc() zeroes. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/slab.h"
+
+#define OBJ_CNT 100
+#define OBJ_MAGIC 0x0b1ec7ed
+
+/* A 100-byte object, so that malloc() would round it to 128. */
+struct obj {
+  unsigned magic; /* Set by the constructor. */
+  int id;         /* Set by the test. */
+  char pad[92];
+};
+
+static int ctor_cnt;
+
+static void obj_ctor(void* p) {
+  struct obj* o = p;
+  o->magic = OBJ_MAGIC;
+  ctor_cnt++;
+}
+
+void test_slab_cache(void) {
+  static struct obj* objs[OBJ_CNT];
+  struct kmem_cache* ctor_cache = kmem_cache_create("test-ctor", sizeof(struct obj), obj_ctor);
+  struct kmem_cache* zero_cache = kmem_cache_create("test-zero", sizeof(struct obj), NULL);
+  struct obj* o;
+  int cnt, i;
+  size_t j;
+
+  /* Every object starts out constructed and keeps its own id. */
+  for (i = 0; i < OBJ_CNT; i++) {
+    objs[i] = kmem_cache_alloc(ctor_cache);
+    if (objs[i] == NULL)
+      fail("allocation %d failed", i);
+    if (objs[i]->magic != OBJ_MAGIC)
+      fail("object %d not constructed", i);
+    objs[i]->id = i;
+  }
+  for (i = 0; i < OBJ_CNT; i++)
+    if (objs[i]->id != i)
+      fail("object %d overwritten", i);
+  if (ctor_cnt < OBJ_CNT)
+    fail("constructor ran %d times for %d objects", ctor_cnt, OBJ_CNT);
+  msg("allocated %d constructed objects", OBJ_CNT);
+
+  /* A freed object is reused without running the constructor. */
+  cnt = ctor_cnt;
+  kmem_cache_free(ctor_cache, objs[0]);
+  o = kmem_cache_alloc(ctor_cache);
+  if (o != objs[0])
+    fail("freed object not reused");
+  if (o->magic != OBJ_MAGIC || ctor_cnt != cnt)
+    fail("freed object reconstructed");
+  msg("freed object reused in constructed state");
+
+  for (i = 0; i < OBJ_CNT; i++)
+    kmem_cache_free(ctor_cache, objs[i]);
+
+  /* Zeroed allocation. */
+  o = kmem_cache_zalloc(zero_cache);
+  if (o == NULL)
+    fail("zeroed allocation failed");
+  for (j = 0; j < sizeof *o; j++)
+    if (((unsigned char*)o)[j] != 0)
+      fail("byte %zu of zeroed object is %#x", j, ((unsigned char*)o)[j]);
+  kmem_cache_free(zero_cache, o);
+  msg("zeroed object is zero");
+}
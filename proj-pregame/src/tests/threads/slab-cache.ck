@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(slab-cache) begin
+(slab-cache) allocated 100 constructed objects
+(slab-cache) freed object reused in constructed state
+(slab-cache) zeroed object is zero
+(slab-cache) end
+EOF
+pass;
@@ -0,0 +1,80 @@
+/* Checks softirqs and tasklets.  Schedules tasklets from a
+   thread and from a timer, which now fires from the timer
+   softirq, and checks that each runs once per scheduling, in
+   interrupt context but with interrupts on. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define TASKLET_CNT 10
+#define RESCHEDULE_CNT 5
+
+static struct tasklet tasklets[TASKLET_CNT];
+static int run_cnt[TASKLET_CNT];
+static bool bad_context;
+
+static void count_tasklet(void* aux) {
+  int* cnt = aux;
+
+  if (!intr_context() || intr_get_level() != INTR_ON)
+    bad_context = true;
+  (*cnt)++;
+}
+
+static void reschedule_tasklet(void* aux) {
+  struct tasklet* t = aux;
+
+  if (++run_cnt[0] < RESCHEDULE_CNT)
+    tasklet_schedule(t);
+}
+
+static void schedule_from_timer(void* aux) {
+  if (!intr_context() || intr_get_level() != INTR_OFF)
+    bad_context = true;
+  tasklet_schedule(aux);
+}
+
+void test_softirq(void) {
+  struct timer_event timer;
+  int i;
+
+  /* Each scheduled tasklet runs once, even if scheduled twice
+     before it gets to. */
+  for (i = 0; i < TASKLET_CNT; i++) {
+    tasklet_init(&tasklets[i], count_tasklet, &run_cnt[i]);
+    tasklet_schedule(&tasklets[i]);
+    tasklet_schedule(&tasklets[i]);
+  }
+  timer_sleep(2);
+  for (i = 0; i < TASKLET_CNT; i++)
+    if (run_cnt[i] != 1)
+      fail("tasklet %d ran %d times", i, run_cnt[i]);
+  if (bad_context)
+    fail("tasklet ran outside interrupt context or with interrupts off");
+  msg("Scheduled %d tasklets, each ran once.", TASKLET_CNT);
+
+  /* A tasklet may schedule itself again. */
+  run_cnt[0] = 0;
+  tasklet_init(&tasklets[0], reschedule_tasklet, &tasklets[0]);
+  tasklet_schedule(&tasklets[0]);
+  timer_sleep(2);
+  if (run_cnt[0] != RESCHEDULE_CNT)
+    fail("rescheduled tasklet ran %d times", run_cnt[0]);
+  msg("Tasklet rescheduled itself %d times.", RESCHEDULE_CNT);
+
+  /* Timers fire from a softirq and may schedule tasklets. */
+  run_cnt[1] = 0;
+  tasklet_init(&tasklets[1], count_tasklet, &run_cnt[1]);
+  timer_event_init(&timer, schedule_from_timer, &tasklets[1]);
+  timer_add(&timer, timer_ticks() + 1);
+  timer_sleep(3);
+  if (run_cnt[1] != 1)
+    fail("tasklet from timer ran %d times", run_cnt[1]);
+  if (bad_context)
+    fail("timer or tasklet ran in the wrong context");
+  msg("Timer scheduled a tasklet that ran once.");
+}
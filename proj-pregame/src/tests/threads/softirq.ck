@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(softirq) begin
+(softirq) Scheduled 10 tasklets, each ran once.
+(softirq) Tasklet rescheduled itself 5 times.
+(softirq) Timer scheduled a tasklet that ran once.
+(softirq) end
+EOF
+pass;
@@ -2,7 +2,8 @@
 use strict;
 use warnings;
 use tests::tests;
-check_expected ([<<'EOF']);
+use tests::threads::bench;
+check_bench ([<<'EOF']);
 (st-matmul) begin
 (st-matmul) Executing single-threaded matmul...
 (st-matmul) Matrix results match expected values.
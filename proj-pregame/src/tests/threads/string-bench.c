@@ -0,0 +1,237 @@
+/* Checks memcpy(), memmove(), memset() and memcmp() against the
+   byte-at-a-time loops they replaced, and then times them.
+
+   The check runs each function at every combination of source
+   and destination misalignment, on sizes around the point where
+   the word loops take over, and on overlapping blocks in both
+   directions for memmove().
+
+   Each timing moves about BENCH_BYTES bytes in total.  memmove()
+   moves a block 4 bytes up within one buffer, so that it has to
+   copy backward, and memcmp() compares equal blocks, so that it
+   has to look at every byte. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define BENCH_BYTES (256 * 1024)
+#define MAX_SIZE (64 * 1024)
+#define BUF_PAGES (MAX_SIZE / PGSIZE + 1)
+
+/* Bytes either side of a block that the check also compares, to
+   catch writes past its ends. */
+#define GUARD 16
+
+static void* byte_memcpy(void* dst_, const void* src_, size_t size) {
+  unsigned char* dst = dst_;
+  const unsigned char* src = src_;
+
+  while (size-- > 0)
+    *dst++ = *src++;
+  return dst_;
+}
+
+static void* byte_memmove(void* dst_, const void* src_, size_t size) {
+  unsigned char* dst = dst_;
+  const unsigned char* src = src_;
+
+  if (dst < src) {
+    while (size-- > 0)
+      *dst++ = *src++;
+  } else {
+    dst += size;
+    src += size;
+    while (size-- > 0)
+      *--dst = *--src;
+  }
+  return dst_;
+}
+
+static void* byte_memset(void* dst_, int value, size_t size) {
+  unsigned char* dst = dst_;
+
+  while (size-- > 0)
+    *dst++ = value;
+  return dst_;
+}
+
+static int byte_memcmp(const void* a_, const void* b_, size_t size) {
+  const unsigned char* a = a_;
+  const unsigned char* b = b_;
+
+  for (; size-- > 0; a++, b++)
+    if (*a != *b)
+      return *a > *b ? +1 : -1;
+  return 0;
+}
+
+/* Operations to check and time, old and new. */
+enum op { OP_MEMCPY, OP_MEMMOVE, OP_MEMSET, OP_MEMCMP };
+static const char* op_names[] = {"memcpy", "memmove", "memset", "memcmp"};
+
+static uint8_t *buf_a, *buf_b;
+
+/* Fills bytes OFS...OFS+LEN of both buffers with the same
+   pattern, varied by SEED. */
+static void fill_both(size_t ofs, size_t len, unsigned seed) {
+  size_t i;
+
+  for (i = ofs; i < ofs + len; i++)
+    buf_a[i] = buf_b[i] = i * 37 + seed;
+}
+
+/* Fails unless bytes OFS...OFS+LEN of the two buffers are equal,
+   after running OP on SIZE bytes at DST_OFS and SRC_OFS. */
+static void check_same(enum op op, size_t ofs, size_t len, size_t size, size_t dst_ofs,
+                       size_t src_ofs) {
+  size_t i;
+
+  for (i = ofs; i < ofs + len; i++)
+    if (buf_a[i] != buf_b[i])
+      fail("%s of %zu bytes from %zu to %zu: byte %zu is %#x, expected %#x", op_names[op], size,
+           src_ofs, dst_ofs, i, buf_a[i], buf_b[i]);
+}
+
+/* Runs OP on SIZE bytes at DST_OFS and SRC_OFS, new functions in
+   buf_a and byte loops in buf_b, and checks that both leave the
+   same bytes and that the new function returns what the byte loop
+   would. */
+static void check_op(enum op op, size_t size, size_t dst_ofs, size_t src_ofs) {
+  size_t lo = (dst_ofs < src_ofs ? dst_ofs : src_ofs) - GUARD;
+  size_t hi = (dst_ofs > src_ofs ? dst_ofs : src_ofs) + size + GUARD;
+  void *dst_a = buf_a + dst_ofs, *dst_b = buf_b + dst_ofs;
+  int cmp_a, cmp_b, i;
+
+  fill_both(lo, hi - lo, size + dst_ofs * 3 + src_ofs);
+  switch (op) {
+    case OP_MEMCPY:
+      if (memcpy(dst_a, buf_a + src_ofs, size) != dst_a)
+        fail("memcpy did not return its destination");
+      byte_memcpy(dst_b, buf_b + src_ofs, size);
+      break;
+    case OP_MEMMOVE:
+      if (memmove(dst_a, buf_a + src_ofs, size) != dst_a)
+        fail("memmove did not return its destination");
+      byte_memmove(dst_b, buf_b + src_ofs, size);
+      break;
+    case OP_MEMSET:
+      if (memset(dst_a, src_ofs, size) != dst_a)
+        fail("memset did not return its destination");
+      byte_memset(dst_b, src_ofs, size);
+      break;
+    case OP_MEMCMP:
+      /* Compare a copy of the source with the source, first equal
+         and then with one byte changed, in the middle and at the
+         end, up and down. */
+      byte_memcpy(dst_a, buf_a + src_ofs, size);
+      byte_memcpy(dst_b, buf_b + src_ofs, size);
+      if (memcmp(dst_a, buf_a + src_ofs, size) != 0)
+        fail("memcmp of %zu equal bytes returned nonzero", size);
+      for (i = 0; i < 4 && size > 0; i++) {
+        uint8_t* p = buf_a + dst_ofs + (i < 2 ? size / 2 : size - 1);
+        int delta = i % 2 ? -1 : 1;
+
+        *p += delta;
+        cmp_a = memcmp(dst_a, buf_a + src_ofs, size);
+        cmp_b = byte_memcmp(dst_a, buf_a + src_ofs, size);
+        if ((cmp_a > 0) != (cmp_b > 0) || (cmp_a < 0) != (cmp_b < 0))
+          fail("memcmp of %zu bytes differing at byte %zu returned %d, expected %d", size,
+               (size_t)(p - (uint8_t*)dst_a), cmp_a, cmp_b);
+        *p -= delta;
+      }
+      break;
+  }
+  check_same(op, lo, hi - lo, size, dst_ofs, src_ofs);
+}
+
+/* Checks every operation on misaligned and overlapping blocks. */
+static void check_all(void) {
+  /* Sizes around string.c's WORD_MIN of 16, and a few larger
+     ones with odd tails. */
+  static const size_t big_sizes[] = {63, 64, 65, 255, 4099};
+  static const int overlaps[] = {-9, -4, -3, -1, 1, 3, 4, 9};
+  const size_t base = 2 * GUARD + 16;
+  const size_t apart = 4096 + 256;
+  enum op op;
+  size_t size, dst_mis, src_mis, i;
+
+  for (op = OP_MEMCPY; op <= OP_MEMCMP; op++)
+    for (size = 0; size < 40 + sizeof big_sizes / sizeof *big_sizes; size++) {
+      size_t n = size < 40 ? size : big_sizes[size - 40];
+      for (dst_mis = 0; dst_mis < 4; dst_mis++)
+        for (src_mis = 0; src_mis < 4; src_mis++)
+          check_op(op, n, base + dst_mis, base + apart + src_mis);
+    }
+
+  for (size = 0; size < 40 + sizeof big_sizes / sizeof *big_sizes; size++) {
+    size_t n = size < 40 ? size : big_sizes[size - 40];
+    for (src_mis = 0; src_mis < 4; src_mis++)
+      for (i = 0; i < sizeof overlaps / sizeof *overlaps; i++)
+        check_op(OP_MEMMOVE, n, base + src_mis + overlaps[i], base + src_mis);
+  }
+}
+
+/* Returns the average cycles per call of OP on SIZE bytes, using
+   the byte loops if OLD is true. */
+static uint64_t time_op(enum op op, size_t size, bool old) {
+  size_t iters = BENCH_BYTES / size, i;
+  uint64_t start = timer_cycles();
+
+  for (i = 0; i < iters; i++)
+    switch (op) {
+      case OP_MEMCPY:
+        (old ? byte_memcpy : memcpy)(buf_a, buf_b, size);
+        break;
+      case OP_MEMMOVE:
+        (old ? byte_memmove : memmove)(buf_a + 4, buf_a, size);
+        break;
+      case OP_MEMSET:
+        (old ? byte_memset : memset)(buf_a, i, size);
+        break;
+      case OP_MEMCMP:
+        if ((old ? byte_memcmp : memcmp)(buf_a, buf_b, size) != 0)
+          fail("%s of equal blocks returned nonzero", op_names[op]);
+        break;
+    }
+  return (timer_cycles() - start) / iters;
+}
+
+void test_string_bench(void) {
+  static const size_t sizes[] = {8, 64, 512, 4096, MAX_SIZE};
+  enum op op;
+  size_t i;
+
+  buf_a = palloc_get_multiple(PAL_ZERO, BUF_PAGES);
+  buf_b = palloc_get_multiple(PAL_ZERO, BUF_PAGES);
+  if (buf_a == NULL || buf_b == NULL)
+    fail("out of memory for %d-byte buffers", BUF_PAGES * PGSIZE);
+
+  msg("Checking block functions against byte loops...");
+  check_all();
+
+  msg("Timing block functions against byte loops...");
+  for (op = OP_MEMCPY; op <= OP_MEMCMP; op++)
+    for (i = 0; i < sizeof sizes / sizeof *sizes; i++) {
+      uint64_t old_cycles, new_cycles;
+
+      /* Start each pair from equal blocks, for memcmp(). */
+      memset(buf_a, 0, BUF_PAGES * PGSIZE);
+      memset(buf_b, 0, BUF_PAGES * PGSIZE);
+      old_cycles = time_op(op, sizes[i], true);
+      new_cycles = time_op(op, sizes[i], false);
+      msg("bench: %s %5zu bytes: %" PRIu64 " cycles/call byte loop, %" PRIu64
+          " cycles/call new, %" PRIu64 ".%" PRIu64 "x",
+          op_names[op], sizes[i], old_cycles, new_cycles,
+          new_cycles ? old_cycles / new_cycles : 0,
+          new_cycles ? old_cycles * 10 / new_cycles % 10 : 0);
+    }
+
+  palloc_free_multiple(buf_a, BUF_PAGES);
+  palloc_free_multiple(buf_b, BUF_PAGES);
+}
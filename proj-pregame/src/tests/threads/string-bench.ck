@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench ([<<'EOF']);
+(string-bench) begin
+(string-bench) Checking block functions against byte loops...
+(string-bench) Timing block functions against byte loops...
+(string-bench) end
+EOF
+pass;
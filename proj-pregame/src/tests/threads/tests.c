@@ -50,7 +50,17 @@ static const struct test threads_tests[] = {
     {"smfs-hierarchy-16", test_smfs_hierarchy_16},
     {"smfs-hierarchy-32", test_smfs_hierarchy_32},
     {"smfs-hierarchy-64", test_smfs_hierarchy_64},
-    {"smfs-hierarchy-256", test_smfs_hierarchy_256}};
+    {"smfs-hierarchy-256", test_smfs_hierarchy_256},
+    {"sched-bench-prio", test_sched_bench_prio},
+    {"sched-bench-mlfqs", test_sched_bench_mlfqs},
+    {"lock-bench", test_lock_bench},
+    {"workqueue", test_workqueue},
+    {"softirq", test_softirq},
+    {"create-bench", test_create_bench},
+    {"rw-lock-modes", test_rw_lock_modes},
+    {"slab-cache", test_slab_cache},
+    {"string-bench", test_string_bench},
+    {"bitmap-bench", test_bitmap_bench}};
 
 /* Runs the threads test named NAME. */
 void run_threads_test(const char* name) {
@@ -52,5 +52,15 @@ extern test_func test_smfs_hierarchy_16;
 extern test_func test_smfs_hierarchy_32;
 extern test_func test_smfs_hierarchy_64;
 extern test_func test_smfs_hierarchy_256;
+extern test_func test_sched_bench_prio;
+extern test_func test_sched_bench_mlfqs;
+extern test_func test_lock_bench;
+extern test_func test_workqueue;
+extern test_func test_softirq;
+extern test_func test_create_bench;
+extern test_func test_rw_lock_modes;
+extern test_func test_slab_cache;
+extern test_func test_string_bench;
+extern test_func test_bitmap_bench;
 
 #endif /* tests/threads/tests.h */
@@ -0,0 +1,70 @@
+/* Checks the kernel work queue.  Queues works at every priority
+   and checks that each runs exactly once, that a delayed work
+   does not run before its delay is up, even if queued again
+   meanwhile, and that a cancelled work never runs. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+#define WORK_CNT 30
+#define DELAY_TICKS 10
+
+static struct work works[WORK_CNT];
+static int run_cnt[WORK_CNT];
+static int64_t ran_at;
+
+static void count_work(void* aux) {
+  int* cnt = aux;
+  enum intr_level old_level = intr_disable();
+  (*cnt)++;
+  intr_set_level(old_level);
+}
+
+static void stamp_work(void* aux UNUSED) { ran_at = timer_ticks(); }
+
+void test_workqueue(void) {
+  struct work w;
+  int64_t start;
+  int i;
+
+  /* Every queued work runs once. */
+  for (i = 0; i < WORK_CNT; i++) {
+    work_init(&works[i], count_work, &run_cnt[i], i % WORK_PRI_CNT);
+    work_queue(&works[i]);
+  }
+  for (i = 0; i < WORK_CNT; i++)
+    work_flush(&works[i]);
+  for (i = 0; i < WORK_CNT; i++)
+    if (run_cnt[i] != 1)
+      fail("work %d ran %d times", i, run_cnt[i]);
+  msg("Queued %d works, each ran once.", WORK_CNT);
+
+  /* Delayed work waits, and can't be queued twice. */
+  work_init(&w, stamp_work, NULL, WORK_HIGH);
+  start = timer_ticks();
+  if (!work_queue_delayed(&w, DELAY_TICKS))
+    fail("work_queue_delayed() on idle work failed");
+  if (work_queue(&w))
+    fail("work_queue() on pending work succeeded");
+  work_flush(&w);
+  if (ran_at - start < DELAY_TICKS)
+    fail("delayed work ran after %lld ticks", ran_at - start);
+  msg("Delayed work ran after at least %d ticks.", DELAY_TICKS);
+
+  /* Cancelled work does not run. */
+  ran_at = 0;
+  work_queue_delayed(&w, DELAY_TICKS);
+  if (!work_cancel(&w))
+    fail("work_cancel() on pending work failed");
+  timer_sleep(2 * DELAY_TICKS);
+  if (ran_at != 0)
+    fail("cancelled work ran");
+  if (work_cancel(&w))
+    fail("work_cancel() on idle work succeeded");
+  msg("Cancelled work did not run.");
+}
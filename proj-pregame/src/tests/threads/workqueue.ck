@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) Queued 30 works, each ran once.
+(workqueue) Delayed work ran after at least 10 ticks.
+(workqueue) Cancelled work did not run.
+(workqueue) end
+EOF
+pass;
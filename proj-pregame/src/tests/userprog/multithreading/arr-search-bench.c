@@ -0,0 +1,84 @@
+/* Times a search of a large array split across 1, 2, 4 and 8
+   threads, to measure the cost of creating and joining user
+   threads against the work they share.  Also checks that every
+   split finds the right answer. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+#include <pthread.h>
+#include <syscall.h>
+#include <time.h>
+
+#define ARR_SIZE (1 << 16)
+#define MAX_THREADS 8
+#define ROUNDS 16
+
+int arr[ARR_SIZE];
+
+struct thread_data {
+  int start_idx; /* Inclusive. */
+  int end_idx;   /* Exclusive. */
+  int elem;      /* Elem to find. */
+  int elem_idx;  /* Where ELEM was found, or -1. */
+};
+
+void thread_function(void* arg_);
+
+/* Searches for elem in range [start_idx, end_idx). */
+void thread_function(void* arg_) {
+  struct thread_data* d = arg_;
+
+  d->elem_idx = -1;
+  for (int i = d->start_idx; i < d->end_idx; i++)
+    if (arr[i] == d->elem) {
+      d->elem_idx = i;
+      break;
+    }
+}
+
+static int64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Searches for ELEM with THREAD_CNT threads and returns where it
+   was found, or -1. */
+static int search(int elem, int thread_cnt) {
+  struct thread_data data[MAX_THREADS];
+  tid_t tids[MAX_THREADS];
+  int chunk = ARR_SIZE / thread_cnt;
+  int found = -1;
+
+  for (int i = 0; i < thread_cnt; i++) {
+    data[i].start_idx = i * chunk;
+    data[i].end_idx = (i + 1) * chunk;
+    data[i].elem = elem;
+    tids[i] = pthread_check_create(thread_function, &data[i]);
+  }
+  for (int i = 0; i < thread_cnt; i++) {
+    pthread_check_join(tids[i]);
+    if (data[i].elem_idx >= 0)
+      found = data[i].elem_idx;
+  }
+  return found;
+}
+
+void test_main(void) {
+  for (int i = 0; i < ARR_SIZE; i++)
+    arr[i] = ARR_SIZE - i - 1;
+
+  for (int thread_cnt = 1; thread_cnt <= MAX_THREADS; thread_cnt *= 2) {
+    int64_t start = now_us();
+    for (int r = 0; r < ROUNDS; r++) {
+      /* Alternate between the last element and a missing one,
+         so that every thread scans its whole chunk. */
+      int elem = r % 2 == 0 ? 0 : ARR_SIZE;
+      int expected = r % 2 == 0 ? ARR_SIZE - 1 : -1;
+      if (search(elem, thread_cnt) != expected)
+        fail("search with %d threads got the wrong answer", thread_cnt);
+    }
+    msg("bench: %d threads: %lld us per search", thread_cnt, (now_us() - start) / ROUNDS);
+  }
+  msg("Searches found the right answers.");
+}
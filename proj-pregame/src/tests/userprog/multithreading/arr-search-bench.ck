@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench ([<<'EOF']);
+(arr-search-bench) begin
+(arr-search-bench) Searches found the right answers.
+(arr-search-bench) end
+arr-search-bench: exit(0)
+EOF
+pass;
@@ -0,0 +1,95 @@
+/* Measures user lock throughput, uncontended in one thread and
+   contended among several, for futex-backed locks that stay in
+   user mode when they can, and for locks that enter the kernel on
+   every acquire and release.  Also checks that the contended
+   counters come out right. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+#include <pthread.h>
+#include <syscall.h>
+#include <time.h>
+
+#define UNCONTENDED_ITERS 20000
+#define CONTENDED_THREADS 4
+#define CONTENDED_ITERS 2000
+
+/* Lock under test and its operations. */
+struct lock_ops {
+  const char* name;
+  void (*acquire)(lock_t*);
+  void (*release)(lock_t*);
+};
+
+static void trap_acquire(lock_t*);
+static void trap_release(lock_t*);
+
+static const struct lock_ops lock_types[] = {
+    {"futex", lock_acquire, lock_release},
+    {"trap", trap_acquire, trap_release},
+};
+
+static const struct lock_ops* cur_ops;
+static lock_t lock;
+static int counter;
+
+/* Stand-ins for locks kept in the kernel: the same lock, with a
+   system call that does nothing in front of every operation. */
+static void trap_acquire(lock_t* l) {
+  futex_wake(&l->state, 0);
+  lock_acquire(l);
+}
+
+static void trap_release(lock_t* l) {
+  lock_release(l);
+  futex_wake(&l->state, 0);
+}
+
+static int64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void thread_function(void* arg_);
+
+/* Increments COUNTER under the lock CONTENDED_ITERS times. */
+void thread_function(void* arg_ UNUSED) {
+  for (int i = 0; i < CONTENDED_ITERS; i++) {
+    cur_ops->acquire(&lock);
+    counter++;
+    cur_ops->release(&lock);
+  }
+}
+
+void test_main(void) {
+  for (size_t t = 0; t < sizeof lock_types / sizeof *lock_types; t++) {
+    tid_t tids[CONTENDED_THREADS];
+    int64_t start, us;
+
+    cur_ops = &lock_types[t];
+    lock_check_init(&lock);
+
+    start = now_us();
+    for (int i = 0; i < UNCONTENDED_ITERS; i++) {
+      cur_ops->acquire(&lock);
+      cur_ops->release(&lock);
+    }
+    us = now_us() - start;
+    msg("bench: %s uncontended: %d pairs in %lld us", cur_ops->name, UNCONTENDED_ITERS, us);
+
+    counter = 0;
+    start = now_us();
+    for (int i = 0; i < CONTENDED_THREADS; i++)
+      tids[i] = pthread_check_create(thread_function, NULL);
+    for (int i = 0; i < CONTENDED_THREADS; i++)
+      pthread_check_join(tids[i]);
+    us = now_us() - start;
+    msg("bench: %s contended: %d threads x %d pairs in %lld us", cur_ops->name,
+        CONTENDED_THREADS, CONTENDED_ITERS, us);
+
+    if (counter != CONTENDED_THREADS * CONTENDED_ITERS)
+      fail("%s lock lost updates: counter is %d", cur_ops->name, counter);
+  }
+  msg("Counters are correct.");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench ([<<'EOF']);
+(futex-bench) begin
+(futex-bench) Counters are correct.
+(futex-bench) end
+futex-bench: exit(0)
+EOF
+pass;
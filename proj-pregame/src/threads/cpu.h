@@ -0,0 +1,43 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Maximum number of CPUs we will bring up. */
+#define CPU_MAX 8
+
+/* Per-CPU state.  cpus[0] is the bootstrap processor (BSP),
+   which runs main(); the others are application processors
+   (APs) started by smp_init(). */
+struct cpu {
+  int id;                     /* Index in cpus[]. */
+  uint8_t apic_id;            /* Local APIC ID. */
+  volatile bool started;      /* Set by the CPU once it is running. */
+  struct thread* idle_thread; /* Runs when there is nothing else. */
+
+  /* Owned by interrupt.c. */
+  bool in_external_intr;    /* Are we processing an external interrupt? */
+  bool yield_on_return;     /* Should we yield on interrupt return? */
+  bool in_softirq;          /* Are we running softirqs? */
+  uint32_t softirq_pending; /* Bit N set if softirq N is raised. */
+  uint64_t irqoff_start;    /* timer_cycles() when interrupts went off. */
+  uintptr_t irqoff_site;    /* Who turned them off. */
+
+#ifdef USERPROG
+  /* Owned by userprog/pagedir.c. */
+  uint32_t* active_pd;     /* Page directory in CR3, or null. */
+  volatile bool tlb_flush; /* Set until this CPU flushes its TLB. */
+#endif
+};
+
+/* CPUs that are running, in cpus[0] through cpus[cpu_cnt - 1]. */
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+struct cpu* cpu_current(void);
+
+/* Returns true if running on the bootstrap processor. */
+static inline bool cpu_is_bsp(void) { return cpu_current() == &cpus[0]; }
+
+#endif /* threads/cpu.h */
@@ -12,6 +12,7 @@
 #include "devices/kbd.h"
 #include "devices/input.h"
 #include "devices/serial.h"
+#include "devices/profile.h"
 #include "devices/shutdown.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
@@ -24,6 +25,8 @@
 #include "threads/pte.h"
 #include "threads/thread.h"
 #include "threads/shell.h"           //new
+#include "threads/smp.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -59,19 +62,43 @@ static const char* scratch_bdev_name;
 #ifdef VM
 static const char* swap_bdev_name;
 #endif
+
+/* -iotrace: Number of block I/O trace records to keep, or 0 to
+   disable tracing. */
+static size_t iotrace_cnt;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -profile: Number of timer-tick samples to keep, or 0 to
+   disable the sampling profiler. */
+static size_t profile_cnt;
+
+/* -boottime: Print how long each boot phase took? */
+static bool print_boot_times;
+
+/* Boot phases timed by boot_phase(), in TSC cycles. */
+#define BOOT_PHASE_MAX 16
+static struct boot_time {
+  const char* name; /* Phase name. */
+  uint64_t cycles;  /* Duration in TSC cycles. */
+} boot_times[BOOT_PHASE_MAX];
+static size_t boot_time_cnt;
+static uint64_t boot_phase_start; /* TSC at end of previous phase. */
+
 static void bss_init(void);
 static void paging_init(void);
 
 static char** read_command_line(void);
 static char** parse_options(char** argv);
+static size_t parse_count(const char* name, const char* value, size_t default_cnt);
 static void run_actions(char** argv);
 static void usage(void);
 
+static void boot_phase(const char* name);
+static void print_boot_phases(void);
+
 #ifdef FILESYS
 static void locate_block_devices(void);
 static void locate_block_device(enum block_type, const char* name);
@@ -84,6 +111,10 @@ int main(void) {
   /* Clear BSS. */
   bss_init();
 
+  /* The TSC starts counting at reset, so its value here is the
+     time spent in the BIOS and the loader. */
+  boot_phase("firmware+loader");
+
   /* Break command line into arguments and parse options. */
   argv = read_command_line();
   argv = parse_options(argv);
@@ -95,11 +126,17 @@ int main(void) {
 
   /* Greet user. */
   printf("Pintos booting with %'" PRIu32 " kB RAM...\n", init_ram_pages * PGSIZE / 1024);
+  boot_phase("early init");
 
   /* Initialize memory system. */
   palloc_init(user_page_limit);
+  boot_phase("palloc_init");
   malloc_init();
+  boot_phase("malloc_init");
   paging_init();
+  boot_phase("paging_init");
+  if (profile_cnt > 0)
+    profile_init(profile_cnt);
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -120,24 +157,35 @@ int main(void) {
   userprog_init();
 #endif
 
+  boot_phase("interrupts");
+
   /* Start thread scheduler and enable interrupts. */
   thread_start();
   serial_init_queue();
   timer_calibrate();
 
-  /* 修改 */
-  synch_init();
+  boot_phase("scheduler+calibrate");
+  smp_init();
+  boot_phase("smp");
+  workqueue_init();
   
 #ifdef FILESYS
   /* Initialize file system. */
+  if (iotrace_cnt > 0)
+    block_trace_init(iotrace_cnt);
   ide_init();
+  boot_phase("ide_init");
   locate_block_devices();
   filesys_init(format_filesys);
+  boot_phase("filesys_init");
   #ifdef VM
   swap_init();
+  boot_phase("swap_init");
   #endif
 #endif
 
+  if (print_boot_times)
+    print_boot_phases();
   printf("Boot complete.\n");
 
   if (*argv != NULL) {
@@ -165,6 +213,30 @@ static void bss_init(void) {
   memset(&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Records that boot phase NAME ended now, having started where
+   the previous phase ended.  Cheap enough to do on every boot;
+   the results are only printed with -boottime. */
+static void boot_phase(const char* name) {
+  uint64_t now = timer_cycles();
+
+  if (boot_time_cnt < BOOT_PHASE_MAX) {
+    boot_times[boot_time_cnt].name = name;
+    boot_times[boot_time_cnt].cycles = now - boot_phase_start;
+    boot_time_cnt++;
+  }
+  boot_phase_start = now;
+}
+
+/* Prints the boot phases recorded by boot_phase(). */
+static void print_boot_phases(void) {
+  size_t i;
+
+  printf("Boot time breakdown (TSC cycles):\n");
+  for (i = 0; i < boot_time_cnt; i++)
+    printf("  %-20s %'15" PRIu64 "\n", boot_times[i].name, boot_times[i].cycles);
+  printf("  %-20s %'15" PRIu64 "\n", "total", boot_phase_start);
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
@@ -200,6 +272,31 @@ static void paging_init(void) {
   asm volatile("movl %0, %%cr3" : : "r"(vtop(init_page_dir)));
 }
 
+/* Maps the page of memory-mapped device registers at physical
+   address PADDR, uncached, into the kernel's address space and
+   returns its kernel virtual address.  Device registers live
+   above any RAM we support, so the page is mapped at the
+   virtual address equal to PADDR.  Must be called before any
+   user page directory is created, since those copy their kernel
+   mappings from init_page_dir. */
+void* paging_map_mmio(uintptr_t paddr) {
+  void* vaddr = (void*)paddr;
+  uint32_t* pd = init_page_dir;
+  uint32_t* pt;
+
+  ASSERT(pg_ofs(vaddr) == 0);
+  ASSERT(paddr >= LOADER_PHYS_BASE + init_ram_pages * PGSIZE);
+
+  if (pd[pd_no(vaddr)] == 0)
+    pd[pd_no(vaddr)] = pde_create(palloc_get_page(PAL_ASSERT | PAL_ZERO));
+  pt = pde_get_pt(pd[pd_no(vaddr)]);
+  pt[pt_no(vaddr)] = paddr | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+
+  /* Flush the TLB by reloading CR3. */
+  asm volatile("movl %0, %%cr3" : : "r"(vtop(init_page_dir)) : "memory");
+  return vaddr;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char** read_command_line(void) {
@@ -255,6 +352,8 @@ static char** parse_options(char** argv) {
       filesys_bdev_name = value;
     else if (!strcmp(name, "-scratch"))
       scratch_bdev_name = value;
+    else if (!strcmp(name, "-iotrace"))
+      iotrace_cnt = parse_count(name, value, BLOCK_TRACE_DEFAULT);
 #ifdef VM
     else if (!strcmp(name, "-swap"))
       swap_bdev_name = value;
@@ -262,6 +361,14 @@ static char** parse_options(char** argv) {
 #endif
     else if (!strcmp(name, "-rs"))
       random_init(atoi(value));
+    else if (!strcmp(name, "-boottime"))
+      print_boot_times = true;
+    else if (!strcmp(name, "-tickless"))
+      timer_tickless = true;
+    else if (!strcmp(name, "-irqoff"))
+      intr_off_tracking = true;
+    else if (!strcmp(name, "-profile"))
+      profile_cnt = parse_count(name, value, PROFILE_DEFAULT);
     else if (!strcmp(name, "-sched")) {
       if (!strcmp(value, "fifo"))
         scheduler_flags[SCHED_FIFO] = 1;
@@ -321,6 +428,25 @@ static char** parse_options(char** argv) {
   return argv;
 }
 
+/* Parses VALUE, the argument to option NAME, as a positive
+   count.  Returns DEFAULT_CNT if VALUE is null.  Panics if VALUE
+   is not a positive decimal number. */
+static size_t parse_count(const char* name, const char* value, size_t default_cnt) {
+  const char* p;
+  size_t cnt = 0;
+
+  if (value == NULL)
+    return default_cnt;
+  for (p = value; *p >= '0' && *p <= '9'; p++) {
+    if (cnt > (SIZE_MAX - 9) / 10)
+      PANIC("count `%s' for option `%s' too large (use -h for help)", value, name);
+    cnt = cnt * 10 + (*p - '0');
+  }
+  if (p == value || *p != '\0' || cnt == 0)
+    PANIC("bad count `%s' for option `%s' (use -h for help)", value, name);
+  return cnt;
+}
+
 /* Runs the task specified in ARGV[1]. */
 static void run_task(char** argv) {
   const char* task = argv[1];
@@ -435,11 +561,16 @@ static void usage(void) {
          "  -f                 Format file system device during startup.\n"
          "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
          "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+         "  -iotrace[=COUNT]   Trace the last COUNT block requests, dump at shutdown.\n"
 #ifdef VM
          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif // VM
 #endif // FILESYS
          "  -rs=SEED           Set random number seed to SEED.\n"
+         "  -boottime          Print the time spent in each boot phase.\n"
+         "  -tickless          Stop the timer tick while the CPU is idle.\n"
+         "  -irqoff            Report the longest interrupts-off stretches.\n"
+         "  -profile[=COUNT]   Sample the last COUNT timer ticks, dump at shutdown.\n"
          "  -sched-fair        Use alternate non-strict priority scheduler. Mutually exclusive "
          "with \"-sched-mlfqs\", \"-sched-prio\".\n"
          "  -sched-mlfqs       Use multi-level feedback queue scheduler. Mutually exclusive with "
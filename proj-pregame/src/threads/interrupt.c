@@ -3,14 +3,18 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/spinlock.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/gdt.h"
+#include "userprog/process.h"
 #endif
 
 /* Programmable Interrupt Controller (PIC) registers.
@@ -46,13 +50,73 @@ static unsigned int unexpected_cnt[INTR_CNT];
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr; /* Are we processing an external interrupt? */
-static bool yield_on_return;  /* Should we yield on interrupt return? */
+   interrupt returns.  Each CPU tracks this in its struct cpu. */
+
+/* Much of the kernel protects shared data by turning interrupts
+   off, which on its own only keeps out other code on the same
+   CPU.  So once other CPUs are running, each CPU also holds
+   intr_lock whenever its interrupts are off: intr_disable() and
+   interrupt entry acquire it, and intr_enable() and interrupt
+   return release it.  A thread switch happens with interrupts
+   off, so the lock passes from the old thread to the new one on
+   the same CPU.  This keeps every interrupts-off critical section
+   correct on SMP, at the cost of serializing all of them; code
+   that runs with interrupts on, such as user programs and most
+   kernel computation, runs in parallel. */
+static struct spinlock intr_lock;
+static bool intr_lock_enabled; /* Set by intr_smp_start(). */
+
+/* Returns the CPU we are running on.  Until other CPUs start,
+   that can only be the BSP, which lets this work even before
+   thread_init() sets up the running thread. */
+static inline struct cpu* this_cpu(void) { return intr_lock_enabled ? cpu_current() : &cpus[0]; }
+
+/* Softirqs, indexed by enum softirq. */
+struct softirq_action {
+  softirq_func* func; /* Handler, or null if unregistered. */
+  const char* name;   /* Name, for statistics. */
+  int64_t runs;       /* Number of times run. */
+};
+static struct softirq_action softirqs[SOFTIRQ_CNT];
+
+/* Times softirq_run() goes around again for softirqs raised
+   while it ran.  Any still pending after that wait for the next
+   interrupt, so that a steady stream of them cannot starve
+   threads. */
+#define SOFTIRQ_RESTART_MAX 10
+
+/* Scheduled tasklets, oldest first.  Protected by turning
+   interrupts off. */
+static struct list tasklets;
+
+static void softirq_run(struct cpu*);
+static void tasklet_softirq(void);
+
+/* Interrupts-off instrumentation, enabled by -irqoff.  Each
+   stretch with interrupts off is charged to the code that turned
+   them off: the caller of intr_disable(), or the vector of an
+   interrupt taken while they were on.  The table is protected by
+   turning interrupts off; sites that do not fit are not
+   recorded. */
+#define IRQOFF_SITES 64  /* Size of irqoff_sites[]. */
+#define IRQOFF_REPORT 10 /* Sites printed by intr_print_stats(). */
+struct irqoff_site {
+  uintptr_t site;      /* Caller address, or vector number. */
+  uint64_t max_cycles; /* Longest stretch. */
+  int64_t cnt;         /* Number of stretches. */
+};
+static struct irqoff_site irqoff_sites[IRQOFF_SITES];
+static int64_t irqoff_dropped; /* Stretches from sites that did not fit. */
+bool intr_off_tracking;        /* Enabled by -irqoff. */
+
+static void irqoff_begin(uintptr_t site);
+static void irqoff_end(void);
+static enum intr_level disable_from(uintptr_t site);
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init(void);
 static void pic_end_of_interrupt(int irq);
+static bool is_external(uint8_t vec_no);
 
 /* Interrupt Descriptor Table helpers. */
 static uint64_t make_intr_gate(void (*)(void), int dpl);
@@ -79,13 +143,21 @@ enum intr_level intr_get_level(void) {
 /* Enables or disables interrupts as specified by LEVEL and
    returns the previous interrupt status. */
 enum intr_level intr_set_level(enum intr_level level) {
-  return level == INTR_ON ? intr_enable() : intr_disable();
+  return level == INTR_ON ? intr_enable() : disable_from((uintptr_t)__builtin_return_address(0));
 }
 
-/* Enables interrupts and returns the previous interrupt status. */
+/* Enables interrupts and returns the previous interrupt status.
+   Softirqs may do this, but not external interrupt handlers. */
 enum intr_level intr_enable(void) {
   enum intr_level old_level = intr_get_level();
-  ASSERT(!intr_context());
+  ASSERT(!this_cpu()->in_external_intr);
+
+  if (old_level == INTR_OFF) {
+    if (intr_off_tracking)
+      irqoff_end();
+    if (intr_lock_enabled)
+      spinlock_release(&intr_lock);
+  }
 
   /* Enable interrupts by setting the interrupt flag.
 
@@ -97,7 +169,11 @@ enum intr_level intr_enable(void) {
 }
 
 /* Disables interrupts and returns the previous interrupt status. */
-enum intr_level intr_disable(void) {
+enum intr_level intr_disable(void) { return disable_from((uintptr_t)__builtin_return_address(0)); }
+
+/* Does the work of intr_disable(), charging the time interrupts
+   stay off to SITE. */
+static enum intr_level disable_from(uintptr_t site) {
   enum intr_level old_level = intr_get_level();
 
   /* Disable interrupts by clearing the interrupt flag.
@@ -105,9 +181,62 @@ enum intr_level intr_disable(void) {
      Hardware Interrupts". */
   asm volatile("cli" : : : "memory");
 
+  if (old_level == INTR_ON) {
+    if (intr_lock_enabled)
+      spinlock_acquire(&intr_lock);
+    if (intr_off_tracking)
+      irqoff_begin(site);
+  }
+
   return old_level;
 }
 
+/* Enables interrupts and halts the CPU until the next one
+   arrives.
+
+   The `sti' instruction disables interrupts until the
+   completion of the next instruction, so these two instructions
+   are executed atomically.  This atomicity is important;
+   otherwise, an interrupt could be handled between re-enabling
+   interrupts and waiting for the next one to occur, wasting as
+   much as one clock tick worth of time.
+
+   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
+   7.11.1 "HLT Instruction". */
+void intr_enable_and_halt(void) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(!intr_context());
+
+  if (intr_off_tracking)
+    irqoff_end();
+  if (intr_lock_enabled)
+    spinlock_release(&intr_lock);
+  asm volatile("sti; hlt" : : : "memory");
+}
+
+/* Makes intr_disable() take intr_lock from now on.  Called by
+   the BSP just before it starts the other CPUs. */
+void intr_smp_start(void) {
+  enum intr_level old_level = intr_disable();
+
+  spinlock_acquire(&intr_lock);
+  intr_lock_enabled = true;
+  intr_set_level(old_level);
+}
+
+/* Called by an application processor, with interrupts off, as
+   soon as it is running kernel code: loads the shared IDT and
+   takes intr_lock, since its interrupts are off. */
+void intr_ap_init(void) {
+  uint64_t idtr_operand = make_idtr_operand(sizeof idt - 1, idt);
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(intr_lock_enabled);
+
+  asm volatile("lidt %0" : : "m"(idtr_operand));
+  spinlock_acquire(&intr_lock);
+}
+
 /* Initializes the interrupt system. */
 void intr_init(void) {
   uint64_t idtr_operand;
@@ -126,6 +255,9 @@ void intr_init(void) {
   idtr_operand = make_idtr_operand(sizeof idt - 1, idt);
   asm volatile("lidt %0" : : "m"(idtr_operand));
 
+  list_init(&tasklets);
+  softirq_register(SOFTIRQ_TASKLET, tasklet_softirq, "tasklet");
+
   /* Initialize intr_names. */
   for (i = 0; i < INTR_CNT; i++)
     intr_names[i] = "unknown";
@@ -167,9 +299,10 @@ static void register_handler(uint8_t vec_no, int dpl, enum intr_level level,
 
 /* Registers external interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The handler will
-   execute with interrupts disabled. */
+   execute with interrupts disabled.  VEC_NO is either a PIC
+   vector (0x20...0x2f) or a local APIC vector. */
 void intr_register_ext(uint8_t vec_no, intr_handler_func* handler, const char* name) {
-  ASSERT(vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT(is_external(vec_no));
   register_handler(vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -188,21 +321,48 @@ void intr_register_ext(uint8_t vec_no, intr_handler_func* handler, const char* n
    discussion. */
 void intr_register_int(uint8_t vec_no, int dpl, enum intr_level level, intr_handler_func* handler,
                        const char* name) {
-  ASSERT(vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT(!is_external(vec_no));
   register_handler(vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
-bool intr_context(void) { return in_external_intr; }
+/* Returns true during processing of an external interrupt or
+   of the softirqs it runs on the way out, and false at all
+   other times.  Either way, the code may not sleep. */
+bool intr_context(void) {
+  struct cpu* c = this_cpu();
+  return c->in_external_intr || c->in_softirq;
+}
 
-/* During processing of an external interrupt, directs the
-   interrupt handler to yield to a new process just before
-   returning from the interrupt.  May not be called at any other
-   time. */
+/* During processing of an external interrupt or a softirq,
+   directs the interrupt handler to yield to a new process just
+   before returning from the interrupt.  May not be called at
+   any other time. */
 void intr_yield_on_return(void) {
   ASSERT(intr_context());
-  yield_on_return = true;
+  this_cpu()->yield_on_return = true;
+}
+
+/* Masks (if MASKED is true) or unmasks the PIC interrupt line
+   that delivers vector VEC, which must be in 0x20...0x2f.  A
+   masked line's requests are held by the PIC and delivered when
+   it is unmasked. */
+void intr_mask_irq(uint8_t vec, bool masked) {
+  int port = vec < 0x28 ? PIC0_DATA : PIC1_DATA;
+  uint8_t bit = 1 << (vec & 7);
+  enum intr_level old_level;
+
+  ASSERT(vec >= 0x20 && vec < 0x30);
+
+  old_level = intr_disable();
+  outb(port, masked ? inb(port) | bit : inb(port) & ~bit);
+  intr_set_level(old_level);
+}
+
+/* Returns true if VEC_NO is delivered by an interrupt
+   controller, either the PICs or the local APIC, rather than
+   raised by the CPU or an INT instruction. */
+static bool is_external(uint8_t vec_no) {
+  return (vec_no >= 0x20 && vec_no < 0x30) || vec_no >= LAPIC_VEC_BASE;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -320,6 +480,13 @@ void intr_handler(struct intr_frame* frame) {
   bool external;
   intr_handler_func* handler;
 
+  /* An interrupt gate turned interrupts off, so take intr_lock,
+     unless the interrupted code had them off and so holds it. */
+  if (intr_lock_enabled && (frame->eflags & FLAG_IF) && intr_get_level() == INTR_OFF)
+    spinlock_acquire(&intr_lock);
+  if (intr_off_tracking && (frame->eflags & FLAG_IF) && intr_get_level() == INTR_OFF)
+    irqoff_begin(frame->vec_no);
+
 #ifdef USERPROG
   /* 如果是用户中断就保存用户的esp */
   if((frame->error_code & 0x4) != 0)
@@ -330,13 +497,21 @@ void intr_handler(struct intr_frame* frame) {
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
      An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  external = is_external(frame->vec_no);
   if (external) {
+    struct cpu* c = this_cpu();
+
     ASSERT(intr_get_level() == INTR_OFF);
-    ASSERT(!intr_context());
+    ASSERT(!c->in_external_intr);
 
-    in_external_intr = true;
-    yield_on_return = false;
+    /* An interrupt that arrives while softirqs run leaves any
+       yield they asked for to the interrupt that ran them. */
+    c->in_external_intr = true;
+    if (!c->in_softirq)
+      c->yield_on_return = false;
+
+    /* Catch up on any ticks skipped while idle. */
+    timer_irq_enter();
   }
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
@@ -351,15 +526,217 @@ void intr_handler(struct intr_frame* frame) {
 
   /* Complete the processing of an external interrupt. */
   if (external) {
+    struct cpu* c = this_cpu();
+
     ASSERT(intr_get_level() == INTR_OFF);
-    ASSERT(intr_context());
+    ASSERT(c->in_external_intr);
+
+    c->in_external_intr = false;
+    if (frame->vec_no < 0x30)
+      pic_end_of_interrupt(frame->vec_no);
+    else if (frame->vec_no != LAPIC_SPURIOUS_VEC)
+      lapic_eoi();
+
+    /* Run the deferred work the handler raised, now that the
+       interrupt is acknowledged.  If we interrupted softirqs,
+       they pick it up themselves when we return to them. */
+    if (!c->in_softirq) {
+      if (c->softirq_pending != 0)
+        softirq_run(c);
+      if (c->yield_on_return)
+        thread_yield();
+    }
+  }
+
+#ifdef USERPROG
+  /* A thread whose process is exiting leaves it here rather than
+     go back to user mode. */
+  if (is_trap_from_userspace(frame))
+    process_exit_if_killed();
+#endif
+
+  /* Returning will turn interrupts back on, so drop intr_lock.
+     We may have switched threads and back since taking it, but
+     the lock goes with the CPU, not the thread. */
+  if (intr_off_tracking && (frame->eflags & FLAG_IF) && intr_get_level() == INTR_OFF)
+    irqoff_end();
+  if (intr_lock_enabled && (frame->eflags & FLAG_IF) && intr_get_level() == INTR_OFF)
+    spinlock_release(&intr_lock);
+}
+
+/* Runs the softirqs pending on C, with interrupts on, and then
+   any raised while they ran.  Called with interrupts off on the
+   way out of an external interrupt; returns the same way. */
+static void softirq_run(struct cpu* c) {
+  int restarts;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(!c->in_softirq);
+
+  c->in_softirq = true;
+  for (restarts = 0; c->softirq_pending != 0 && restarts < SOFTIRQ_RESTART_MAX; restarts++) {
+    uint32_t pending = c->softirq_pending;
+    int nr;
+
+    c->softirq_pending = 0;
+    for (nr = 0; nr < SOFTIRQ_CNT; nr++)
+      if (pending & (1u << nr))
+        softirqs[nr].runs++;
+
+    intr_enable();
+    for (nr = 0; nr < SOFTIRQ_CNT; nr++)
+      if (pending & (1u << nr))
+        softirqs[nr].func();
+    intr_disable();
+  }
+  c->in_softirq = false;
+}
+
+/* Registers FUNC, named NAME, as the handler for softirq NR. */
+void softirq_register(enum softirq nr, softirq_func* func, const char* name) {
+  ASSERT(nr < SOFTIRQ_CNT);
+  ASSERT(softirqs[nr].func == NULL);
+
+  softirqs[nr].func = func;
+  softirqs[nr].name = name;
+}
+
+/* Marks softirq NR pending on this CPU.  From an external
+   interrupt handler or a softirq, it runs before the interrupt
+   returns; from a thread, it waits for the next interrupt. */
+void softirq_raise(enum softirq nr) {
+  enum intr_level old_level = intr_disable();
+
+  ASSERT(nr < SOFTIRQ_CNT);
+  ASSERT(softirqs[nr].func != NULL);
+
+  this_cpu()->softirq_pending |= 1u << nr;
+  intr_set_level(old_level);
+}
 
-    in_external_intr = false;
-    pic_end_of_interrupt(frame->vec_no);
+/* Initializes T to call FUNC(AUX) once scheduled. */
+void tasklet_init(struct tasklet* t, tasklet_func* func, void* aux) {
+  ASSERT(t != NULL);
+  ASSERT(func != NULL);
+
+  t->func = func;
+  t->aux = aux;
+  t->scheduled = false;
+}
+
+/* Schedules T to run from SOFTIRQ_TASKLET.  May be called from
+   an interrupt handler; T may reschedule itself. */
+void tasklet_schedule(struct tasklet* t) {
+  enum intr_level old_level = intr_disable();
+
+  if (!t->scheduled) {
+    t->scheduled = true;
+    list_push_back(&tasklets, &t->elem);
+    softirq_raise(SOFTIRQ_TASKLET);
+  }
+  intr_set_level(old_level);
+}
+
+/* SOFTIRQ_TASKLET handler.  Runs the tasklets scheduled so far,
+   each with interrupts on.  Ones scheduled meanwhile are left
+   for the next round. */
+static void tasklet_softirq(void) {
+  struct list batch;
+  enum intr_level old_level;
+
+  list_init(&batch);
+  old_level = intr_disable();
+  while (!list_empty(&tasklets))
+    list_push_back(&batch, list_pop_front(&tasklets));
+  intr_set_level(old_level);
+
+  while (!list_empty(&batch)) {
+    struct tasklet* t = list_entry(list_pop_front(&batch), struct tasklet, elem);
+
+    old_level = intr_disable();
+    t->scheduled = false;
+    intr_set_level(old_level);
+    t->func(t->aux);
+  }
+}
+
+/* Notes that this CPU just turned interrupts off, on behalf of
+   SITE. */
+static void irqoff_begin(uintptr_t site) {
+  struct cpu* c = this_cpu();
+
+  c->irqoff_start = timer_cycles();
+  c->irqoff_site = site;
+}
+
+/* Charges the time since irqoff_begin() to its site.  Called
+   with interrupts off, just before they go back on. */
+static void irqoff_end(void) {
+  struct cpu* c = this_cpu();
+  uint64_t cycles;
+  size_t i, h;
+
+  if (c->irqoff_start == 0)
+    return;
+  cycles = timer_cycles() - c->irqoff_start;
+  c->irqoff_start = 0;
+
+  /* Open addressing on the site address. */
+  h = (c->irqoff_site >> 2) % IRQOFF_SITES;
+  for (i = 0; i < IRQOFF_SITES; i++) {
+    struct irqoff_site* s = &irqoff_sites[(h + i) % IRQOFF_SITES];
+    if (s->cnt == 0)
+      s->site = c->irqoff_site;
+    if (s->site == c->irqoff_site) {
+      s->cnt++;
+      if (cycles > s->max_cycles)
+        s->max_cycles = cycles;
+      return;
+    }
+  }
+  irqoff_dropped++;
+}
 
-    if (yield_on_return)
-      thread_yield();
+/* Prints softirq statistics and, with -irqoff, the sites that
+   kept interrupts off the longest.  A site below INTR_CNT is an
+   interrupt vector; the others are code addresses, which the
+   `backtrace' tool turns into function names. */
+void intr_print_stats(void) {
+  bool shown[IRQOFF_SITES] = {false};
+  uint64_t hz = timer_cycles_hz();
+  int nr, n;
+
+  printf("Softirq:");
+  for (nr = 0; nr < SOFTIRQ_CNT; nr++)
+    if (softirqs[nr].func != NULL)
+      printf(" %lld %s", softirqs[nr].runs, softirqs[nr].name);
+  printf("\n");
+
+  if (!intr_off_tracking)
+    return;
+  for (n = 0; n < IRQOFF_REPORT; n++) {
+    struct irqoff_site* max = NULL;
+    int i, max_i = 0;
+
+    for (i = 0; i < IRQOFF_SITES; i++)
+      if (!shown[i] && irqoff_sites[i].cnt > 0 &&
+          (max == NULL || irqoff_sites[i].max_cycles > max->max_cycles)) {
+        max = &irqoff_sites[i];
+        max_i = i;
+      }
+    if (max == NULL)
+      break;
+    shown[max_i] = true;
+
+    printf("Interrupts off: %" PRIu64 " us max, %lld times, ",
+           hz != 0 ? max->max_cycles * 1000000 / hz : 0, max->cnt);
+    if (max->site < INTR_CNT)
+      printf("interrupt %#04x (%s)\n", (unsigned)max->site, intr_names[max->site]);
+    else
+      printf("at %p\n", (void*)max->site);
   }
+  if (irqoff_dropped > 0)
+    printf("Interrupts off: %lld more from untracked sites\n", irqoff_dropped);
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
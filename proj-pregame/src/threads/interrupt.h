@@ -1,6 +1,7 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <list.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -14,6 +15,7 @@ enum intr_level intr_get_level(void);
 enum intr_level intr_set_level(enum intr_level);
 enum intr_level intr_enable(void);
 enum intr_level intr_disable(void);
+void intr_enable_and_halt(void);
 
 /* Interrupt stack frame. */
 struct intr_frame {
@@ -60,6 +62,44 @@ void intr_register_ext(uint8_t vec, intr_handler_func*, const char* name);
 void intr_register_int(uint8_t vec, int dpl, enum intr_level, intr_handler_func*, const char* name);
 bool intr_context(void);
 void intr_yield_on_return(void);
+void intr_mask_irq(uint8_t vec, bool masked);
+
+void intr_smp_start(void);
+void intr_ap_init(void);
+
+/* Softirqs: deferred work that an external interrupt handler
+   raises and that runs just before the interrupt returns, with
+   interrupts on but still in interrupt context. */
+enum softirq {
+  SOFTIRQ_TIMER,   /* Timer wheel and scheduler bookkeeping. */
+  SOFTIRQ_TASKLET, /* Runs scheduled tasklets. */
+  SOFTIRQ_CNT
+};
+
+typedef void softirq_func(void);
+void softirq_register(enum softirq, softirq_func*, const char* name);
+void softirq_raise(enum softirq);
+
+/* A tasklet is a one-shot deferred call, run by SOFTIRQ_TASKLET.
+   There is one tasklet list for all CPUs, so the tasklet may run
+   on any CPU, not necessarily the one that scheduled it.  If it
+   is scheduled again while it runs, the new run may start on
+   another CPU before the first one returns.  Scheduling a tasklet
+   that is already scheduled does nothing. */
+typedef void tasklet_func(void* aux);
+struct tasklet {
+  struct list_elem elem; /* Element in the tasklet list. */
+  tasklet_func* func;    /* Function to call. */
+  void* aux;             /* Its argument. */
+  bool scheduled;        /* In the tasklet list? */
+};
+
+void tasklet_init(struct tasklet*, tasklet_func*, void* aux);
+void tasklet_schedule(struct tasklet*);
+
+/* Interrupts-off instrumentation (-irqoff). */
+extern bool intr_off_tracking;
+void intr_print_stats(void);
 
 void intr_dump_frame(const struct intr_frame*);
 const char* intr_name(uint8_t vec);
@@ -8,6 +8,11 @@
 /* Physical address of kernel base. */
 #define LOADER_KERN_BASE 0x20000 /* 128 kB. */
 
+/* Physical address to which smp_init() copies the startup code
+   for the other CPUs.  Must be page-aligned and below 1 MB.
+   The loader is done with this memory by then. */
+#define LOADER_AP_BASE 0x8000 /* 32 kB. */
+
 /* Kernel virtual address at which all physical memory is mapped.
    Must be aligned on a 4 MB boundary. */
 #define LOADER_PHYS_BASE 0xc0000000 /* 3 GB. */
@@ -2,13 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 #ifdef VM
 #include "vm/frame.h"
@@ -29,11 +30,53 @@
    half to the user pool.  That should be huge overkill for the
    kernel pool, but that's just fine for demonstration purposes. */
 
+/* Free pages are managed by a binary buddy allocator.  Each
+   pool is carved into blocks of 2**ORDER pages, aligned to their
+   size relative to the pool's base, and keeps one free list per
+   order.  An allocation takes the smallest free block that is big
+   enough, splitting larger blocks in half as needed, and gives
+   back any pages past the request.  A free merges the block with
+   its "buddy", the other half of the block it was split from,
+   for as long as the buddy is free too.  Both take O(log n)
+   time, where palloc used to scan a bitmap from its start.
+
+   palloc_free_page() is called from the scheduler with
+   interrupts off to free dying threads, so the free lists are
+   protected by turning interrupts off rather than by a lock.
+   Every operation on them is short.
+
+   Each pool also keeps a small reserve of free pages that the
+   idle thread has already zeroed, so that a PAL_ZERO page
+   request does not have to clear 4 kB on the caller's critical
+   path.  Reserved pages are marked used in used_map.  When a
+   pool runs out of free blocks, its reserve goes back to the
+   allocator before anything else (such as eviction) is tried. */
+
+/* Number of block orders.  A pool can hold blocks of up to
+   2**(MAX_ORDER - 1) pages, far more than any pool has. */
+#define MAX_ORDER 20
+
+/* Marks a page of order_map that does not start a free block. */
+#define NOT_FREE 0xff
+
+/* Maximum number of pre-zeroed pages kept by each pool. */
+#define PREZERO_MAX 64
+
 /* A memory pool. */
 struct pool {
-  struct lock lock;        /* Mutual exclusion. */
-  struct bitmap* used_map; /* Bitmap of free pages. */
-  uint8_t* base;           /* Base of pool. */
+  const char* name;                 /* Name, for statistics. */
+  struct bitmap* used_map;          /* Bitmap of free pages. */
+  uint8_t* order_map;               /* Order of free block at each page. */
+  struct list free_lists[MAX_ORDER]; /* Free blocks of each order. */
+  uint8_t* base;                    /* Base of pool. */
+  size_t page_cnt;                  /* Number of pages in pool. */
+
+  /* Pre-zeroed pages. */
+  size_t zeroed[PREZERO_MAX];       /* Indexes of reserved zero pages. */
+  size_t zeroed_cnt;                /* Number of entries in zeroed. */
+  long long zero_hits;              /* PAL_ZERO pages served from zeroed. */
+  long long zero_misses;            /* PAL_ZERO pages zeroed on demand. */
+  long long prezeroed;              /* Pages zeroed by the idle thread. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -41,6 +84,10 @@ static struct pool kernel_pool, user_pool;
 
 static void init_pool(struct pool*, void* base, size_t page_cnt, const char* name);
 static bool page_from_pool(const struct pool*, void* page);
+static size_t buddy_alloc(struct pool*, size_t page_cnt);
+static void buddy_free(struct pool*, size_t page_idx, size_t page_cnt);
+static void buddy_free_block(struct pool*, size_t page_idx, unsigned order);
+static void prezero_pool(struct pool*);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -95,14 +142,41 @@ void palloc_init(size_t user_page_limit) {
 void* palloc_get_multiple(enum palloc_flags flags, size_t page_cnt) {
   struct pool* pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void* pages;
-  size_t page_idx;
+  size_t page_idx = BITMAP_ERROR;
+  bool zeroed = false;
+  enum intr_level old_level;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire(&pool->lock);
-  page_idx = bitmap_scan_and_flip(pool->used_map, 0, page_cnt, false);
-  lock_release(&pool->lock);
+  old_level = intr_disable();
+  if ((flags & PAL_ZERO) && page_cnt == 1 && pool->zeroed_cnt > 0) {
+    page_idx = pool->zeroed[--pool->zeroed_cnt];
+    zeroed = true;
+  } else {
+    page_idx = buddy_alloc(pool, page_cnt);
+    if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0) {
+      /* Out of free blocks: fall back on the reserve. */
+      if (page_cnt == 1) {
+        page_idx = pool->zeroed[--pool->zeroed_cnt];
+        zeroed = true;
+      } else {
+        while (pool->zeroed_cnt > 0) {
+          size_t idx = pool->zeroed[--pool->zeroed_cnt];
+          bitmap_reset(pool->used_map, idx);
+          buddy_free_block(pool, idx, 0);
+        }
+        page_idx = buddy_alloc(pool, page_cnt);
+      }
+    }
+  }
+  if (page_idx != BITMAP_ERROR && (flags & PAL_ZERO)) {
+    if (zeroed)
+      pool->zero_hits++;
+    else
+      pool->zero_misses += page_cnt;
+  }
+  intr_set_level(old_level);
 
   /* 下面进行修改 */
 #ifdef VM
@@ -130,7 +204,7 @@ void* palloc_get_multiple(enum palloc_flags flags, size_t page_cnt) {
 
 
   if (pages != NULL) {
-    if (flags & PAL_ZERO)
+    if ((flags & PAL_ZERO) && !zeroed)
       memset(pages, 0, PGSIZE * page_cnt);
   } else {
     if (flags & PAL_ASSERT)
@@ -154,6 +228,7 @@ void* palloc_get_page(enum palloc_flags flags) { return palloc_get_multiple(flag
 void palloc_free_multiple(void* pages, size_t page_cnt) {
   struct pool* pool;
   size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT(pg_ofs(pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -172,8 +247,11 @@ void palloc_free_multiple(void* pages, size_t page_cnt) {
   memset(pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable();
   ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+  buddy_free(pool, page_idx, page_cnt);
+  intr_set_level(old_level);
 
 #ifdef VM
   for(size_t i = 0; i < page_cnt; i++)
@@ -184,26 +262,72 @@ void palloc_free_multiple(void* pages, size_t page_cnt) {
 /* Frees the page at PAGE. */
 void palloc_free_page(void* page) { palloc_free_multiple(page, 1); }
 
+/* Tops up the pre-zeroed page reserve of each pool.  Called by
+   the idle thread with interrupts on, so that zeroing can be
+   preempted as soon as there is real work to do. */
+void palloc_prezero(void) {
+  ASSERT(intr_get_level() == INTR_ON);
+  prezero_pool(&kernel_pool);
+  prezero_pool(&user_pool);
+}
+
+/* Zeroes free pages of POOL into its reserve until the reserve
+   is full or the pool has no free page left. */
+static void prezero_pool(struct pool* pool) {
+  for (;;) {
+    enum intr_level old_level = intr_disable();
+    size_t page_idx = BITMAP_ERROR;
+
+    if (pool->zeroed_cnt < PREZERO_MAX)
+      page_idx = buddy_alloc(pool, 1);
+    intr_set_level(old_level);
+    if (page_idx == BITMAP_ERROR)
+      return;
+
+    memset(pool->base + page_idx * PGSIZE, 0, PGSIZE);
+
+    old_level = intr_disable();
+    if (pool->zeroed_cnt < PREZERO_MAX) {
+      pool->zeroed[pool->zeroed_cnt++] = page_idx;
+      pool->prezeroed++;
+    } else {
+      /* Another CPU filled the reserve meanwhile. */
+      bitmap_reset(pool->used_map, page_idx);
+      buddy_free_block(pool, page_idx, 0);
+    }
+    intr_set_level(old_level);
+  }
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 /* 初始化内存池，这里一般初始化内核池和用户池（两者对半开）。分配page_cnt个
    页的大小，考虑到记录页状态的数据结构位图也需要空间，所以可使用空间只有
    page_cnt - bm_pages个页的大小，并且调整该内存池的起始地址base */
 static void init_pool(struct pool* p, void* base, size_t page_cnt, const char* name) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's used_map and order_map at its base.
+     Calculate the space needed for them
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP(bitmap_buf_size(page_cnt), PGSIZE);
+  size_t bm_size = bitmap_buf_size(page_cnt);
+  size_t bm_pages = DIV_ROUND_UP(bm_size + page_cnt, PGSIZE);
+  unsigned order;
   if (bm_pages > page_cnt)
     PANIC("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init(&p->lock);
-  p->used_map = bitmap_create_in_buf(page_cnt, base, bm_pages * PGSIZE);
+  /* Initialize the pool, with all of its pages in use, then
+     free them all into the buddy lists. */
+  p->name = name;
+  p->used_map = bitmap_create_in_buf(page_cnt, base, bm_size);
+  p->order_map = (uint8_t*)base + bm_size;
+  memset(p->order_map, NOT_FREE, page_cnt);
+  for (order = 0; order < MAX_ORDER; order++)
+    list_init(&p->free_lists[order]);
   p->base = base + bm_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  buddy_free(p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -211,7 +335,130 @@ static void init_pool(struct pool* p, void* base, size_t page_cnt, const char* n
 static bool page_from_pool(const struct pool* pool, void* page) {
   size_t page_no = pg_no(page);
   size_t start_page = pg_no(pool->base);
-  size_t end_page = start_page + bitmap_size(pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free list element stored in page PAGE_IDX of
+   POOL. */
+static struct list_elem* page_elem(struct pool* pool, size_t page_idx) {
+  return (struct list_elem*)(pool->base + page_idx * PGSIZE);
+}
+
+/* Returns the index in POOL of the page holding free list
+   element E. */
+static size_t elem_page(struct pool* pool, struct list_elem* e) {
+  return pg_no(e) - pg_no(pool->base);
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and marks them
+   used.  Takes the smallest free block of at least PAGE_CNT
+   pages, splits it down to the smallest power of 2 that holds
+   them, and frees the pages past PAGE_CNT again.  Returns the
+   index of the first page, or BITMAP_ERROR if no free block is
+   big enough.  Interrupts must be off. */
+static size_t buddy_alloc(struct pool* pool, size_t page_cnt) {
+  unsigned want, order;
+  size_t page_idx;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  for (want = 0; want < MAX_ORDER && ((size_t)1 << want) < page_cnt; want++)
+    continue;
+  for (order = want; order < MAX_ORDER; order++)
+    if (!list_empty(&pool->free_lists[order]))
+      break;
+  if (order >= MAX_ORDER)
+    return BITMAP_ERROR;
+
+  page_idx = elem_page(pool, list_pop_front(&pool->free_lists[order]));
+  pool->order_map[page_idx] = NOT_FREE;
+
+  /* Split, keeping the lower half and freeing the upper. */
+  while (order > want) {
+    size_t buddy;
+
+    order--;
+    buddy = page_idx + ((size_t)1 << order);
+    pool->order_map[buddy] = order;
+    list_push_front(&pool->free_lists[order], page_elem(pool, buddy));
+  }
+
+  ASSERT(bitmap_none(pool->used_map, page_idx, (size_t)1 << want));
+  bitmap_set_multiple(pool->used_map, page_idx, page_cnt, true);
+  if (page_cnt < ((size_t)1 << want))
+    buddy_free(pool, page_idx + page_cnt, ((size_t)1 << want) - page_cnt);
+  return page_idx;
+}
+
+/* Frees the PAGE_CNT pages of POOL starting at PAGE_IDX into the
+   buddy lists, as the largest aligned blocks that cover them.
+   Interrupts must be off. */
+static void buddy_free(struct pool* pool, size_t page_idx, size_t page_cnt) {
+  while (page_cnt > 0) {
+    unsigned order = 0;
+
+    while (order + 1 < MAX_ORDER && page_idx % ((size_t)2 << order) == 0 &&
+           ((size_t)2 << order) <= page_cnt)
+      order++;
+    buddy_free_block(pool, page_idx, order);
+    page_idx += (size_t)1 << order;
+    page_cnt -= (size_t)1 << order;
+  }
+}
+
+/* Frees the block of 2**ORDER pages of POOL at PAGE_IDX, merging
+   it with its buddy for as long as the buddy is free. */
+static void buddy_free_block(struct pool* pool, size_t page_idx, unsigned order) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(page_idx % ((size_t)1 << order) == 0);
+
+  for (; order + 1 < MAX_ORDER; order++) {
+    size_t buddy = page_idx ^ ((size_t)1 << order);
+    if (buddy + ((size_t)1 << order) > pool->page_cnt || pool->order_map[buddy] != order)
+      break;
+    list_remove(page_elem(pool, buddy));
+    pool->order_map[buddy] = NOT_FREE;
+    if (buddy < page_idx)
+      page_idx = buddy;
+  }
+  pool->order_map[page_idx] = order;
+  list_push_front(&pool->free_lists[order], page_elem(pool, page_idx));
+}
+
+/* Prints the free space of POOL by block order.  Fragmentation
+   is the share of free pages outside the largest free block, so
+   0% means that every free page could serve one request. */
+static void print_pool_stats(struct pool* pool) {
+  size_t free_pages = 0, largest = 0, blocks[MAX_ORDER];
+  enum intr_level old_level;
+  unsigned order;
+
+  old_level = intr_disable();
+  for (order = 0; order < MAX_ORDER; order++) {
+    blocks[order] = list_size(&pool->free_lists[order]);
+    free_pages += blocks[order] << order;
+    if (blocks[order] != 0)
+      largest = (size_t)1 << order;
+  }
+  intr_set_level(old_level);
+
+  printf("Palloc %s: %zu of %zu pages free, largest free block %zu pages, "
+         "%zu%% fragmentation\n",
+         pool->name, free_pages, pool->page_cnt, largest,
+         free_pages != 0 ? (free_pages - largest) * 100 / free_pages : 0);
+  printf("  free blocks by order:");
+  for (order = 0; order < MAX_ORDER; order++)
+    if (blocks[order] != 0)
+      printf(" %u:%zu", order, blocks[order]);
+  printf("\n");
+  printf("  zero pages: %lld pre-zeroed hits, %lld zeroed on demand, %lld zeroed while idle, "
+         "%zu in reserve\n",
+         pool->zero_hits, pool->zero_misses, pool->prezeroed, pool->zeroed_cnt);
+}
+
+/* Prints free space and fragmentation of both pools. */
+void palloc_print_stats(void) {
+  print_pool_stats(&kernel_pool);
+  print_pool_stats(&user_pool);
+}
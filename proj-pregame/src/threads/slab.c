@@ -0,0 +1,272 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* An object cache, after Bonwick's slab allocator.
+
+   malloc() rounds each request up to a power of 2, so a type
+   that is a little bigger than a power of 2 wastes almost half
+   of every block, and all types of about the same size share one
+   descriptor lock.  A cache instead hands out objects of exactly
+   one size, carved out of page-sized "slabs" that are owned by
+   that cache alone.
+
+   Each slab starts with a header and keeps its own list of free
+   objects.  The cache keeps its slabs on a "partial" list (some
+   objects free) and a "full" list (none free), and allocates
+   from the first partial slab.  When a slab becomes completely
+   free, it is given back to the page allocator, except that one
+   empty slab is kept in reserve so that a type allocated and
+   freed in a loop does not go to palloc every time.
+
+   A cache may have a constructor, which is run on each object
+   when its slab is created rather than on every allocation.
+   Objects must be freed in their constructed state, so the free
+   list link is then kept in an extra word after the object
+   instead of in the object itself. */
+
+/* Object cache. */
+struct kmem_cache {
+  char name[16];           /* Name, for statistics. */
+  size_t obj_size;         /* Size requested by the creator. */
+  size_t stride;           /* Distance between objects in a slab. */
+  size_t link_ofs;         /* Offset of the free list link. */
+  size_t objs_per_slab;    /* Objects in each slab. */
+  void (*ctor)(void*);     /* Constructor, or null. */
+  struct lock lock;        /* Protects everything below. */
+  struct list partial;     /* Slabs with some free objects. */
+  struct list full;        /* Slabs with no free objects. */
+  struct slab* spare;      /* One empty slab kept in reserve. */
+  size_t slab_cnt;         /* Slabs, including the spare. */
+  size_t in_use;           /* Objects allocated. */
+  size_t peak;             /* Maximum of in_use. */
+  unsigned long long allocs; /* Total allocations. */
+  unsigned long long reclaimed; /* Slabs returned to palloc. */
+  struct list_elem elem;   /* Element in all_caches. */
+};
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header, at the start of each slab page. */
+struct slab {
+  unsigned magic;          /* Always set to SLAB_MAGIC. */
+  struct kmem_cache* cache; /* Owning cache. */
+  struct list_elem elem;   /* Element in partial or full list. */
+  size_t in_use;           /* Objects allocated from this slab. */
+  void* free;              /* First free object. */
+};
+
+/* All caches, for statistics. */
+static struct list all_caches = LIST_INITIALIZER(all_caches);
+
+static struct slab* slab_create(struct kmem_cache*);
+static struct slab* obj_to_slab(struct kmem_cache*, void*);
+static void** obj_link(struct kmem_cache*, void*);
+
+/* Creates and returns a cache of SIZE-byte objects called NAME.
+   If CTOR is nonnull, it is called on each object once, when
+   the object's slab is created.  Panics if memory is not
+   available, since caches are created at initialization. */
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, void (*ctor)(void*)) {
+  struct kmem_cache* c;
+  enum intr_level old_level;
+
+  ASSERT(size > 0);
+  c = malloc(sizeof *c);
+  if (c == NULL)
+    PANIC("kmem_cache_create: out of memory for cache %s", name);
+
+  strlcpy(c->name, name, sizeof c->name);
+  c->obj_size = size;
+  c->ctor = ctor;
+  if (ctor != NULL) {
+    c->link_ofs = ROUND_UP(size, sizeof(void*));
+    c->stride = c->link_ofs + sizeof(void*);
+  } else {
+    c->link_ofs = 0;
+    c->stride = ROUND_UP(size > sizeof(void*) ? size : sizeof(void*), sizeof(void*));
+  }
+  ASSERT(c->stride <= PGSIZE - sizeof(struct slab));
+  c->objs_per_slab = (PGSIZE - sizeof(struct slab)) / c->stride;
+
+  lock_init(&c->lock);
+  lock_set_name(&c->lock, c->name);
+  list_init(&c->partial);
+  list_init(&c->full);
+  c->spare = NULL;
+  c->slab_cnt = c->in_use = c->peak = 0;
+  c->allocs = c->reclaimed = 0;
+
+  old_level = intr_disable();
+  list_push_back(&all_caches, &c->elem);
+  intr_set_level(old_level);
+  return c;
+}
+
+/* Allocates and returns an object from cache C, in the state its
+   constructor left it in.  Returns a null pointer if memory is
+   not available. */
+void* kmem_cache_alloc(struct kmem_cache* c) {
+  struct slab* s;
+  void* obj;
+
+  lock_acquire(&c->lock);
+  if (!list_empty(&c->partial))
+    s = list_entry(list_front(&c->partial), struct slab, elem);
+  else {
+    if (c->spare != NULL) {
+      s = c->spare;
+      c->spare = NULL;
+    } else {
+      s = slab_create(c);
+      if (s == NULL) {
+        lock_release(&c->lock);
+        return NULL;
+      }
+    }
+    list_push_front(&c->partial, &s->elem);
+  }
+
+  obj = s->free;
+  s->free = *obj_link(c, obj);
+  if (++s->in_use == c->objs_per_slab) {
+    list_remove(&s->elem);
+    list_push_front(&c->full, &s->elem);
+  }
+  if (++c->in_use > c->peak)
+    c->peak = c->in_use;
+  c->allocs++;
+  lock_release(&c->lock);
+  return obj;
+}
+
+/* Allocates and returns a zeroed object from cache C, which must
+   not have a constructor.  Returns a null pointer if memory is
+   not available. */
+void* kmem_cache_zalloc(struct kmem_cache* c) {
+  void* obj;
+
+  ASSERT(c->ctor == NULL);
+  obj = kmem_cache_alloc(c);
+  if (obj != NULL)
+    memset(obj, 0, c->obj_size);
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   C.  If C has a constructor, OBJ must be in its constructed
+   state.  A null OBJ is ignored. */
+void kmem_cache_free(struct kmem_cache* c, void* obj) {
+  struct slab* s;
+
+  if (obj == NULL)
+    return;
+  s = obj_to_slab(c, obj);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  if (c->ctor == NULL)
+    memset(obj, 0xcc, c->obj_size);
+#endif
+
+  lock_acquire(&c->lock);
+  ASSERT(s->in_use > 0);
+  *obj_link(c, obj) = s->free;
+  s->free = obj;
+  if (s->in_use-- == c->objs_per_slab) {
+    list_remove(&s->elem);
+    list_push_front(&c->partial, &s->elem);
+  }
+  c->in_use--;
+
+  /* Keep one empty slab in reserve and give any other back. */
+  if (s->in_use == 0) {
+    list_remove(&s->elem);
+    if (c->spare == NULL)
+      c->spare = s;
+    else {
+      s->magic = 0;
+      palloc_free_page(s);
+      c->slab_cnt--;
+      c->reclaimed++;
+    }
+  }
+  lock_release(&c->lock);
+}
+
+/* Prints usage of every cache.  Fragmentation is the share of
+   the cache's slab pages not holding a live object: slab
+   headers, the unusable tail of each slab, free objects, and
+   padding added to each object. */
+void kmem_cache_print_stats(void) {
+  struct list_elem* e;
+
+  for (e = list_begin(&all_caches); e != list_end(&all_caches); e = list_next(e)) {
+    struct kmem_cache* c = list_entry(e, struct kmem_cache, elem);
+    size_t bytes = c->slab_cnt * PGSIZE;
+    size_t waste = bytes - c->in_use * c->obj_size;
+
+    printf("Slab %s: %zu-byte objects, %zu per slab, %zu in use (peak %zu), "
+           "%llu allocs, %zu slabs (%llu reclaimed), %zu%% fragmentation\n",
+           c->name, c->obj_size, c->objs_per_slab, c->in_use, c->peak, c->allocs, c->slab_cnt,
+           c->reclaimed, bytes != 0 ? waste * 100 / bytes : 0);
+  }
+}
+
+/* Allocates a new slab for cache C, runs C's constructor on each
+   of its objects, and threads them onto its free list.  Returns
+   a null pointer if memory is not available. */
+static struct slab* slab_create(struct kmem_cache* c) {
+  struct slab* s = palloc_get_page(0);
+  uint8_t* obj;
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->in_use = 0;
+  s->free = NULL;
+
+  /* Push in reverse so that objects are handed out in address
+     order. */
+  obj = (uint8_t*)(s + 1) + c->objs_per_slab * c->stride;
+  for (i = 0; i < c->objs_per_slab; i++) {
+    obj -= c->stride;
+    if (c->ctor != NULL)
+      c->ctor(obj);
+    *obj_link(c, obj) = s->free;
+    s->free = obj;
+  }
+  c->slab_cnt++;
+  return s;
+}
+
+/* Returns the slab that object OBJ of cache C is in. */
+static struct slab* obj_to_slab(struct kmem_cache* c, void* obj) {
+  struct slab* s = pg_round_down(obj);
+
+  /* Check that the slab is valid and belongs to C. */
+  ASSERT(s->magic == SLAB_MAGIC);
+  ASSERT(s->cache == c);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT((pg_ofs(obj) - sizeof *s) % c->stride == 0);
+
+  return s;
+}
+
+/* Returns the free list link of object OBJ of cache C. */
+static void** obj_link(struct kmem_cache* c, void* obj) {
+  return (void**)((uint8_t*)obj + c->link_ofs);
+}
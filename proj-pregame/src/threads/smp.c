@@ -0,0 +1,382 @@
+#include "threads/smp.h"
+#include <debug.h>
+#include <packed.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+
+/* Multiprocessor support.  The BSP finds the other CPUs in the
+   ACPI MADT or, failing that, the Intel MultiProcessor tables,
+   and starts each one with the INIT-SIPI-SIPI sequence.  See
+   [ACPI] 5.2.12 "Multiple APIC Description Table (MADT)", [MP]
+   chapter 4 "MP Configuration Table", and [IA32-v3a] 8.4
+   "Multiple-Processor (MP) Initialization". */
+
+/* CPUs that are running.  cpus[0] is the BSP. */
+struct cpu cpus[CPU_MAX] = {{.id = 0, .started = true}};
+int cpu_cnt = 1;
+
+/* APIC IDs of the APs found by smp_init(). */
+static uint8_t ap_ids[CPU_MAX - 1];
+static int ap_cnt;
+
+/* ACPI Root System Description Pointer, version 1 part. */
+struct rsdp {
+  char signature[8]; /* "RSD PTR ". */
+  uint8_t checksum;  /* Sums to 0 over the structure. */
+  char oem_id[6];
+  uint8_t revision;
+  uint32_t rsdt_addr; /* Physical address of the RSDT. */
+} PACKED;
+
+/* Header common to every ACPI System Description Table. */
+struct sdt_header {
+  char signature[4]; /* "RSDT", "APIC", etc. */
+  uint32_t length;   /* Length of the table, including header. */
+  uint8_t revision;
+  uint8_t checksum; /* Sums to 0 over the whole table. */
+  char oem_id[6];
+  char oem_table_id[8];
+  uint32_t oem_revision;
+  uint32_t creator_id;
+  uint32_t creator_revision;
+} PACKED;
+
+/* MADT, which lists the interrupt controllers. */
+struct madt {
+  struct sdt_header header; /* Signature "APIC". */
+  uint32_t lapic_addr;      /* Physical address of local APICs. */
+  uint32_t flags;
+  uint8_t entries[]; /* Variable-length entries. */
+} PACKED;
+
+#define MADT_LAPIC 0            /* Entry type: processor local APIC. */
+#define MADT_LAPIC_ENABLED 0x01 /* Local APIC flag: usable. */
+
+/* MADT processor local APIC entry. */
+struct madt_lapic {
+  uint8_t type;   /* MADT_LAPIC. */
+  uint8_t length; /* 8. */
+  uint8_t acpi_processor_id;
+  uint8_t apic_id;
+  uint32_t flags;
+} PACKED;
+
+/* MP floating pointer structure. */
+struct mp_fps {
+  char signature[4]; /* "_MP_". */
+  uint32_t config;   /* Physical address of MP configuration table. */
+  uint8_t length;    /* In 16-byte units. */
+  uint8_t spec_rev;
+  uint8_t checksum; /* Sums to 0 over the structure. */
+  uint8_t features[5];
+} PACKED;
+
+/* MP configuration table header. */
+struct mp_config {
+  char signature[4];    /* "PCMP". */
+  uint16_t base_length; /* Length of header and entries. */
+  uint8_t spec_rev;
+  uint8_t checksum; /* Sums to 0 over BASE_LENGTH bytes. */
+  char oem_id[8];
+  char product_id[12];
+  uint32_t oem_table;
+  uint16_t oem_table_size;
+  uint16_t entry_cnt;
+  uint32_t lapic_addr;
+  uint16_t ext_length;
+  uint8_t ext_checksum;
+  uint8_t reserved;
+} PACKED;
+
+#define MP_PROCESSOR 0         /* Entry type: processor. */
+#define MP_PROCESSOR_SIZE 20   /* Size of a processor entry. */
+#define MP_OTHER_SIZE 8        /* Size of every other entry. */
+#define MP_CPU_ENABLED 0x01    /* Processor flag: usable. */
+
+/* MP configuration table processor entry. */
+struct mp_processor {
+  uint8_t type; /* MP_PROCESSOR. */
+  uint8_t apic_id;
+  uint8_t apic_version;
+  uint8_t flags;
+  uint32_t signature;
+  uint32_t features;
+  uint32_t reserved[2];
+} PACKED;
+
+/* Startup code in ap-start.S. */
+extern const char ap_start[], ap_start_end[];
+extern uint32_t ap_boot_cr3, ap_boot_esp;
+
+void ap_main(void) NO_RETURN;
+static bool acpi_find_cpus(void);
+static bool mp_find_cpus(void);
+static void add_ap(uint8_t apic_id);
+static void start_ap(uint8_t apic_id, uint32_t* boot_esp);
+static intr_handler_func resched_interrupt;
+#ifdef USERPROG
+static intr_handler_func tlb_interrupt;
+#endif
+
+/* Finds the other CPUs and starts them.  Called by the BSP with
+   interrupts on, once the timer has been calibrated. */
+void smp_init(void) {
+  uint32_t *pd, *boot_cr3, *boot_esp;
+  int i;
+
+  ASSERT(intr_get_level() == INTR_ON);
+
+  if (!lapic_present())
+    return;
+  cpus[0].apic_id = lapic_id();
+  if (!acpi_find_cpus())
+    mp_find_cpus();
+  if (ap_cnt == 0)
+    return;
+
+  intr_register_ext(LAPIC_RESCHED_VEC, resched_interrupt, "APIC Resched");
+#ifdef USERPROG
+  intr_register_ext(LAPIC_TLB_VEC, tlb_interrupt, "APIC TLB Shootdown");
+#endif
+  intr_smp_start();
+
+  /* The APs turn on paging while running the startup code at its
+     physical address, so they need a page directory that maps
+     the first 4 MB of physical memory at virtual address 0 as
+     well as where the kernel expects it. */
+  pd = palloc_get_page(PAL_ASSERT);
+  memcpy(pd, init_page_dir, PGSIZE);
+  pd[0] = pd[pd_no(PHYS_BASE)];
+
+  memcpy(ptov(LOADER_AP_BASE), ap_start, ap_start_end - ap_start);
+  boot_cr3 = ptov(LOADER_AP_BASE + ((const char*)&ap_boot_cr3 - ap_start));
+  boot_esp = ptov(LOADER_AP_BASE + ((const char*)&ap_boot_esp - ap_start));
+  *boot_cr3 = vtop(pd);
+
+  for (i = 0; i < ap_cnt; i++)
+    start_ap(ap_ids[i], boot_esp);
+
+  palloc_free_page(pd);
+  printf("smp: %d CPUs online\n", cpu_cnt);
+}
+
+/* Starts the AP with APIC_ID as cpus[cpu_cnt], pointing the copy
+   of ap_boot_esp at BOOT_ESP to the stack it should use. */
+static void start_ap(uint8_t apic_id, uint32_t* boot_esp) {
+  struct cpu* c = &cpus[cpu_cnt];
+  struct thread* t;
+  int64_t deadline;
+  int i;
+
+  c->id = cpu_cnt;
+  c->apic_id = apic_id;
+  c->started = false;
+  t = thread_create_idle(c);
+  if (t == NULL) {
+    printf("smp: out of memory starting CPU with APIC ID %u\n", apic_id);
+    return;
+  }
+  *boot_esp = (uint32_t)t + PGSIZE;
+
+  /* INIT puts the AP in its wait-for-SIPI state, and then a SIPI
+     starts it at LOADER_AP_BASE.  Some CPUs need a second SIPI. */
+  lapic_send_init(apic_id);
+  timer_mdelay(10);
+  for (i = 0; i < 2 && !c->started; i++) {
+    lapic_send_startup(apic_id, LOADER_AP_BASE);
+    timer_udelay(200);
+  }
+
+  /* ap_main() sets STARTED and increments cpu_cnt. */
+  deadline = timer_ns() + 100 * 1000 * 1000;
+  while (!c->started && timer_ns() < deadline)
+    barrier();
+  if (!c->started) {
+    /* Put it back to sleep before freeing its stack. */
+    lapic_send_init(apic_id);
+    thread_destroy_idle(t);
+    printf("smp: CPU with APIC ID %u did not start\n", apic_id);
+  }
+}
+
+/* C entry point for an AP, called by ap-start.S with interrupts
+   off on the stack of the idle thread smp_init() made for it. */
+void ap_main(void) {
+  struct cpu* c = cpu_current();
+
+  /* Drop the startup page directory, which smp_init() frees. */
+  asm volatile("movl %0, %%cr3" : : "r"(vtop(init_page_dir)) : "memory");
+
+  intr_ap_init();
+#ifdef USERPROG
+  gdt_init();
+#endif
+  lapic_ap_init();
+
+  cpu_cnt++;
+  c->started = true;
+  thread_run_idle();
+}
+
+/* Reschedule IPI handler.  Another CPU has made a thread ready on
+   this CPU's run queue that should run now. */
+static void resched_interrupt(struct intr_frame* args UNUSED) { intr_yield_on_return(); }
+
+#ifdef USERPROG
+/* TLB shootdown IPI handler.  Another CPU has changed a page
+   table that this CPU has loaded, and is waiting for us to drop
+   any stale translations.  Reloading CR3 flushes the TLB. */
+static void tlb_interrupt(struct intr_frame* args UNUSED) {
+  struct cpu* c = cpu_current();
+  uint32_t cr3;
+
+  asm volatile("movl %%cr3, %0; movl %0, %%cr3" : "=r"(cr3) : : "memory");
+  c->tlb_flush = false;
+}
+#endif
+
+/* Records APIC_ID as an AP, unless it is the BSP's or we have
+   found as many as we can use. */
+static void add_ap(uint8_t apic_id) {
+  if (apic_id != cpus[0].apic_id && ap_cnt < CPU_MAX - 1)
+    ap_ids[ap_cnt++] = apic_id;
+}
+
+/* Returns a pointer through which to access the SIZE bytes of
+   physical memory at PADDR, or a null pointer if they are not
+   all in RAM that the kernel has mapped. */
+static void* map_phys(uint32_t paddr, uint32_t size) {
+  uint32_t ram = init_ram_pages * PGSIZE;
+
+  if (paddr >= ram || size > ram - paddr)
+    return NULL;
+  return ptov(paddr);
+}
+
+/* Returns true if the SIZE bytes at P sum to 0 mod 256. */
+static bool checksum_ok(const void* p, size_t size) {
+  const uint8_t* b = p;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *b++;
+  return sum == 0;
+}
+
+/* Searches the LENGTH bytes of physical memory at PADDR, on
+   16-byte boundaries, for a structure that starts with the
+   SIGNATURE of SIG_LEN bytes and whose first SIZE bytes have a
+   valid checksum.  Returns it, or a null pointer if none. */
+static void* scan(uint32_t paddr, uint32_t length, const char* signature, size_t sig_len,
+                  size_t size) {
+  const char* p = map_phys(paddr, length);
+  uint32_t ofs;
+
+  if (p == NULL)
+    return NULL;
+  for (ofs = 0; ofs + size <= length; ofs += 16)
+    if (!memcmp(p + ofs, signature, sig_len) && checksum_ok(p + ofs, size))
+      return (void*)(p + ofs);
+  return NULL;
+}
+
+/* Returns the physical address of the Extended BIOS Data Area,
+   whose segment the BIOS stores at 0x40e. */
+static uint32_t ebda_paddr(void) { return (uint32_t) * (uint16_t*)ptov(0x40e) << 4; }
+
+/* Returns the ACPI table at PADDR if it is mapped, has a valid
+   checksum, and has SIGNATURE, or a null pointer otherwise. */
+static struct sdt_header* acpi_table(uint32_t paddr, const char* signature) {
+  struct sdt_header* h = map_phys(paddr, sizeof *h);
+
+  if (h == NULL || memcmp(h->signature, signature, 4) || h->length < sizeof *h ||
+      map_phys(paddr, h->length) == NULL || !checksum_ok(h, h->length))
+    return NULL;
+  return h;
+}
+
+/* Finds the APs listed in the ACPI MADT.  Returns false if there
+   is no MADT. */
+static bool acpi_find_cpus(void) {
+  struct rsdp* rsdp;
+  struct sdt_header* rsdt;
+  uint32_t* entries;
+  size_t i, entry_cnt;
+
+  rsdp = scan(ebda_paddr(), 1024, "RSD PTR ", 8, sizeof *rsdp);
+  if (rsdp == NULL)
+    rsdp = scan(0xe0000, 0x20000, "RSD PTR ", 8, sizeof *rsdp);
+  if (rsdp == NULL || (rsdt = acpi_table(rsdp->rsdt_addr, "RSDT")) == NULL)
+    return false;
+
+  entries = (uint32_t*)(rsdt + 1);
+  entry_cnt = (rsdt->length - sizeof *rsdt) / sizeof *entries;
+  for (i = 0; i < entry_cnt; i++) {
+    struct madt* madt = (struct madt*)acpi_table(entries[i], "APIC");
+    uint8_t *e, *end;
+
+    if (madt == NULL)
+      continue;
+    end = (uint8_t*)madt + madt->header.length;
+    for (e = madt->entries; e + 2 <= end && e[1] >= 2 && e + e[1] <= end; e += e[1]) {
+      struct madt_lapic* l = (struct madt_lapic*)e;
+      if (l->type == MADT_LAPIC && l->length >= sizeof *l && (l->flags & MADT_LAPIC_ENABLED))
+        add_ap(l->apic_id);
+    }
+    return true;
+  }
+  return false;
+}
+
+/* Finds the APs listed in the MP configuration table.  Returns
+   false if there is none. */
+static bool mp_find_cpus(void) {
+  uint32_t base_top = (uint32_t) * (uint16_t*)ptov(0x413) * 1024;
+  struct mp_fps* fps;
+  struct mp_config* config;
+  uint8_t *e, *end;
+  int i;
+
+  fps = scan(ebda_paddr(), 1024, "_MP_", 4, sizeof *fps);
+  if (fps == NULL)
+    fps = scan(base_top - 1024, 1024, "_MP_", 4, sizeof *fps);
+  if (fps == NULL)
+    fps = scan(0xf0000, 0x10000, "_MP_", 4, sizeof *fps);
+  if (fps == NULL || fps->config == 0)
+    return false;
+
+  config = map_phys(fps->config, sizeof *config);
+  if (config == NULL || memcmp(config->signature, "PCMP", 4) ||
+      map_phys(fps->config, config->base_length) == NULL ||
+      !checksum_ok(config, config->base_length))
+    return false;
+
+  e = (uint8_t*)(config + 1);
+  end = (uint8_t*)config + config->base_length;
+  for (i = 0; i < config->entry_cnt && e < end; i++) {
+    if (*e == MP_PROCESSOR) {
+      struct mp_processor* p = (struct mp_processor*)e;
+      if (p->flags & MP_CPU_ENABLED)
+        add_ap(p->apic_id);
+      e += MP_PROCESSOR_SIZE;
+    } else
+      e += MP_OTHER_SIZE;
+  }
+  return true;
+}
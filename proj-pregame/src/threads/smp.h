@@ -0,0 +1,6 @@
+#ifndef THREADS_SMP_H
+#define THREADS_SMP_H
+
+void smp_init(void);
+
+#endif /* threads/smp.h */
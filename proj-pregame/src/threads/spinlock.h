@@ -0,0 +1,45 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A spinlock, for mutual exclusion between CPUs.  A CPU waiting
+   for a spinlock busy-waits instead of sleeping, so spinlocks
+   must only be held briefly, and with interrupts off, so that
+   the holder cannot be preempted by a thread that then spins
+   on the same lock. */
+struct spinlock {
+  volatile uint32_t locked; /* 1 if held, 0 if free. */
+};
+
+/* Initializes LOCK as free. */
+static inline void spinlock_init(struct spinlock* lock) { lock->locked = 0; }
+
+/* Tries to acquire LOCK without spinning.  Returns true if
+   successful, false if LOCK is held.  See [IA32-v2b] "XCHG",
+   which is implicitly locked. */
+static inline bool spinlock_try_acquire(struct spinlock* lock) {
+  uint32_t old = 1;
+  asm volatile("xchgl %0, %1" : "+r"(old), "+m"(lock->locked) : : "memory");
+  return old == 0;
+}
+
+/* Acquires LOCK, spinning until it is free.  Spins on plain
+   reads, which hit in the cache, rather than on XCHG, which
+   would bounce the cache line between the waiting CPUs. */
+static inline void spinlock_acquire(struct spinlock* lock) {
+  while (!spinlock_try_acquire(lock))
+    while (lock->locked)
+      asm volatile("pause");
+}
+
+/* Releases LOCK.  x86 does not reorder stores with older loads
+   or stores, so a compiler barrier is enough to keep the
+   critical section's accesses before the release. */
+static inline void spinlock_release(struct spinlock* lock) {
+  asm volatile("" : : : "memory");
+  lock->locked = 0;
+}
+
+#endif /* threads/spinlock.h */
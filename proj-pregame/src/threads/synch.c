@@ -30,19 +30,18 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
-#include "threads/malloc.h"
 #include "threads/thread.h"
 #include "lib/kernel/list.h"
+#include "devices/timer.h"
 
-/* */
-struct list priorities_list;
+/* Times an adaptive lock checks for its holder to let go before
+   the waiter gives up and sleeps. */
+#define LOCK_SPIN_MAX 1000
+
+/* Locks and readers-writers locks given a name, whose statistics
+   lock_print_stats() prints. */
+static struct list named_locks = LIST_INITIALIZER(named_locks);
 
-/* 初始化 */
-void synch_init(){
-  if(active_sched_policy == SCHED_PRIO){
-    create_thread_unit(thread_current());
-  }
-}
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -106,6 +105,12 @@ bool sema_try_down(struct semaphore* sema) {
 
 /* 弹出等待线程中priority最高的线程 */
 static struct thread* waiters_pop(struct semaphore* sema){
+  /* MLFQS：等待者的优先级可能已经过时，先补算 */
+  if(active_sched_policy == SCHED_MLFQS){
+    struct list_elem* e;
+    for(e = list_begin(&sema->waiters); e != list_end(&sema->waiters); e = list_next(e))
+      mlfqs_refresh(list_entry(e, struct thread, elem));
+  }
   struct list_elem* max = list_max(&sema->waiters, pri_comparator, NULL);
   list_remove(max);
   return list_entry(max, struct thread, elem);
@@ -163,130 +168,91 @@ static void sema_test_helper(void* sema_) {
 
 
 static void lock_acquire_prio(struct lock*);
-static bool lock_comparator(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED);
-
-/* 查找一个线程对应的线程优先级单元 */
-struct thread_priority* thread_unit(struct thread* t){
-  ASSERT(t != NULL);
-
-  if(list_empty(&priorities_list))
-    return NULL;
+static bool lock_spin(struct lock*);
+static void lock_take(struct lock*);
+static void lock_account(struct lock*, bool contended, uint64_t wait_cycles);
+static void stats_init(struct lock_stats*);
+static void stats_name(struct lock_stats*, const char* name);
+static void stats_release(struct lock_stats*, uint64_t held);
+static void lock_setup(struct lock*, uintptr_t site);
+static void rw_lock_setup(struct rw_lock*, enum rw_mode, uintptr_t site);
+
+#ifdef LOCK_PROFILE
+/* Lock contention profiler, built in by "make LOCK_PROFILE=1"
+   (after a "make clean").  Locks are grouped into classes by the
+   code address that called lock_init() on them, so that, for
+   example, every inode's lock adds up in one class.  Use the
+   "backtrace" tool to turn the printed addresses into lines. */
+#define LOCK_CLASSES 128 /* Size of lock_classes[]. */
+#define LOCK_REPORT 20   /* Classes printed, most waited on first. */
+
+struct lock_class {
+  uintptr_t site;           /* Caller of lock_init(), or 0 if slot free. */
+  int64_t locks;            /* Locks initialized there. */
+  int64_t acquires;         /* Times any of them was acquired. */
+  int64_t contended;        /* Times the acquirer had to wait. */
+  uint64_t wait_cycles;     /* Total TSC cycles spent waiting. */
+  uint64_t max_wait_cycles; /* Longest single wait. */
+  uint64_t hold_cycles;     /* Total TSC cycles held. */
+  uint64_t max_hold_cycles; /* Longest single hold. */
+};
 
-  struct list_elem *e;
-  struct thread_priority* t_p;
-  for (e = list_begin(&priorities_list); e != list_end(&priorities_list); e = list_next(e))
-    if((t_p = list_entry(e, struct thread_priority, elem))->thread == t)
-      return t_p;
-  
-  ASSERT("EORRO");
-  return NULL;  
-}
-
-/* 更新线程优先级 由于维护的locks链表中，元素根据prio从大到小排序，
-  所以直接查看第一个元素的prio，判断是否要更新     */
-void re_priority_prio(struct thread_priority* t_p){
-  
-  int priority;
-  struct list_elem* elem;
-  if(list_empty(&t_p->locks)){
-    priority = t_p->old_priorities;
-  }else{
-    elem = list_front(&t_p->locks);
-    priority = list_entry(elem, struct lock_offer, elem)->priority;
-  }
+static struct lock_class lock_classes[LOCK_CLASSES];
+static int64_t lock_classes_dropped; /* Locks from sites that did not fit. */
 
-  t_p->thread->priority = priority;
-  if(t_p->thread == thread_current())
-    thread_try_yield();
-}
+static struct lock_class* lock_class_get(uintptr_t site);
+static void lock_profile_acquire(struct lock*, bool contended, uint64_t wait_cycles);
+static void lock_profile_release(struct lock*, uint64_t held);
+static void lock_profile_print(void);
+#endif
 
-/* 在线程优先级单元中的locks中寻找lock_offer,没有就创建*/
-static struct lock_offer* target(struct lock* lock, struct thread_priority* t_p){
+/* 重新计算 T 的优先级：取基础优先级和它持有的每个锁上
+   等待者最高优先级中的最大值，就绪线程会换队列 */
+void donate_recompute(struct thread* t){
+  ASSERT(intr_get_level() == INTR_OFF);
 
   struct list_elem* e;
-  struct list* list = &t_p->locks;
-  struct lock_offer* lock_offer;
-  for (e = list_begin(list); e != list_end(list); e = list_next(e))
-    if((lock_offer = list_entry(e, struct lock_offer, elem))->lock == lock)
-      return lock_offer;
-  lock_offer = (struct lock_offer*)malloc(sizeof(struct lock_offer));
-  lock_offer->lock = lock;
-  lock_offer->priority = -1;
-  return lock_offer;
-}
-
-/* 向低优先级线程捐赠 */
-static void offer_lock(struct lock* lock, struct thread* low, int priority){
-  ASSERT(lock != NULL);
-  ASSERT(low != NULL);
-
-  struct thread_priority* t_p = thread_unit(low);
-  ASSERT(t_p != NULL);
-
-  struct lock_offer* offer = target(lock,t_p);
-  
-  if(offer->priority == -1) {
-    offer->priority = priority;
-  }else if(offer->priority < priority){
-    offer->priority = priority;
-    list_remove(&offer->elem);
-  }else{}
-  
-  list_insert_ordered_down(&t_p->locks, &offer->elem, lock_comparator, NULL);
-  re_priority_prio(t_p);
-}
-
-/* A <= B时 返回true */
-static bool lock_comparator(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED){
-  return list_entry(a, struct lock_offer, elem)->priority <= list_entry(b, struct lock_offer, elem)->priority;
+  int priority = t->base_priority;
+  for(e = list_begin(&t->held_locks); e != list_end(&t->held_locks); e = list_next(e)){
+    struct lock* lock = list_entry(e, struct lock, elem);
+    if(lock->max_priority > priority)
+      priority = lock->max_priority;
+  }
+  thread_change_priority(t, priority);
 }
 
-/* 迭代捐赠 */
-static void nested_donate(struct thread_priority* cur_tp){
-  ASSERT(cur_tp != NULL);
+/* 沿着等待链把 PRIORITY 捐给 LOCK 的持有者，最多 DONATE_DEPTH_MAX 层。
+   遇到优先级已经不低于 PRIORITY 的持有者就可以停下，
+   它后面的线程早已得到过至少这么高的捐赠 */
+static void donate(struct lock* lock, int priority){
+  ASSERT(intr_get_level() == INTR_OFF);
 
-  struct thread_priority* tp = cur_tp;
-  struct lock* lock = cur_tp->waiting;
+  int depth;
   struct thread* holder;
-  while(lock != NULL){
-    holder = lock->holder;
-    offer_lock(lock, holder, cur_tp->thread->priority);
+  for(depth = 0; lock != NULL && depth < DONATE_DEPTH_MAX; depth++){
+    if(lock->max_priority < priority)
+      lock->max_priority = priority;
 
-    tp = thread_unit(holder);
-    lock = tp->waiting;
+    holder = lock->holder;
+    if(holder == NULL || holder->priority >= priority)
+      break;
+    thread_change_priority(holder, priority);
+    lock = holder->waiting_lock;
   }
 }
 
-/* 结束捐献 */
-static void end_offer(struct lock* lock, struct thread_priority* holder){
-  ASSERT(lock != NULL);
-
-  struct thread_priority* t_p = holder;
+/* 等待 SEMA 的线程中最高的优先级，没有则为 -1 */
+static int waiters_max_priority(struct semaphore* sema){
   struct list_elem* e;
-  struct list* list = &t_p->locks;
-  struct lock_offer* lock_offer;
-  for (e = list_begin(list); e != list_end(list); e = list_next(e))
-    if((lock_offer = list_entry(e, struct lock_offer, elem))->lock == lock){
-      list_remove(e);
-      re_priority_prio(t_p);
-      return;
-    }
-
-  ASSERT("EROOR");
-  
+  int max = -1;
+  for(e = list_begin(&sema->waiters); e != list_end(&sema->waiters); e = list_next(e)){
+    struct thread* t = list_entry(e, struct thread, elem);
+    if(t->priority > max)
+      max = t->priority;
+  }
+  return max;
 }
 
-/* 创建一个线程优先级单元 */
-void create_thread_unit(struct thread* thread){
-  ASSERT(thread != NULL);
-
-  struct thread_priority* thread_p = (struct thread_priority*)malloc(sizeof(struct thread_priority));
-  list_push_front(&priorities_list,&thread_p->elem);
-  list_init(&thread_p->locks);
-  thread_p->old_priorities = thread->priority;
-  thread_p->thread = thread;
-  thread_p->waiting = NULL;
-}
 /* Initializes LOCK.  A lock can be held by at most a single
    thread at any given time.  Our locks are not "recursive", that
    is, it is an error for the thread currently holding a lock to
@@ -302,13 +268,34 @@ void create_thread_unit(struct thread* thread){
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
    instead of a lock. */
-void lock_init(struct lock* lock) {
+void lock_init(struct lock* lock) { lock_setup(lock, (uintptr_t)__builtin_return_address(0)); }
+
+/* Does the work of lock_init() for a call from SITE. */
+static void lock_setup(struct lock* lock, uintptr_t site UNUSED) {
   ASSERT(lock != NULL);
 
   lock->holder = NULL;
+  lock->max_priority = -1;
+  lock->adaptive = false;
+  lock->acquired_at = 0;
+  stats_init(&lock->stats);
+#ifdef LOCK_PROFILE
+  lock->class = lock_class_get(site);
+#endif
   sema_init(&lock->semaphore, 1);
 }
 
+/* Initializes LOCK as an adaptive lock.  A thread that finds an
+   adaptive lock held spins for a while, as long as the holder is
+   running on another CPU, before it goes to sleep: for a short
+   critical section the holder is likely to let go sooner than
+   two context switches would take.  On one CPU the holder can
+   never be running, so this is the same as lock_init(). */
+void lock_init_adaptive(struct lock* lock) {
+  lock_setup(lock, (uintptr_t)__builtin_return_address(0));
+  lock->adaptive = true;
+}
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
@@ -319,44 +306,101 @@ void lock_init(struct lock* lock) {
    we need to sleep. */
 
 void lock_acquire(struct lock* lock) {
+  uint64_t start = 0;
+  bool contended;
+
   ASSERT(lock != NULL);
   ASSERT(!intr_context());
   ASSERT(!lock_held_by_current_thread(lock));
 
-  if(active_sched_policy == SCHED_PRIO){
+  /* Only a hint, to decide whether to time the wait. */
+  contended = lock->semaphore.value == 0;
+  if (contended)
+    start = timer_cycles();
+
+  if (contended && lock->adaptive && lock_spin(lock)) {
+    /* Got it while spinning. */
+  } else if(active_sched_policy == SCHED_PRIO){
     lock_acquire_prio(lock);
   }else{
     sema_down(&lock->semaphore);
-    lock->holder = thread_current();
+    lock_take(lock);
   }
+  lock_account(lock, contended, contended ? timer_cycles() - start : 0);
 }
 
-/* 优先级捐赠策略实现：*/
-static void lock_acquire_prio(struct lock* lock){
-  
-  if(lock_try_acquire(lock)) return;
+/* Spins while LOCK's holder is running, trying to take LOCK as
+   soon as it is free.  Returns true if we took it, false if the
+   holder stopped running or we spun too long. */
+static bool lock_spin(struct lock* lock) {
+  int i;
 
-  struct thread* holder;
+  for (i = 0; i < LOCK_SPIN_MAX; i++) {
+    struct thread* holder = *(struct thread* volatile*)&lock->holder;
+
+    if (holder == NULL) {
+      if (sema_try_down(&lock->semaphore)) {
+        enum intr_level old_level = intr_disable();
+        struct thread* cur = thread_current();
+
+        /* Threads already asleep on the lock still want their
+           priority donated. */
+        lock_take(lock);
+        if (active_sched_policy == SCHED_PRIO) {
+          lock->max_priority = waiters_max_priority(&lock->semaphore);
+          if (lock->max_priority > cur->priority)
+            thread_change_priority(cur, lock->max_priority);
+        }
+        intr_set_level(old_level);
+        return true;
+      }
+    } else if (holder->status != THREAD_RUNNING)
+      return false;
+    asm volatile("pause");
+  }
+  return false;
+}
+
+/* Makes the current thread LOCK's holder, once it has downed
+   LOCK's semaphore. */
+static void lock_take(struct lock* lock) {
+  lock->holder = thread_current();
+  list_push_back(&thread_current()->held_locks, &lock->elem);
+}
+
+/* Updates LOCK's statistics as its new holder: it had to wait
+   WAIT_CYCLES if CONTENDED. */
+static void lock_account(struct lock* lock, bool contended, uint64_t wait_cycles) {
+  lock->stats.acquires++;
+  if (contended) {
+    lock->stats.contended++;
+    lock->stats.wait_cycles += wait_cycles;
+  }
+#ifdef LOCK_PROFILE
+  lock_profile_acquire(lock, contended, wait_cycles);
+#endif
+  lock->acquired_at = timer_cycles();
+}
+
+/* 优先级捐赠策略实现：锁被占用时沿等待链捐赠，拿到锁后
+   继承剩余等待者的优先级。全程不分配内存 */
+static void lock_acquire_prio(struct lock* lock){
   struct thread* cur = thread_current();
-  struct thread_priority* cur_tp = thread_unit(cur); 
   enum intr_level old_level;
 
   old_level = intr_disable();
-  holder = lock->holder;
-  //什么时候holder会大于cur，如果真的大于又怎么处理
-  if(holder!=NULL){  
-  
-    cur_tp->waiting = lock;
-    nested_donate(cur_tp);
-
-    sema_down(&lock->semaphore);
-    lock->holder = thread_current();
-    cur_tp->waiting = NULL;
-
-  }else{
-    sema_down(&lock->semaphore);
-    lock->holder = thread_current();
+  if(lock->holder != NULL){
+    cur->waiting_lock = lock;
+    donate(lock, cur->priority);
   }
+  sema_down(&lock->semaphore);
+  cur->waiting_lock = NULL;
+
+  lock->holder = cur;
+  lock->max_priority = waiters_max_priority(&lock->semaphore);
+  list_push_back(&cur->held_locks, &lock->elem);
+  if(lock->max_priority > cur->priority)
+    thread_change_priority(cur, lock->max_priority);
   intr_set_level(old_level);
 }
 
@@ -373,51 +417,43 @@ bool lock_try_acquire(struct lock* lock) {
   ASSERT(!lock_held_by_current_thread(lock));
 
   success = sema_try_down(&lock->semaphore);
-  if (success)
-    lock->holder = thread_current();
+  if (success) {
+    lock_take(lock);
+    lock_account(lock, false, 0);
+  }
   return success;
 }
 
-static void lock_release_prio(struct lock* lock);
-
 /* Releases LOCK, which must be owned by the current thread.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
    handler. */
 void lock_release(struct lock* lock) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+  uint64_t held;
+
   ASSERT(lock != NULL);
   ASSERT(lock_held_by_current_thread(lock));
 
-  if(active_sched_policy == SCHED_PRIO){
-    lock_release_prio(lock);
-  }else{
-    sema_up(&lock->semaphore);
-    lock->holder = NULL;
-  }
-}
-
-/* 优先级策略下的释放 */
-static void lock_release_prio(struct lock* lock){
-  enum intr_level old_level;
-  struct thread_priority* t_p;
+  held = timer_cycles() - lock->acquired_at;
+  stats_release(&lock->stats, held);
+#ifdef LOCK_PROFILE
+  lock_profile_release(lock, held);
+#endif
 
-  //如果还未启动捐赠单元就普通操作
-  if(list_empty(&priorities_list)){
-    sema_up(&lock->semaphore);
-    lock->holder = NULL;
-  }else{
-    t_p = thread_unit(thread_current());
-    old_level = intr_disable();
-
-    lock->holder = NULL;
-    sema_up(&lock->semaphore);
-    if(!list_empty(&t_p->locks))
-      end_offer(lock, t_p);
+  old_level = intr_disable();
+  list_remove(&lock->elem);
+  lock->holder = NULL;
 
-    intr_set_level(old_level);
-  }
+  /* 只有这个锁的捐赠撑着当前优先级时才需要重新计算 */
+  if(active_sched_policy == SCHED_PRIO && lock->max_priority >= cur->priority)
+    donate_recompute(cur);
+  lock->max_priority = -1;
 
+  sema_up(&lock->semaphore);
+  intr_set_level(old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -429,30 +465,139 @@ bool lock_held_by_current_thread(const struct lock* lock) {
   return lock->holder == thread_current();
 }
 
-/* Initializes a readers-writers lock */
+/* Names LOCK, so that lock_print_stats() prints its statistics.
+   Only for locks that live until shutdown. */
+void lock_set_name(struct lock* lock, const char* name) { stats_name(&lock->stats, name); }
+
+/* Prints the statistics of every named lock. */
+void lock_print_stats(void) {
+  uint64_t hz = timer_cycles_hz();
+  struct list_elem* e;
+
+  for (e = list_begin(&named_locks); e != list_end(&named_locks); e = list_next(e)) {
+    struct lock_stats* s = list_entry(e, struct lock_stats, elem);
+    uint64_t wait_us = hz ? s->wait_cycles * 1000000 / hz : 0;
+    uint64_t hold_us = hz ? s->max_hold_cycles * 1000000 / hz : 0;
+
+    printf("Lock %s: %lld acquires, %lld contended, %llu us waiting, max hold %llu us (tid %d)\n",
+           s->name, s->acquires, s->contended, wait_us, hold_us, s->max_holder);
+  }
+#ifdef LOCK_PROFILE
+  lock_profile_print();
+#endif
+}
+
+/* Initializes statistics S, unnamed. */
+static void stats_init(struct lock_stats* s) {
+  s->name = NULL;
+  s->acquires = s->contended = 0;
+  s->wait_cycles = s->max_hold_cycles = 0;
+  s->max_holder = 0;
+}
+
+/* Names statistics S and adds them to the named locks. */
+static void stats_name(struct lock_stats* s, const char* name) {
+  enum intr_level old_level;
+
+  ASSERT(s->name == NULL);
+
+  s->name = name;
+  old_level = intr_disable();
+  list_push_back(&named_locks, &s->elem);
+  intr_set_level(old_level);
+}
+
+/* Records in S that the current thread is letting go of a lock
+   it held for HELD cycles. */
+static void stats_release(struct lock_stats* s, uint64_t held) {
+  if (held > s->max_hold_cycles) {
+    s->max_hold_cycles = held;
+    s->max_holder = thread_current()->tid;
+  }
+}
+
+/* Initializes a readers-writers lock that prefers writers. */
 void rw_lock_init(struct rw_lock* rw_lock) {
-  lock_init(&rw_lock->lock);
+  rw_lock_setup(rw_lock, RW_PREFER_WRITERS, (uintptr_t)__builtin_return_address(0));
+}
+
+/* Initializes a readers-writers lock with admission policy MODE. */
+void rw_lock_init_mode(struct rw_lock* rw_lock, enum rw_mode mode) {
+  rw_lock_setup(rw_lock, mode, (uintptr_t)__builtin_return_address(0));
+}
+
+/* Does the work of rw_lock_init_mode() for a call from SITE. */
+static void rw_lock_setup(struct rw_lock* rw_lock, enum rw_mode mode, uintptr_t site) {
+  lock_setup(&rw_lock->lock, site);
   cond_init(&rw_lock->read);
   cond_init(&rw_lock->write);
   rw_lock->AR = rw_lock->WR = rw_lock->AW = rw_lock->WW = 0;
+  rw_lock->mode = mode;
+  rw_lock->phase = 0;
+  rw_lock->admitted = 0;
+  rw_lock->acquired_at = 0;
+  stats_init(&rw_lock->stats);
+}
+
+/* Names RW_LOCK, so that lock_print_stats() prints its
+   statistics.  Only for locks that live until shutdown. */
+void rw_lock_set_name(struct rw_lock* rw_lock, const char* name) {
+  stats_name(&rw_lock->stats, name);
+}
+
+/* Returns true if a reader that started waiting in PHASE may
+   enter RW_LOCK now. */
+static bool rw_reader_may_enter(const struct rw_lock* rw_lock, unsigned phase) {
+  switch (rw_lock->mode) {
+    case RW_PREFER_READERS:
+      return rw_lock->AW == 0;
+    case RW_PHASE_FAIR:
+      /* A writer's release admits the readers that waited on it,
+         even if more writers are waiting. */
+      return rw_lock->AW == 0 && (rw_lock->WW == 0 || phase != rw_lock->phase);
+    default:
+      return rw_lock->AW + rw_lock->WW == 0;
+  }
 }
 
-/* Acquire a writer-centric readers-writers lock */
+/* Returns true if a writer may enter RW_LOCK now. */
+static bool rw_writer_may_enter(const struct rw_lock* rw_lock) {
+  return rw_lock->AR + rw_lock->AW == 0 &&
+         (rw_lock->mode != RW_PHASE_FAIR || rw_lock->admitted == 0);
+}
+
+/* Acquire a readers-writers lock, admitting readers and writers
+   according to its mode. */
 void rw_lock_acquire(struct rw_lock* rw_lock, bool reader) {
+  uint64_t start = 0;
+  bool waited = false;
+
   // Must hold the guard lock the entire time
   lock_acquire(&rw_lock->lock);
 
   if (reader) {
-    // Reader code: Block while there are waiting or active writers
-    while ((rw_lock->AW + rw_lock->WW) > 0) {
+    unsigned phase = rw_lock->phase;
+
+    // Reader code: Block until the mode lets us in
+    while (!rw_reader_may_enter(rw_lock, phase)) {
+      if (!waited) {
+        waited = true;
+        start = timer_cycles();
+      }
       rw_lock->WR++;
       cond_wait(&rw_lock->read, &rw_lock->lock);
       rw_lock->WR--;
     }
+    if (phase != rw_lock->phase)
+      rw_lock->admitted--;
     rw_lock->AR++;
   } else {
     // Writer code: Block while there are any active readers/writers in the system
-    while ((rw_lock->AR + rw_lock->AW) > 0) {
+    while (!rw_writer_may_enter(rw_lock)) {
+      if (!waited) {
+        waited = true;
+        start = timer_cycles();
+      }
       rw_lock->WW++;
       cond_wait(&rw_lock->write, &rw_lock->lock);
       rw_lock->WW--;
@@ -460,11 +605,19 @@ void rw_lock_acquire(struct rw_lock* rw_lock, bool reader) {
     rw_lock->AW++;
   }
 
+  rw_lock->stats.acquires++;
+  if (waited) {
+    rw_lock->stats.contended++;
+    rw_lock->stats.wait_cycles += timer_cycles() - start;
+  }
+  if (!reader)
+    rw_lock->acquired_at = timer_cycles();
+
   // Release guard lock
   lock_release(&rw_lock->lock);
 }
 
-/* Release a writer-centric readers-writers lock */
+/* Release a readers-writers lock */
 void rw_lock_release(struct rw_lock* rw_lock, bool reader) {
   // Must hold the guard lock the entire time
   lock_acquire(&rw_lock->lock);
@@ -475,12 +628,23 @@ void rw_lock_release(struct rw_lock* rw_lock, bool reader) {
     if (rw_lock->AR == 0 && rw_lock->WW > 0)
       cond_signal(&rw_lock->write, &rw_lock->lock);
   } else {
-    // Writer code: First try to wake a waiting writer, otherwise all waiting readers
+    stats_release(&rw_lock->stats, timer_cycles() - rw_lock->acquired_at);
     rw_lock->AW--;
-    if (rw_lock->WW > 0)
-      cond_signal(&rw_lock->write, &rw_lock->lock);
-    else if (rw_lock->WR > 0)
+    if (rw_lock->mode == RW_PREFER_WRITERS) {
+      // First try to wake a waiting writer, otherwise all waiting readers
+      if (rw_lock->WW > 0)
+        cond_signal(&rw_lock->write, &rw_lock->lock);
+      else if (rw_lock->WR > 0)
+        cond_broadcast(&rw_lock->read, &rw_lock->lock);
+    } else if (rw_lock->WR > 0) {
+      // Readers first; under RW_PHASE_FAIR only those waiting now
+      if (rw_lock->mode == RW_PHASE_FAIR) {
+        rw_lock->phase++;
+        rw_lock->admitted = rw_lock->WR;
+      }
       cond_broadcast(&rw_lock->read, &rw_lock->lock);
+    } else if (rw_lock->WW > 0)
+      cond_signal(&rw_lock->write, &rw_lock->lock);
   }
 
   // Release guard lock
@@ -590,3 +754,100 @@ void cond_broadcast(struct condition* cond, struct lock* lock) {
   while (!list_empty(&cond->waiters))
     cond_signal(cond, lock);
 }
+
+#ifdef LOCK_PROFILE
+/* Returns the class of locks initialized at SITE, adding it if
+   it is new, or a null pointer if the table is full. */
+static struct lock_class* lock_class_get(uintptr_t site) {
+  enum intr_level old_level = intr_disable();
+  struct lock_class* class = NULL;
+  unsigned h = (site >> 2) % LOCK_CLASSES;
+  int i;
+
+  for (i = 0; i < LOCK_CLASSES; i++) {
+    struct lock_class* c = &lock_classes[(h + i) % LOCK_CLASSES];
+    if (c->site == 0)
+      c->site = site;
+    if (c->site == site) {
+      class = c;
+      class->locks++;
+      break;
+    }
+  }
+  if (class == NULL)
+    lock_classes_dropped++;
+  intr_set_level(old_level);
+  return class;
+}
+
+/* Charges an acquire of LOCK to its class: the acquirer waited
+   WAIT_CYCLES if CONTENDED.  Locks of one class are held by
+   different threads at once, so the update turns interrupts
+   off. */
+static void lock_profile_acquire(struct lock* lock, bool contended, uint64_t wait_cycles) {
+  struct lock_class* c = lock->class;
+  enum intr_level old_level;
+
+  if (c == NULL)
+    return;
+  old_level = intr_disable();
+  c->acquires++;
+  if (contended) {
+    c->contended++;
+    c->wait_cycles += wait_cycles;
+    if (wait_cycles > c->max_wait_cycles)
+      c->max_wait_cycles = wait_cycles;
+  }
+  intr_set_level(old_level);
+}
+
+/* Charges a hold of LOCK for HELD cycles to its class. */
+static void lock_profile_release(struct lock* lock, uint64_t held) {
+  struct lock_class* c = lock->class;
+  enum intr_level old_level;
+
+  if (c == NULL)
+    return;
+  old_level = intr_disable();
+  c->hold_cycles += held;
+  if (held > c->max_hold_cycles)
+    c->max_hold_cycles = held;
+  intr_set_level(old_level);
+}
+
+/* Prints the LOCK_REPORT lock classes with the most total wait
+   time, most first.  Ties, such as between classes that were
+   never contended, go to the one with more total hold time. */
+static void lock_profile_print(void) {
+  bool shown[LOCK_CLASSES] = {false};
+  uint64_t hz = timer_cycles_hz();
+  int n;
+
+#define US(CYCLES) (hz != 0 ? (CYCLES)*1000000 / hz : 0)
+  for (n = 0; n < LOCK_REPORT; n++) {
+    struct lock_class* max = NULL;
+    int i, max_i = 0;
+
+    for (i = 0; i < LOCK_CLASSES; i++) {
+      struct lock_class* c = &lock_classes[i];
+      if (!shown[i] && c->acquires > 0 &&
+          (max == NULL || c->wait_cycles > max->wait_cycles ||
+           (c->wait_cycles == max->wait_cycles && c->hold_cycles > max->hold_cycles))) {
+        max = c;
+        max_i = i;
+      }
+    }
+    if (max == NULL)
+      break;
+    shown[max_i] = true;
+
+    printf("Lock profile: %p (%lld locks): %lld acquires, %lld contended, "
+           "wait %llu us (max %llu), hold %llu us (max %llu)\n",
+           (void*)max->site, max->locks, max->acquires, max->contended, US(max->wait_cycles),
+           US(max->max_wait_cycles), US(max->hold_cycles), US(max->max_hold_cycles));
+  }
+#undef US
+  if (lock_classes_dropped > 0)
+    printf("Lock profile: %lld locks from untracked sites\n", lock_classes_dropped);
+}
+#endif
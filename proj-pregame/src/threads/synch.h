@@ -3,10 +3,9 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 
-void synch_init(void);
-
 /* A counting semaphore. */
 struct semaphore {
   unsigned value;      /* Current value. */
@@ -19,17 +18,43 @@ bool sema_try_down(struct semaphore*);
 void sema_up(struct semaphore*);
 void sema_self_test(void);
 
+/* Contention statistics of a lock or readers-writers lock,
+   updated by the thread that holds it. */
+struct lock_stats {
+  const char* name;         /* Set by lock_set_name(), else null. */
+  struct list_elem elem;    /* In the list of named locks. */
+  int64_t acquires;         /* Times acquired. */
+  int64_t contended;        /* Times the acquirer had to wait. */
+  uint64_t wait_cycles;     /* Total TSC cycles spent waiting. */
+  uint64_t max_hold_cycles; /* Longest time held by one thread. */
+  int max_holder;           /* TID of the thread that held it longest. */
+};
+
 /* Lock. */
 struct lock {
   struct thread* holder;      /* Thread holding lock (for debugging). */
   struct semaphore semaphore; /* Binary semaphore controlling access. */
+  struct list_elem elem;      /* 在持有者的 held_locks 中 */
+  int max_priority;           /* 等待者中最高的优先级，没有则为 -1 */
+  bool adaptive;              /* Spin while the holder is running? */
+  uint64_t acquired_at;       /* TSC when the holder acquired it. */
+  struct lock_stats stats;    /* Contention statistics. */
+#ifdef LOCK_PROFILE
+  struct lock_class* class;   /* Profile of locks from our lock_init() site. */
+#endif
 };
 
+/* 嵌套捐赠最多沿着等待链传递的层数 */
+#define DONATE_DEPTH_MAX 8
+
 void lock_init(struct lock*);
+void lock_init_adaptive(struct lock*);
 void lock_acquire(struct lock*);
 bool lock_try_acquire(struct lock*);
 void lock_release(struct lock*);
 bool lock_held_by_current_thread(const struct lock*);
+void lock_set_name(struct lock*, const char* name);
+void lock_print_stats(void);
 
 /* Condition variable. */
 struct condition {
@@ -45,34 +70,33 @@ void cond_broadcast(struct condition*, struct lock*);
 #define RW_READER 1
 #define RW_WRITER 0
 
+/* Whom a readers-writers lock lets in first when both readers
+   and writers wait. */
+enum rw_mode {
+  RW_PREFER_WRITERS, /* Writers, as soon as the readers drain. */
+  RW_PREFER_READERS, /* Readers, whenever no writer is active. */
+  RW_PHASE_FAIR      /* Alternate: each writer then the readers it held up. */
+};
+
 struct rw_lock {
   struct lock lock;
   struct condition read, write;
   int AR, WR, AW, WW;
+  enum rw_mode mode;        /* Admission policy. */
+  unsigned phase;           /* RW_PHASE_FAIR: bumped when a writer admits readers. */
+  int admitted;             /* RW_PHASE_FAIR: readers admitted but not yet in. */
+  uint64_t acquired_at;     /* TSC when the active writer got in. */
+  struct lock_stats stats;  /* Contention statistics. */
 };
 
 void rw_lock_init(struct rw_lock*);
+void rw_lock_init_mode(struct rw_lock*, enum rw_mode);
 void rw_lock_acquire(struct rw_lock*, bool reader);
 void rw_lock_release(struct rw_lock*, bool reader);
+void rw_lock_set_name(struct rw_lock*, const char* name);
 
-/* 捐赠调度策略使用*/
-struct thread_priority{
-  struct list_elem elem;
-  struct thread* thread;
-  int old_priorities;
-  struct list locks;    /*该线程锁所接受到的，来自于锁的捐赠*/
-  struct lock* waiting;
-};
-
-struct lock_offer{
-  struct list_elem elem;
-  struct lock* lock;
-  int priority;
-};
-
-void create_thread_unit(struct thread* thread);
-struct thread_priority* thread_unit(struct thread* t);
-void re_priority_prio(struct thread_priority* t_p);
+/* 捐赠调度策略使用 */
+void donate_recompute(struct thread*);
 
 /* Optimization barrier.
 
@@ -4,6 +4,7 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -11,6 +12,8 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -20,32 +23,74 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* 优先级调度————捐赠策略 */
-extern struct list priorities_list;
-
-/* 优先级调度————MLFQS策略 */
-struct list ready_lists_mlfqs[64];
-
 /* LOAG_AVG————MLFQS策略*/
 fixed_point_t load_avg;
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-struct list ready_list;
+/* MLFQS：recent_cpu 的衰减按纪元（秒）懒惰地进行。
+   decay_coeff[E % MLFQS_DECAY_HISTORY] 是第 E 秒的衰减系数 */
+#define MLFQS_DECAY_HISTORY 256
+static unsigned decay_epoch;
+static fixed_point_t decay_coeff[MLFQS_DECAY_HISTORY];
+
+/* MLFQS：本周期内 recent_cpu 变过的线程，每个CPU每tick至多一个。
+   其他CPU的tick由BSP转发，可能比BSP晚一个，所以留两倍的余量 */
+#define MLFQS_DIRTY_MAX (2 * MLFQS_PRIORITY_INTERVAL * CPU_MAX)
+static struct thread* mlfqs_dirty[MLFQS_DIRTY_MAX];
+static int mlfqs_dirty_cnt;
+
+/* Per-CPU scheduler state.  Each CPU runs the threads on its own
+   run queue.  Like the rest of the scheduler's state, run queues
+   are protected by turning interrupts off, which on SMP also
+   takes intr_lock (see interrupt.c), so any CPU may put a thread
+   on any other CPU's run queue. */
+struct runqueue {
+  /* List of processes in THREAD_READY state, that is, processes
+     that are ready to run but not actually running.  Used by
+     SCHED_FIFO. */
+  struct list ready_list;
+
+  /* Run queue for SCHED_PRIO and SCHED_MLFQS: a FIFO of ready
+     threads per priority, plus a bitmap with bit P set whenever
+     ready_queues[P] is nonempty, so that the highest-priority
+     ready thread is found in constant time. */
+  struct list ready_queues[PRI_MAX + 1];
+  uint64_t ready_bitmap;
+
+  /* Run queue for SCHED_FAIR: ready threads ordered by virtual
+     runtime, the CPU time each has used scaled down by its
+     weight.  The thread that has had the least runs next. */
+  struct rb_tree fair_tree;
+  int64_t fair_min_vruntime; /* Floor for vruntime; never decreases. */
+  int64_t fair_weight_sum;   /* Total weight of threads in fair_tree. */
+
+  int nr_ready;           /* # of ready threads, under any policy. */
+  struct thread* curr;    /* Thread running on this CPU. */
+  unsigned thread_ticks;  /* # of timer ticks since last yield. */
+  unsigned balance_ticks; /* # of timer ticks since last rebalance. */
+};
+
+static struct runqueue runqueues[CPU_MAX];
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 struct list all_list;
 
-/* Idle thread. */
-static struct thread* idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread* initial_thread;
 
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+/* Pages of threads that have died, kept for thread_create() to
+   reuse instead of going back to palloc, linked through their
+   `elem' members.  No thread page is ever zeroed in full:
+   init_thread() clears the struct thread at the bottom, and the
+   kernel stack above it needs no clearing.  Protected by turning
+   interrupts off. */
+#define THREAD_CACHE_MAX 16
+static struct list thread_cache;
+static size_t thread_cache_cnt;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame {
   void* eip;             /* Return address. */
@@ -57,10 +102,45 @@ struct kernel_thread_frame {
 static long long idle_ticks;   /* # of timer ticks spent idle. */
 static long long kernel_ticks; /* # of timer ticks in kernel threads. */
 static long long user_ticks;   /* # of timer ticks in user programs. */
+static long long steals;       /* # of threads pulled by idle CPUs. */
+static long long migrations;   /* # of threads moved between CPUs. */
+static long long cache_hits;   /* # of thread pages reused from thread_cache. */
+static long long cache_misses; /* # of thread pages taken from palloc. */
 
 /* Scheduling. */
-#define TIME_SLICE 4          /* # of timer ticks to give each thread. */
-static unsigned thread_ticks; /* # of timer ticks since last yield. */
+#define TIME_SLICE 4 /* # of timer ticks to give each thread. */
+
+/* Load balancing between CPUs.  A CPU that runs out of threads
+   steals one from the busiest CPU, and every BALANCE_INTERVAL
+   ticks each CPU pulls a thread from the busiest CPU if that one
+   has at least 2 more threads than it does.  A thread that ran
+   within the last MIGRATION_COST_NS probably still has its
+   working set in its CPU's cache, so it is only moved if it
+   would otherwise wait behind another ready thread. */
+#define BALANCE_INTERVAL (4 * TIME_SLICE)
+#define MIGRATION_COST_NS 500000
+
+/* SCHED_FAIR tuning.  Every ready thread should run once per
+   FAIR_LATENCY_NS, but for at least FAIR_MIN_GRANULARITY_NS at
+   a time.  A waking thread preempts the running one only if it
+   is owed more than FAIR_WAKEUP_GRANULARITY_NS, and a thread
+   that slept is given up to FAIR_SLEEPER_CREDIT_NS of vruntime
+   credit so that it runs soon after waking. */
+#define FAIR_LATENCY_NS (TIME_SLICE * (NSEC_PER_SEC / TIMER_FREQ))
+#define FAIR_MIN_GRANULARITY_NS (NSEC_PER_SEC / TIMER_FREQ)
+#define FAIR_WAKEUP_GRANULARITY_NS (FAIR_MIN_GRANULARITY_NS / 2)
+#define FAIR_SLEEPER_CREDIT_NS (FAIR_LATENCY_NS / 2)
+
+/* Weight of a thread at each priority.  PRI_DEFAULT has weight
+   FAIR_WEIGHT_DEFAULT and each priority level is worth 10% more
+   CPU time than the one below it. */
+#define FAIR_WEIGHT_DEFAULT 1024
+static const int fair_weights[PRI_MAX + 1] = {
+    53,   59,   65,   71,   78,   86,   95,    104,   114,   126,   138,   152,   167,
+    184,  203,  223,  245,  270,  297,  326,   359,   395,   434,   478,   525,   578,
+    636,  699,  769,  846,  931,  1024, 1126,  1239,  1363,  1499,  1649,  1814,  1995,
+    2195, 2415, 2656, 2922, 3214, 3535, 3889,  4278,  4705,  5176,  5693,  6263,  6889,
+    7578, 8336, 9169, 10086, 11095, 12204, 13425, 14767, 16244, 17868, 19655, 21621};
 
 static void init_thread(struct thread*, const char* name, int priority);
 static bool is_thread(struct thread*) UNUSED;
@@ -68,10 +148,15 @@ static void* alloc_frame(struct thread*, size_t size);
 static void schedule(void);
 static void thread_enqueue(struct thread* t);
 static tid_t allocate_tid(void);
+static tid_t create_thread(const char* name, int priority, thread_func*, void* aux,
+                           struct process* pcb);
+static struct thread* thread_page_alloc(void);
+static void thread_page_free(struct thread*);
 void thread_switch_tail(struct thread* prev);
 
 static void kernel_thread(thread_func*, void* aux);
 static void idle(void* aux UNUSED);
+static void idle_loop(void) NO_RETURN;
 static struct thread* running_thread(void);
 
 static struct thread* next_thread_to_run(void);
@@ -81,6 +166,38 @@ static struct thread* thread_schedule_fair(void);
 static struct thread* thread_schedule_mlfqs(void);
 static struct thread* thread_schedule_reserved(void);
 
+static void rq_init(struct runqueue* rq);
+static int rq_load(struct runqueue* rq);
+static struct cpu* select_cpu(void);
+static void cpu_kick(struct thread* t);
+static struct runqueue* busiest_rq(void);
+static struct thread* pick_migratable(struct runqueue* rq, bool idle);
+static void migrate_thread(struct thread* t, struct cpu* dst);
+static bool steal_thread(void);
+static struct thread* balance(void);
+static void rq_push(struct thread* t);
+static void rq_remove(struct thread* t);
+static int rq_max_priority(struct runqueue* rq);
+static struct thread* rq_pop(struct runqueue* rq);
+
+static bool fair_less(const struct rb_elem* a, const struct rb_elem* b, void* aux);
+static void fair_enqueue(struct thread* t);
+static void fair_dequeue(struct thread* t);
+static void fair_update_curr(void);
+static void fair_update_min_vruntime(void);
+static int64_t fair_slice(struct thread* t);
+static bool fair_tick_preempt(struct thread* t);
+static bool fair_wakeup_preempt(void);
+
+/* Returns CPU's run queue. */
+static inline struct runqueue* cpu_rq(struct cpu* cpu) { return &runqueues[cpu->id]; }
+
+/* Returns the running CPU's run queue. */
+static inline struct runqueue* this_rq(void) { return cpu_rq(cpu_current()); }
+
+/* Returns true if T is some CPU's idle thread. */
+static inline bool is_idle(struct thread* t) { return t->cpu != NULL && t == t->cpu->idle_thread; }
+
 /* Determines which scheduler the kernel should use.
    Controlled by the kernel command-line options
     "-sched=fifo", "-sched=prio",
@@ -104,7 +221,7 @@ scheduler_func* scheduler_jump_table[8] = {thread_schedule_fifo,     thread_sche
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queues and the tid lock.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -116,20 +233,20 @@ void thread_init(void) {
   ASSERT(intr_get_level() == INTR_OFF);
 
   lock_init(&tid_lock);
-  list_init(&ready_list);  /* 在MLFQS策略中理应被删除，但害怕有bug */
   list_init(&all_list);
-    /* 初始化专属列表 */
-  if(active_sched_policy == SCHED_PRIO)
-    list_init(&priorities_list);
-  else if(active_sched_policy == SCHED_MLFQS){
-    for(int i = 0; i < 64; i++)
-      list_init(&ready_lists_mlfqs[i]);
+  list_init(&thread_cache);
+  for (int i = 0; i < CPU_MAX; i++)
+    rq_init(&runqueues[i]);
+    /* 初始化专属状态 */
+  if(active_sched_policy == SCHED_MLFQS){
     load_avg = fix_int(0);  
   }
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread();
   init_thread(initial_thread, "main", PRI_DEFAULT);
+  initial_thread->cpu = &cpus[0];
+  runqueues[0].curr = initial_thread;
   initial_thread->niceness = NIC_DEFAULT;
   initial_thread->recent_cpu = fix_int(0);
   initial_thread->status = THREAD_RUNNING;
@@ -149,7 +266,7 @@ void thread_start(void) {
   /* Start preemptive thread scheduling. */
   intr_enable();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to make itself the BSP's. */
   sema_down(&idle_started);
 }
 
@@ -157,12 +274,13 @@ void thread_start(void) {
    Thus, this function runs in an external interrupt context. */
 void thread_tick(void) {
   struct thread* t = thread_current();
+  struct runqueue* rq = this_rq();
 
   /* 当前运行线程加一 */
   recent_cpu_add(t);
 
   /* Update statistics. */
-  if (t == idle_thread)
+  if (is_idle(t))
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pcb != NULL)
@@ -171,10 +289,29 @@ void thread_tick(void) {
   else
     kernel_ticks++;
 
-  if (active_sched_policy == SCHED_MLFQS){}
+  if (active_sched_policy == SCHED_MLFQS){
+    /* BSP 由 timer.c 每 MLFQS_PRIORITY_INTERVAL tick 让出一次，其他CPU按时间片让出 */
+    if (!cpu_is_bsp() && ++rq->thread_ticks >= TIME_SLICE)
+      intr_yield_on_return();
+  }
+  else if (active_sched_policy == SCHED_FAIR){
+    if (!is_idle(t) && fair_tick_preempt(t))
+      intr_yield_on_return();
+  }
   else{
     /* Enforce preemption. */
-    if (++thread_ticks >= TIME_SLICE)
+    if (++rq->thread_ticks >= TIME_SLICE)
+      intr_yield_on_return();
+  }
+
+  /* Even out the load between CPUs. */
+  if (cpu_cnt > 1 && ++rq->balance_ticks >= BALANCE_INTERVAL) {
+    struct thread* pulled = balance();
+
+    rq->balance_ticks = 0;
+    if (pulled != NULL &&
+        (is_idle(t) || ((active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS) &&
+                        pulled->priority > t->priority)))
       intr_yield_on_return();
   }
 }
@@ -183,6 +320,21 @@ void thread_tick(void) {
 void thread_print_stats(void) {
   printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n", idle_ticks, kernel_ticks,
          user_ticks);
+  printf("Thread cache: %lld hits, %lld misses\n", cache_hits, cache_misses);
+  if (cpu_cnt > 1)
+    printf("Balance: %d CPUs, %lld steals, %lld migrations\n", cpu_cnt, steals, migrations);
+
+  if (active_sched_policy == SCHED_FAIR) {
+    struct list_elem* e;
+
+    printf("Fair: min_vruntime %lld ns\n", this_rq()->fair_min_vruntime);
+    for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)) {
+      struct thread* t = list_entry(e, struct thread, allelem);
+      if (!is_idle(t))
+        printf("  %-16s tid %3d pri %2d: vruntime %lld ns, waited %lld ns\n", t->name, t->tid,
+               t->priority, t->vruntime, t->wait_ns);
+    }
+  }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -201,6 +353,23 @@ void thread_print_stats(void) {
    PRIORITY, but no actual priority scheduling is implemented.
    Priority scheduling is the goal of Problem 1-3. */
 tid_t thread_create(const char* name, int priority, thread_func* function, void* aux) {
+  return create_thread(name, priority, function, aux, NULL);
+}
+
+#ifdef USERPROG
+/* Like thread_create(), but the new thread joins process PCB
+   instead of starting a process of its own. */
+tid_t thread_create_in(struct process* pcb, const char* name, int priority, thread_func* function,
+                       void* aux) {
+  ASSERT(pcb != NULL);
+  return create_thread(name, priority, function, aux, pcb);
+}
+#endif
+
+/* Does the work of thread_create().  Under USERPROG the new
+   thread belongs to PCB, or to a new process if PCB is null. */
+static tid_t create_thread(const char* name, int priority, thread_func* function, void* aux,
+                           struct process* pcb UNUSED) {
   struct thread* t;
   struct kernel_thread_frame* kf;
   struct switch_entry_frame* ef;
@@ -210,7 +379,7 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
   ASSERT(function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page(PAL_ZERO);
+  t = thread_page_alloc();
   if (t == NULL)
     return TID_ERROR;
 
@@ -219,9 +388,13 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
   tid = t->tid = allocate_tid();
 
 #ifdef USERPROG
-  if(!process_init(t)){ 
+  if (pcb != NULL)
+    t->pcb = pcb;
+  else if(!process_init(t)){ 
+    enum intr_level old_level = intr_disable();
     list_remove(&t->allelem);
-    palloc_free_page(t);
+    intr_set_level(old_level);
+    thread_page_free(t);
     return TID_ERROR;
   }
 #endif
@@ -264,21 +437,403 @@ void thread_block(void) {
 }
 
 /* Places a thread on the ready structure appropriate for the
-   current active scheduling policy.
+   current active scheduling policy, on the run queue of the CPU
+   it last ran on, or of the least loaded CPU if it is new.
    
    This function must be called with interrupts turned off. */
 static void thread_enqueue(struct thread* t) {
+  struct runqueue* rq;
+
   ASSERT(intr_get_level() == INTR_OFF);
   ASSERT(is_thread(t));
 
+  if (t->cpu == NULL) {
+    t->cpu = select_cpu();
+    t->vruntime = cpu_rq(t->cpu)->fair_min_vruntime; /* 新线程没有睡眠补偿 */
+  }
+  rq = cpu_rq(t->cpu);
+
   if (active_sched_policy == SCHED_FIFO)
-    list_push_back(&ready_list, &t->elem);
+    list_push_back(&rq->ready_list, &t->elem);
   else if (active_sched_policy == SCHED_PRIO)
-    list_insert_ordered_down(&ready_list, &t->elem, pri_comparator, NULL);
-  else if (active_sched_policy == SCHED_MLFQS)
-    list_push_back(&ready_lists_mlfqs[t->priority], &t->elem);
-  else
+    rq_push(t);
+  else if (active_sched_policy == SCHED_MLFQS) {
+    if (t->status == THREAD_BLOCKED)
+      mlfqs_refresh(t);
+    rq_push(t);
+  } else if (active_sched_policy == SCHED_FAIR) {
+    if (t == running_thread())
+      fair_update_curr();
+    else if (t->status == THREAD_BLOCKED) {
+      /* Waking up: keep at most FAIR_SLEEPER_CREDIT_NS of the
+           credit earned while asleep. */
+      int64_t floor = rq->fair_min_vruntime - FAIR_SLEEPER_CREDIT_NS;
+      if (t->vruntime < floor)
+        t->vruntime = floor;
+    }
+    t->ready_since = timer_ns();
+    fair_enqueue(t);
+  } else
     PANIC("Unimplemented scheduling policy value: %d", active_sched_policy);
+
+  rq->nr_ready++;
+  if (t->cpu != cpu_current())
+    cpu_kick(t);
+}
+
+/* Initializes RQ as empty. */
+static void rq_init(struct runqueue* rq) {
+  list_init(&rq->ready_list);
+  for (int i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init(&rq->ready_queues[i]);
+  rq->ready_bitmap = 0;
+  rb_init(&rq->fair_tree, fair_less, NULL);
+}
+
+/* Returns the number of threads that RQ's CPU has to run,
+   counting the running thread unless it is the idle thread. */
+static int rq_load(struct runqueue* rq) {
+  return rq->nr_ready + (rq->curr != NULL && !is_idle(rq->curr));
+}
+
+/* Returns the CPU with the least load for a new thread to start
+   on, preferring the running CPU on a tie. */
+static struct cpu* select_cpu(void) {
+  struct cpu* best = cpu_current();
+  int best_load = rq_load(cpu_rq(best));
+
+  for (int i = 0; i < cpu_cnt; i++) {
+    int load = rq_load(&runqueues[i]);
+    if (load < best_load) {
+      best = &cpus[i];
+      best_load = load;
+    }
+  }
+  return best;
+}
+
+/* Called when ready thread T is on another CPU's run queue.  If
+   that CPU is idle, or running a thread T should preempt, sends
+   it an IPI to make it reschedule. */
+static void cpu_kick(struct thread* t) {
+  struct thread* curr = cpu_rq(t->cpu)->curr;
+  bool preempt = is_idle(curr);
+
+  if ((active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS) &&
+      t->priority > curr->priority)
+    preempt = true;
+  if (preempt)
+    lapic_send_ipi(t->cpu->apic_id, LAPIC_RESCHED_VEC);
+}
+
+/* Returns the run queue of the CPU other than this one with the
+   most ready threads, or a null pointer if none has any. */
+static struct runqueue* busiest_rq(void) {
+  struct runqueue* self = this_rq();
+  struct runqueue* busiest = NULL;
+
+  for (int i = 0; i < cpu_cnt; i++) {
+    struct runqueue* rq = &runqueues[i];
+    if (rq != self && rq->nr_ready > 0 && (busiest == NULL || rq->nr_ready > busiest->nr_ready))
+      busiest = rq;
+  }
+  return busiest;
+}
+
+/* Returns true if T ran recently enough that its CPU's cache is
+   probably still warm for it. */
+static bool cache_hot(struct thread* t) {
+  return t->last_run != 0 && timer_ns() - t->last_run < MIGRATION_COST_NS;
+}
+
+/* Returns a ready thread on RQ that may move to the running CPU,
+   or a null pointer if there is none.  Under SCHED_PRIO and
+   SCHED_MLFQS only threads of RQ's highest priority are
+   considered, so that stealing never runs a thread ahead of a
+   higher-priority one.  A cache-hot thread qualifies only if
+   IDLE, meaning that the running CPU has nothing else to do, and
+   it is not the only thread waiting on RQ. */
+static struct thread* pick_migratable(struct runqueue* rq, bool idle) {
+  bool allow_hot = idle && rq->nr_ready > 1;
+
+  if (active_sched_policy == SCHED_FIFO) {
+    struct list_elem* e;
+    for (e = list_begin(&rq->ready_list); e != list_end(&rq->ready_list); e = list_next(e)) {
+      struct thread* t = list_entry(e, struct thread, elem);
+      if (allow_hot || !cache_hot(t))
+        return t;
+    }
+  } else if (active_sched_policy == SCHED_FAIR) {
+    struct rb_elem* e;
+    for (e = rb_min(&rq->fair_tree); e != NULL; e = rb_next(e)) {
+      struct thread* t = rb_entry(e, struct thread, fair_elem);
+      if (allow_hot || !cache_hot(t))
+        return t;
+    }
+  } else {
+    int priority = rq_max_priority(rq);
+    struct list_elem* e;
+
+    if (priority < 0)
+      return NULL;
+    for (e = list_begin(&rq->ready_queues[priority]); e != list_end(&rq->ready_queues[priority]);
+         e = list_next(e)) {
+      struct thread* t = list_entry(e, struct thread, elem);
+      if (allow_hot || !cache_hot(t))
+        return t;
+    }
+  }
+  return NULL;
+}
+
+/* Moves ready thread T from its CPU's run queue to DST's. */
+static void migrate_thread(struct thread* t, struct cpu* dst) {
+  struct runqueue* src_rq = cpu_rq(t->cpu);
+  struct runqueue* dst_rq = cpu_rq(dst);
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(t->status == THREAD_READY && t->cpu != dst);
+
+  if (active_sched_policy == SCHED_FIFO)
+    list_remove(&t->elem);
+  else if (active_sched_policy == SCHED_FAIR)
+    fair_dequeue(t);
+  else
+    rq_remove(t);
+  src_rq->nr_ready--;
+
+  t->cpu = dst;
+  if (active_sched_policy == SCHED_FIFO)
+    list_push_back(&dst_rq->ready_list, &t->elem);
+  else if (active_sched_policy == SCHED_FAIR) {
+    /* Keep its lag behind the queue's min_vruntime. */
+    t->vruntime += dst_rq->fair_min_vruntime - src_rq->fair_min_vruntime;
+    fair_enqueue(t);
+  } else
+    rq_push(t);
+  dst_rq->nr_ready++;
+  migrations++;
+}
+
+/* Called when this CPU's run queue is empty.  Moves a thread
+   from the busiest CPU's run queue to this one's, and returns
+   true if successful. */
+static bool steal_thread(void) {
+  struct runqueue* busiest = busiest_rq();
+  struct thread* t;
+
+  if (busiest == NULL || (t = pick_migratable(busiest, true)) == NULL)
+    return false;
+  migrate_thread(t, cpu_current());
+  steals++;
+  return true;
+}
+
+/* Periodic load balancing.  If the busiest CPU has at least 2
+   more threads than this one, moves one of its ready threads
+   here and returns it.  Otherwise returns a null pointer. */
+static struct thread* balance(void) {
+  struct runqueue* busiest = busiest_rq();
+  struct thread* t;
+
+  if (busiest == NULL || rq_load(busiest) - rq_load(this_rq()) < 2)
+    return NULL;
+  t = pick_migratable(busiest, false);
+  if (t != NULL)
+    migrate_thread(t, cpu_current());
+  return t;
+}
+
+/* Appends T to the run queue list for its priority. */
+static void rq_push(struct thread* t) {
+  struct runqueue* rq = cpu_rq(t->cpu);
+
+  ASSERT(PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back(&rq->ready_queues[t->priority], &t->elem);
+  rq->ready_bitmap |= (uint64_t)1 << t->priority;
+}
+
+/* Removes ready thread T from its run queue. */
+static void rq_remove(struct thread* t) {
+  struct runqueue* rq = cpu_rq(t->cpu);
+
+  list_remove(&t->elem);
+  if (list_empty(&rq->ready_queues[t->priority]))
+    rq->ready_bitmap &= ~((uint64_t)1 << t->priority);
+}
+
+/* Returns the index of the most significant set bit in X, which
+   must be nonzero.  See [IA32-v2a] "BSR". */
+static inline int bsr(uint32_t x) {
+  int bit;
+  asm("bsrl %1, %0" : "=r"(bit) : "rm"(x));
+  return bit;
+}
+
+/* Returns the highest priority of any thread in RQ, or -1 if it
+   is empty. */
+static int rq_max_priority(struct runqueue* rq) {
+  uint32_t hi = rq->ready_bitmap >> 32;
+  uint32_t lo = rq->ready_bitmap;
+
+  if (hi != 0)
+    return 32 + bsr(hi);
+  else if (lo != 0)
+    return bsr(lo);
+  else
+    return -1;
+}
+
+/* Removes and returns the first thread of RQ's highest-priority
+   nonempty list, or returns NULL if there is none. */
+static struct thread* rq_pop(struct runqueue* rq) {
+  int priority = rq_max_priority(rq);
+  struct thread* t;
+
+  if (priority < 0)
+    return NULL;
+  t = list_entry(list_front(&rq->ready_queues[priority]), struct thread, elem);
+  rq_remove(t);
+  return t;
+}
+
+/* Sets T's priority to PRIORITY.  If T is ready, it moves to
+   the back of the run queue list for its new priority. */
+void thread_change_priority(struct thread* t, int priority) {
+  enum intr_level old_level;
+
+  ASSERT(is_thread(t));
+  ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
+
+  old_level = intr_disable();
+  if (t->priority != priority) {
+    bool queued = t->status == THREAD_READY && !is_idle(t) &&
+                  active_sched_policy != SCHED_FIFO;
+    if (queued)
+      active_sched_policy == SCHED_FAIR ? fair_dequeue(t) : rq_remove(t);
+    t->priority = priority;
+    if (queued) {
+      active_sched_policy == SCHED_FAIR ? fair_enqueue(t) : rq_push(t);
+      if (t->cpu != cpu_current())
+        cpu_kick(t);
+    }
+  }
+  intr_set_level(old_level);
+}
+
+/* Returns true if thread A has less vruntime than B. */
+static bool fair_less(const struct rb_elem* a, const struct rb_elem* b, void* aux UNUSED) {
+  return rb_entry(a, struct thread, fair_elem)->vruntime <
+         rb_entry(b, struct thread, fair_elem)->vruntime;
+}
+
+/* Inserts T into its CPU's fair run queue. */
+static void fair_enqueue(struct thread* t) {
+  struct runqueue* rq = cpu_rq(t->cpu);
+
+  rb_insert(&rq->fair_tree, &t->fair_elem);
+  rq->fair_weight_sum += fair_weights[t->priority];
+}
+
+/* Removes T from its CPU's fair run queue. */
+static void fair_dequeue(struct thread* t) {
+  struct runqueue* rq = cpu_rq(t->cpu);
+
+  rb_remove(&rq->fair_tree, &t->fair_elem);
+  rq->fair_weight_sum -= fair_weights[t->priority];
+}
+
+/* Charges the running thread for the CPU time it has used since
+   it was last charged. */
+static void fair_update_curr(void) {
+  struct thread* cur = running_thread();
+  int64_t now, delta;
+
+  if (is_idle(cur))
+    return;
+
+  now = timer_ns();
+  delta = now - cur->exec_start;
+  if (delta > 0) {
+    cur->exec_start = now;
+    cur->vruntime += delta * FAIR_WEIGHT_DEFAULT / fair_weights[cur->priority];
+  }
+  fair_update_min_vruntime();
+}
+
+/* Advances this CPU's fair_min_vruntime to the least vruntime
+   of the running thread and the ready threads. */
+static void fair_update_min_vruntime(void) {
+  struct runqueue* rq = this_rq();
+  struct thread* cur = running_thread();
+  int64_t min = INT64_MAX;
+
+  if (!is_idle(cur) && cur->status == THREAD_RUNNING)
+    min = cur->vruntime;
+  if (!rb_empty(&rq->fair_tree)) {
+    int64_t first = rb_entry(rb_min(&rq->fair_tree), struct thread, fair_elem)->vruntime;
+    if (first < min)
+      min = first;
+  }
+  if (min != INT64_MAX && min > rq->fair_min_vruntime)
+    rq->fair_min_vruntime = min;
+}
+
+/* Returns how long running thread T should run before giving up
+   the CPU: its weighted share of the scheduling period. */
+static int64_t fair_slice(struct thread* t) {
+  struct runqueue* rq = this_rq();
+  int64_t nr_running = rb_size(&rq->fair_tree) + 1;
+  int64_t period = FAIR_LATENCY_NS;
+  int64_t weight = fair_weights[t->priority];
+  int64_t slice;
+
+  if (nr_running * FAIR_MIN_GRANULARITY_NS > period)
+    period = nr_running * FAIR_MIN_GRANULARITY_NS;
+  slice = period * weight / (rq->fair_weight_sum + weight);
+  return slice > FAIR_MIN_GRANULARITY_NS ? slice : FAIR_MIN_GRANULARITY_NS;
+}
+
+/* Called at each timer tick for running thread T.  Returns true
+   if T has run for its whole slice, or has run for at least the
+   minimum granularity and is a whole slice ahead of the thread
+   that has had the least CPU time. */
+static bool fair_tick_preempt(struct thread* t) {
+  struct runqueue* rq = this_rq();
+  struct thread* first;
+  int64_t ran, slice;
+
+  fair_update_curr();
+  if (rb_empty(&rq->fair_tree))
+    return false;
+
+  ran = timer_ns() - t->slice_start;
+  slice = fair_slice(t);
+  if (ran >= slice)
+    return true;
+  if (ran < FAIR_MIN_GRANULARITY_NS)
+    return false;
+
+  first = rb_entry(rb_min(&rq->fair_tree), struct thread, fair_elem);
+  return t->vruntime - first->vruntime > slice;
+}
+
+/* Returns true if a thread that has just become ready is owed
+   enough CPU time to preempt the running thread. */
+static bool fair_wakeup_preempt(void) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+  bool preempt = false;
+
+  old_level = intr_disable();
+  fair_update_curr();
+  if (!rb_empty(&this_rq()->fair_tree) && !is_idle(cur)) {
+    struct thread* first = rb_entry(rb_min(&this_rq()->fair_tree), struct thread, fair_elem);
+    preempt = first->vruntime + FAIR_WAKEUP_GRANULARITY_NS < cur->vruntime;
+  }
+  intr_set_level(old_level);
+  return preempt;
 }
 
 /* A <= B时 返回true */
@@ -339,6 +894,9 @@ void thread_exit(void) {
      when it calls thread_switch_tail(). */
   intr_disable();
   list_remove(&thread_current()->allelem);
+  for (int i = 0; i < mlfqs_dirty_cnt; i++)
+    if (mlfqs_dirty[i] == thread_current())
+      mlfqs_dirty[i] = NULL;
   thread_current()->status = THREAD_DYING;
   schedule();
   NOT_REACHED();
@@ -353,7 +911,7 @@ void thread_yield(void) {
   ASSERT(!intr_context());
 
   old_level = intr_disable();
-  if (cur != idle_thread)
+  if (!is_idle(cur))
     thread_enqueue(cur);
   cur->status = THREAD_READY;
   schedule();
@@ -379,10 +937,11 @@ void thread_try_yield(){
   struct thread *t;
   int max = -1;
 
-  if (active_sched_policy == SCHED_PRIO){
-    if(list_empty(&ready_list))
-      return;
-    if(list_entry(list_begin(&ready_list), struct thread, elem)->priority > thread_current()->priority)
+  if (active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS){
+    if(rq_max_priority(this_rq()) > thread_current()->priority)
+      thread_yield();
+  }else if (active_sched_policy == SCHED_FAIR){
+    if(fair_wakeup_preempt())
       thread_yield();
   }else{
 
@@ -411,9 +970,11 @@ void thread_set_priority(int new_priority) {
   struct thread* cur = thread_current();
 
   if(active_sched_policy == SCHED_PRIO){
-    struct thread_priority *t_p = thread_unit(cur);
-    t_p->old_priorities = new_priority;
-    re_priority_prio(t_p); 
+    enum intr_level old_level = intr_disable();
+    cur->base_priority = new_priority;
+    donate_recompute(cur);
+    intr_set_level(old_level);
+    thread_try_yield();
   }else if(active_sched_policy == SCHED_MLFQS)
     thread_yield();
   else{
@@ -458,39 +1019,88 @@ int thread_get_recent_cpu(void) {
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-   The idle thread is initially put on the ready list by
+   The BSP's idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   point it makes itself the BSP's idle thread, "up"s the
+   semaphore passed to it to enable thread_start() to continue,
+   and immediately blocks.  After that, the idle thread never
+   appears in the ready list.  It is returned by
+   next_thread_to_run() as a special case when the ready list is
+   empty.  The other CPUs' idle threads are made by
+   thread_create_idle() instead. */
 static void idle(void* idle_started_ UNUSED) {
   struct semaphore* idle_started = idle_started_;
-  idle_thread = thread_current();
+  cpu_current()->idle_thread = thread_current();
   sema_up(idle_started);
+  idle_loop();
+}
 
+/* Body of every CPU's idle thread. */
+static void idle_loop(void) {
   for (;;) {
     /* Let someone else run. */
     intr_disable();
     thread_block();
 
-    /* Re-enable interrupts and wait for the next one.
+    /* Zero free pages while there is nothing else to do. */
+    intr_enable();
+    palloc_prezero();
+    intr_disable();
 
-         The `sti' instruction disables interrupts until the
-         completion of the next instruction, so these two
-         instructions are executed atomically.  This atomicity is
-         important; otherwise, an interrupt could be handled
-         between re-enabling interrupts and waiting for the next
-         one to occur, wasting as much as one clock tick worth of
-         time.
+    /* Stop the periodic tick if nothing needs it soon. */
+    timer_idle_enter();
 
-         See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
-    asm volatile("sti; hlt" : : : "memory");
+    /* Re-enable interrupts and wait for the next one. */
+    intr_enable_and_halt();
   }
 }
 
+/* Creates the idle thread for CPU, which is not running yet, and
+   returns it, or a null pointer if out of memory.  CPU starts it
+   by switching to the top of its page and calling
+   thread_run_idle(). */
+struct thread* thread_create_idle(struct cpu* cpu) {
+  struct thread* t = thread_page_alloc();
+
+  if (t == NULL)
+    return NULL;
+  init_thread(t, "idle", PRI_MIN);
+  t->tid = allocate_tid();
+  t->cpu = cpu;
+  return t;
+}
+
+/* Frees idle thread T, made by thread_create_idle(), whose CPU
+   never started. */
+void thread_destroy_idle(struct thread* t) {
+  enum intr_level old_level;
+
+  ASSERT(is_thread(t) && t->status == THREAD_BLOCKED);
+
+  old_level = intr_disable();
+  list_remove(&t->allelem);
+  intr_set_level(old_level);
+  thread_page_free(t);
+}
+
+/* Turns the code running on a newly started CPU, on the stack of
+   the idle thread that thread_create_idle() made for it, into
+   that idle thread.  Must be called with interrupts off. */
+void thread_run_idle(void) {
+  struct thread* t = running_thread();
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(is_thread(t) && t->cpu != NULL);
+
+  t->status = THREAD_RUNNING;
+  t->cpu->idle_thread = t;
+  cpu_rq(t->cpu)->curr = t;
+  idle_loop();
+}
+
+/* Returns the CPU we are running on. */
+struct cpu* cpu_current(void) { return running_thread()->cpu; }
+
 /* Function used as the basis for a kernel thread. */
 static void kernel_thread(thread_func* function, void* aux) {
   ASSERT(function != NULL);
@@ -529,6 +1139,8 @@ static void init_thread(struct thread* t, const char* name, int priority) {
   strlcpy(t->name, name, sizeof t->name);
   t->stack = (uint8_t*)t + PGSIZE;
   t->priority = priority;
+  t->base_priority = priority;
+  list_init(&t->held_locks);
 #ifdef USERPROG
   t->pcb = NULL;
   t->user_esp = 0;
@@ -540,13 +1152,12 @@ static void init_thread(struct thread* t, const char* name, int priority) {
 
 
 
-  /* 捐赠策略要新建线程单元，MLFQS策略要计算优先级 */
+  /* MLFQS策略要计算优先级 */
   if( t != initial_thread &&  strcmp(name, "idle") != 0 ){
-    if(active_sched_policy == SCHED_PRIO){
-      create_thread_unit(t);
-    }else if(active_sched_policy == SCHED_MLFQS){
+    if(active_sched_policy == SCHED_MLFQS){
       t->niceness = thread_current()->niceness;  /* 继承 */
       t->recent_cpu = thread_current()->recent_cpu;
+      t->decay_epoch = thread_current()->decay_epoch;
       mlfqs_priority_calc(t);
     }
     
@@ -568,33 +1179,38 @@ static void* alloc_frame(struct thread* t, size_t size) {
 
 /* First-in first-out scheduler */
 static struct thread* thread_schedule_fifo(void) {
-  if (!list_empty(&ready_list))
-    return list_entry(list_pop_front(&ready_list), struct thread, elem);
+  struct runqueue* rq = this_rq();
+
+  if (!list_empty(&rq->ready_list))
+    return list_entry(list_pop_front(&rq->ready_list), struct thread, elem);
   else
-    return idle_thread;
+    return cpu_current()->idle_thread;
 }
 
 /* Strict priority scheduler 
-   弹出下一个执行的线程-------和fifo一样*/
+   弹出最高优先级队列的队首线程 */
 static struct thread* thread_schedule_prio(void) {
-  if (!list_empty(&ready_list))
-    return list_entry(list_pop_front(&ready_list), struct thread, elem);
-  else
-    return idle_thread;
+  struct thread* t = rq_pop(this_rq());
+  return t != NULL ? t : cpu_current()->idle_thread;
 }
 
-/* Fair priority scheduler */
+/* Fair priority scheduler: runs the ready thread with the least
+   vruntime. */
 static struct thread* thread_schedule_fair(void) {
-  PANIC("Unimplemented scheduler policy: \"-sched=fair\"");
+  struct runqueue* rq = this_rq();
+  struct thread* t;
+
+  if (rb_empty(&rq->fair_tree))
+    return cpu_current()->idle_thread;
+  t = rb_entry(rb_min(&rq->fair_tree), struct thread, fair_elem);
+  fair_dequeue(t);
+  return t;
 }
 
 /* Multi-level feedback queue scheduler */   
 static struct thread* thread_schedule_mlfqs(void) {
-  for(int i = 63; i >= 0; i--){
-    if(!list_empty(&ready_lists_mlfqs[i]))
-      return list_entry(list_pop_front(&ready_lists_mlfqs[i]), struct thread, elem);
-  }
-  return idle_thread;
+  struct thread* t = rq_pop(this_rq());
+  return t != NULL ? t : cpu_current()->idle_thread;
 }
 
 /* Not an actual scheduling policy — placeholder for empty
@@ -604,12 +1220,21 @@ static struct thread* thread_schedule_reserved(void) {
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   return a thread from this CPU's run queue, unless the run
+   queue is empty.  (If the running thread can continue running,
+   then it will be in the run queue.)  If the run queue is empty,
+   try to steal one from another CPU, or if there is none to steal,
+   return the CPU's idle thread. */
 static struct thread* next_thread_to_run(void) {
-  return (scheduler_jump_table[active_sched_policy])();
+  struct thread* t;
+
+  if (this_rq()->nr_ready == 0 && cpu_cnt > 1)
+    steal_thread();
+  t = (scheduler_jump_table[active_sched_policy])();
+
+  if (!is_idle(t))
+    this_rq()->nr_ready--;
+  return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -630,14 +1255,24 @@ static struct thread* next_thread_to_run(void) {
    is complete. */
 void thread_switch_tail(struct thread* prev) {
   struct thread* cur = running_thread();
+  struct runqueue* rq = this_rq();
 
   ASSERT(intr_get_level() == INTR_OFF);
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  rq->curr = cur;
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  rq->thread_ticks = 0;
+  if (active_sched_policy == SCHED_FAIR && !is_idle(cur)) {
+    int64_t now = timer_ns();
+    if (cur->ready_since != 0)
+      cur->wait_ns += now - cur->ready_since;
+    cur->ready_since = 0;
+    cur->exec_start = cur->slice_start = now;
+    fair_update_min_vruntime();
+  }
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -651,7 +1286,7 @@ void thread_switch_tail(struct thread* prev) {
      palloc().) */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) {
     ASSERT(prev != cur);
-    palloc_free_page(prev);
+    thread_page_free(prev);
   }
 }
 
@@ -665,12 +1300,22 @@ void thread_switch_tail(struct thread* prev) {
 /* 调度的时候必须关中断 */
 static void schedule(void) {
   struct thread* cur = running_thread();
-  struct thread* next = next_thread_to_run();
+  struct thread* next;
   struct thread* prev = NULL;
 
   ASSERT(intr_get_level() == INTR_OFF);
   ASSERT(cur->status != THREAD_RUNNING);
+
+  /* 公平调度：先结算当前线程用掉的CPU时间 */
+  if (active_sched_policy == SCHED_FAIR)
+    fair_update_curr();
+
+  if (cpu_cnt > 1)
+    cur->last_run = timer_ns();
+
+  next = next_thread_to_run();
   ASSERT(is_thread(next));
+  ASSERT(next->cpu == cur->cpu);
 
   if (cur != next)
     prev = switch_threads(cur, next);
@@ -689,6 +1334,41 @@ static tid_t allocate_tid(void) {
   return tid;
 }
 
+/* Returns a page for a new thread, from thread_cache if it has
+   one, otherwise from palloc, or a null pointer if out of
+   memory.  The contents are garbage until init_thread(). */
+static struct thread* thread_page_alloc(void) {
+  enum intr_level old_level = intr_disable();
+  struct thread* t = NULL;
+
+  if (!list_empty(&thread_cache)) {
+    t = list_entry(list_pop_front(&thread_cache), struct thread, elem);
+    thread_cache_cnt--;
+    cache_hits++;
+  } else
+    cache_misses++;
+  intr_set_level(old_level);
+
+  return t != NULL ? t : palloc_get_page(0);
+}
+
+/* Frees the page of thread T, which is dead or never ran, into
+   thread_cache, or back to palloc if the cache is full. */
+static void thread_page_free(struct thread* t) {
+  enum intr_level old_level = intr_disable();
+  bool cached = thread_cache_cnt < THREAD_CACHE_MAX;
+
+  if (cached) {
+    t->magic = 0;
+    list_push_front(&thread_cache, &t->elem);
+    thread_cache_cnt++;
+  }
+  intr_set_level(old_level);
+
+  if (!cached)
+    palloc_free_page(t);
+}
+
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof(struct thread, stack);
@@ -696,56 +1376,81 @@ uint32_t thread_stack_ofs = offsetof(struct thread, stack);
 
 /* MLFQS状态计算实现 */
 
-/* 重新计算最近cpu使用频率 */
+/* 把 T 的 recent_cpu 补上自上次以来错过的每秒衰减。
+   衰减系数只取决于当时的 load_avg，所以每秒只记一个系数，
+   线程下次被用到时再一次性补算，不必每秒遍历所有线程。
+   睡得比 MLFQS_DECAY_HISTORY 秒还久的线程只补最近那些秒 */
 void recent_cpu_calc(struct thread* t){
   ASSERT(intr_get_level() == INTR_OFF);
   ASSERT(is_thread(t));
 
-  fixed_point_t old = t->recent_cpu;
-  fixed_point_t a = fix_scale(load_avg,2);
-  fixed_point_t coefficient = fix_div(a,fix_add(a,fix_int(1)));
-  t->recent_cpu = fix_add(fix_mul(coefficient, old),fix_int(t->niceness));
+  unsigned lag = decay_epoch - t->decay_epoch;
+  if(lag > MLFQS_DECAY_HISTORY)
+    lag = MLFQS_DECAY_HISTORY;
+
+  for(; lag > 0; lag--){
+    fixed_point_t coefficient = decay_coeff[(decay_epoch - lag + 1) % MLFQS_DECAY_HISTORY];
+    t->recent_cpu = fix_add(fix_mul(coefficient, t->recent_cpu), fix_int(t->niceness));
+  }
+  t->decay_epoch = decay_epoch;
 }
 
-/* recent_cpu 加一  idle线程就直接返回 */
+/* recent_cpu 加一  idle线程就直接返回。
+   同时记下它，下次重算优先级时只算这些线程 */
 void recent_cpu_add(struct thread* t){
   ASSERT(intr_get_level() == INTR_OFF);
   ASSERT(is_thread(t));
 
-  if(t == idle_thread ) return;
+  if(is_idle(t)) return;
   t->recent_cpu = fix_add(t->recent_cpu, fix_int(1));
+
+  if(active_sched_policy == SCHED_MLFQS &&
+     (mlfqs_dirty_cnt == 0 || mlfqs_dirty[mlfqs_dirty_cnt - 1] != t)){
+    ASSERT(mlfqs_dirty_cnt < MLFQS_DIRTY_MAX);
+    mlfqs_dirty[mlfqs_dirty_cnt++] = t;
+  }
 }
 
-/* 更新所有线程的recent_cpu */
+/* 每秒调用：进入新的衰减纪元，并更新各CPU上运行和就绪线程的
+   recent_cpu 与优先级。阻塞线程等被唤醒时再补算 */
 void recent_cpu_update(){
   ASSERT(intr_get_level() == INTR_OFF);
 
-  struct list_elem* e;
-  for(e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)){
-    struct thread *t = list_entry(e, struct thread, allelem);
-    if(t != idle_thread  && strcmp(t->name, "idle") != 0 )
-      recent_cpu_calc(t);
+  fixed_point_t a = fix_scale(load_avg,2);
+  decay_epoch++;
+  decay_coeff[decay_epoch % MLFQS_DECAY_HISTORY] = fix_div(a,fix_add(a,fix_int(1)));
+
+  for(int i = 0; i < cpu_cnt; i++){
+    struct runqueue* rq = &runqueues[i];
+    if(!is_idle(rq->curr)){
+      recent_cpu_calc(rq->curr);
+      mlfqs_priority_calc(rq->curr);
+    }
+
+    /* 优先级变了的线程会被移到别的队列末尾，可能再被访问一次，
+       但那时它已经是最新的，不会再移动 */
+    for(int p = PRI_MAX; p >= PRI_MIN; p--){
+      struct list_elem* e = list_begin(&rq->ready_queues[p]);
+      while(e != list_end(&rq->ready_queues[p])){
+        struct thread* t = list_entry(e, struct thread, elem);
+        e = list_next(e);
+        recent_cpu_calc(t);
+        mlfqs_priority_calc(t);
+      }
+    }
   }
 }
 
 
 
-/* 当前运行和就绪的线程的数量（除了idle线程）*/
+/* 所有CPU上运行和就绪的线程的数量（除了idle线程）*/
 static int ready_threads(void){
   ASSERT(intr_get_level() == INTR_OFF)
 
-  struct list_elem* e;
-  int sum = 0;
-  struct thread *t;
-  enum thread_status status;
-
-  for(e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)){
-    t = list_entry(e, struct thread, allelem);
-    status = t->status;
-    if((status == THREAD_RUNNING || status == THREAD_READY )&& t != idle_thread)
-      sum++;
-  }
-  return sum;
+  int cnt = 0;
+  for(int i = 0; i < cpu_cnt; i++)
+    cnt += rq_load(&runqueues[i]);
+  return cnt;
 }
 
 /* 重新计算load_avg——MLFQS */
@@ -765,7 +1470,7 @@ void load_avg_calc(){
 /* 重新计算优先级——MLFQS (这里关中断一下) */
 void mlfqs_priority_calc(struct thread* t){
   ASSERT(is_thread(t));
-  ASSERT(t != idle_thread);
+  ASSERT(!is_idle(t));
   
   int priority;
   fixed_point_t a;
@@ -776,29 +1481,28 @@ void mlfqs_priority_calc(struct thread* t){
 
   priority = fix_trunc(fix_sub(a, fix_int(2 * t->niceness)));
   
-  priority = priority > 63 ? 63:priority;
-  priority = priority < 0 ? 0:priority;
-  t->priority = priority;
+  priority = priority > PRI_MAX ? PRI_MAX:priority;
+  priority = priority < PRI_MIN ? PRI_MIN:priority;
+  thread_change_priority(t, priority);    /* 就绪线程会被移到新优先级的队列 */
   intr_set_level(old_level);
 }
 
-/* 更新所有线程列表ready_lists_mlfqs的分布格局 */
+/* 重新计算上个周期里用过CPU的线程的优先级，就绪线程随之换队列。
+   其他线程的 recent_cpu 在这期间没有变化 */
 void mlfqs_priority_update(){
   ASSERT(intr_get_level() == INTR_OFF);
 
-  struct list_elem* alle;
-  struct list_elem* e;
-  struct thread *t;
-  for(alle = list_begin(&all_list); alle != list_end(&all_list); alle = list_next(alle)){
-    t = list_entry(alle, struct thread, allelem);
-    e = &t->elem;
-    if(t != idle_thread && strcmp(t->name, "idle") != 0){
-      mlfqs_priority_calc(t);
-      
-      if(t->status == THREAD_READY){
-        list_remove(e);
-        list_push_front(&ready_lists_mlfqs[t->priority], e);    
-      }
-    }
-  }
+  for(int i = 0; i < mlfqs_dirty_cnt; i++)
+    if(mlfqs_dirty[i] != NULL)
+      mlfqs_refresh(mlfqs_dirty[i]);
+  mlfqs_dirty_cnt = 0;
+}
+
+/* 阻塞线程的 recent_cpu 可能落后了若干秒，补算后重新计算优先级 */
+void mlfqs_refresh(struct thread* t){
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if(is_idle(t)) return;
+  recent_cpu_calc(t);
+  mlfqs_priority_calc(t);
 }
@@ -3,10 +3,13 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
 #include "threads/synch.h"
 #include "threads/fixed-point.h"
 
+struct cpu;
+
 /* States in a thread's life cycle. */
 enum thread_status {
   THREAD_RUNNING, /* Running thread. */
@@ -94,10 +97,26 @@ struct thread {
   uint8_t* stack;            /* Saved stack pointer. */
   int priority;              /* Priority. */
   struct list_elem allelem;  /* List element for all threads list. */
+  struct cpu* cpu;           /* CPU whose run queue we are on. */
+  int64_t last_run;          /* timer_ns() when last switched out. */
 
   /*线程BSD调度使用*/
   int niceness;              /* 友好度 */
   fixed_point_t recent_cpu;  /* 最近占用的cpu频率 */
+  unsigned decay_epoch;      /* recent_cpu 已衰减到的纪元 */
+
+  /* 优先级捐赠（SCHED_PRIO）使用 */
+  int base_priority;         /* 不算捐赠时的优先级 */
+  struct list held_locks;    /* 持有的锁 */
+  struct lock* waiting_lock; /* 正在等待的锁 */
+
+  /* 公平调度（SCHED_FAIR）使用 */
+  int64_t vruntime;          /* CPU time used, in ns, scaled by weight. */
+  int64_t exec_start;        /* timer_ns() when last charged for CPU time. */
+  int64_t slice_start;       /* timer_ns() when last dispatched. */
+  int64_t ready_since;       /* timer_ns() when last made ready. */
+  int64_t wait_ns;           /* Total time spent ready, in ns. */
+  struct rb_elem fair_elem;  /* Element in the fair run queue. */
 
   /* Shared between thread.c and synch.c. */
   struct list_elem elem; /* List element. */
@@ -136,6 +155,9 @@ void thread_print_stats(void);
 
 typedef void thread_func(void* aux);
 tid_t thread_create(const char* name, int priority, thread_func*, void*);
+#ifdef USERPROG
+tid_t thread_create_in(struct process*, const char* name, int priority, thread_func*, void*);
+#endif
 
 void thread_block(void);
 void thread_unblock(struct thread*);
@@ -147,6 +169,10 @@ const char* thread_name(void);
 void thread_exit(void) NO_RETURN;
 void thread_yield(void);
 
+struct thread* thread_create_idle(struct cpu*);
+void thread_destroy_idle(struct thread*);
+void thread_run_idle(void) NO_RETURN;
+
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func(struct thread* t, void* aux);
 void thread_foreach(thread_action_func*, void*);
@@ -154,6 +180,7 @@ void thread_foreach(thread_action_func*, void*);
 int thread_get_priority(void);
 void thread_try_yield(void);         /* 如果自身不是最高优先级的函数，yield*/
 void thread_set_priority(int);
+void thread_change_priority(struct thread*, int);
 
 int thread_get_nice(void);
 void thread_set_nice(int);
@@ -165,6 +192,9 @@ bool pri_comparator(const struct list_elem* a, const struct list_elem* b, void*
 
 /* MLFQS状态计算函数 */
  
+/* 每隔多少tick重新计算优先级 */
+#define MLFQS_PRIORITY_INTERVAL 4
+
 /* recent_cpu */
 void recent_cpu_calc(struct thread*);
 void recent_cpu_add(struct thread*);
@@ -176,5 +206,6 @@ void load_avg_calc(void);
 /* priority */
 void mlfqs_priority_calc(struct thread*);
 void mlfqs_priority_update(void);
+void mlfqs_refresh(struct thread*);
 
 #endif /* threads/thread.h */
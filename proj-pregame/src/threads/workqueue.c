@@ -0,0 +1,240 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Kernel work queue.  A fixed pool of worker threads runs work
+   queued by code that cannot or should not do it itself, such as
+   interrupt handlers and system calls that want to return
+   quickly, without each of them paying for a thread of its own.
+
+   The queues may be changed from interrupt handlers, so they are
+   protected by turning interrupts off rather than by a lock. */
+
+/* Number of worker threads: one per CPU, but at least
+   WORKERS_MIN so that one sleeping work does not hold up all the
+   others. */
+#define WORKERS_MIN 2
+#define WORKERS_MAX (CPU_MAX > WORKERS_MIN ? CPU_MAX : WORKERS_MIN)
+
+/* Queued work, one FIFO per priority. */
+static struct list queues[WORK_PRI_CNT];
+
+/* Counts queued works, so that workers sleep while there are
+   none.  May be higher than the number queued if some were
+   cancelled, so workers must allow for empty queues. */
+static struct semaphore work_avail;
+
+/* A worker thread. */
+struct worker {
+  struct thread* thread; /* The worker itself. */
+  struct work* current;  /* Work being run, or null. */
+};
+static struct worker workers[WORKERS_MAX];
+static int worker_cnt;
+
+/* Threads in work_flush(), each waiting on a semaphore that a
+   worker ups after every work it runs. */
+static struct list flush_waiters;
+
+/* A thread in work_flush(). */
+struct flush_waiter {
+  struct list_elem elem;      /* Element in flush_waiters. */
+  struct semaphore semaphore; /* Upped by a worker. */
+};
+
+/* Statistics, per priority. */
+static long long work_cnt[WORK_PRI_CNT];   /* # of works run. */
+static int64_t wait_ns_total[WORK_PRI_CNT]; /* Time from queued to run. */
+static int64_t wait_ns_max[WORK_PRI_CNT];
+
+static thread_func worker_loop;
+static void enqueue(struct work*);
+static void delayed_expire(void* work);
+static bool work_running(const struct work*);
+
+/* Creates the worker threads.  Must be called after
+   thread_start(), and after smp_init() to get one worker per
+   CPU. */
+void workqueue_init(void) {
+  int i;
+
+  for (i = 0; i < WORK_PRI_CNT; i++)
+    list_init(&queues[i]);
+  sema_init(&work_avail, 0);
+  list_init(&flush_waiters);
+
+  worker_cnt = cpu_cnt > WORKERS_MIN ? cpu_cnt : WORKERS_MIN;
+  for (i = 0; i < worker_cnt; i++) {
+    char name[32];
+    snprintf(name, sizeof name, "worker%d", i);
+    if (thread_create(name, PRI_DEFAULT, worker_loop, &workers[i]) == TID_ERROR)
+      PANIC("workqueue: can't create worker thread");
+  }
+}
+
+/* Prints work queue statistics. */
+void workqueue_print_stats(void) {
+  static const char* names[WORK_PRI_CNT] = {"high", "normal", "low"};
+  int i;
+
+  for (i = 0; i < WORK_PRI_CNT; i++)
+    if (work_cnt[i] > 0)
+      printf("Workqueue: %lld %s works, waited %lld us avg, %lld us max\n", work_cnt[i], names[i],
+             wait_ns_total[i] / work_cnt[i] / 1000, wait_ns_max[i] / 1000);
+}
+
+/* Initializes W to call FUNC(AUX) at PRIORITY when queued.  W is
+   not pending until passed to work_queue() or
+   work_queue_delayed(). */
+void work_init(struct work* w, work_func* func, void* aux, enum work_priority priority) {
+  ASSERT(w != NULL);
+  ASSERT(func != NULL);
+  ASSERT(priority < WORK_PRI_CNT);
+
+  w->func = func;
+  w->aux = aux;
+  w->priority = priority;
+  w->pending = false;
+  timer_event_init(&w->timer, delayed_expire, w);
+}
+
+/* Queues W to be run by a worker thread.  Returns false, doing
+   nothing, if W is already pending.  May be called from an
+   interrupt handler. */
+bool work_queue(struct work* w) {
+  enum intr_level old_level = intr_disable();
+  bool queued = !w->pending;
+
+  if (queued) {
+    w->pending = true;
+    enqueue(w);
+  }
+  intr_set_level(old_level);
+  return queued;
+}
+
+/* Queues W to be run by a worker thread after TICKS timer ticks.
+   Returns false, doing nothing, if W is already pending.  May be
+   called from an interrupt handler. */
+bool work_queue_delayed(struct work* w, int64_t ticks) {
+  enum intr_level old_level;
+  bool queued;
+
+  if (ticks <= 0)
+    return work_queue(w);
+
+  old_level = intr_disable();
+  queued = !w->pending;
+  if (queued) {
+    w->pending = true;
+    timer_add(&w->timer, timer_ticks() + ticks);
+  }
+  intr_set_level(old_level);
+  return queued;
+}
+
+/* Stops W from running if it is pending.  Returns true if W was
+   pending, false if it had already started running or was never
+   queued.  Does not wait for a running W to finish; use
+   work_flush() for that. */
+bool work_cancel(struct work* w) {
+  enum intr_level old_level = intr_disable();
+  bool was_pending = w->pending;
+
+  if (was_pending) {
+    if (!timer_cancel(&w->timer))
+      list_remove(&w->elem);
+    w->pending = false;
+  }
+  intr_set_level(old_level);
+  return was_pending;
+}
+
+/* Waits until W is neither pending nor running.  If W queues
+   itself again each time it runs, this may never return. */
+void work_flush(struct work* w) {
+  enum intr_level old_level;
+
+  ASSERT(!intr_context());
+
+  old_level = intr_disable();
+  while (w->pending || work_running(w)) {
+    struct flush_waiter waiter;
+
+    sema_init(&waiter.semaphore, 0);
+    list_push_back(&flush_waiters, &waiter.elem);
+    sema_down(&waiter.semaphore);
+  }
+  intr_set_level(old_level);
+}
+
+/* Appends W to its priority's queue and wakes a worker. */
+static void enqueue(struct work* w) {
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  w->queued_ns = timer_ns();
+  list_push_back(&queues[w->priority], &w->elem);
+  sema_up(&work_avail);
+}
+
+/* Timer callback for work_queue_delayed(). */
+static void delayed_expire(void* work) { enqueue(work); }
+
+/* Returns true if a worker is running W. */
+static bool work_running(const struct work* w) {
+  int i;
+
+  for (i = 0; i < worker_cnt; i++)
+    if (workers[i].current == w)
+      return true;
+  return false;
+}
+
+/* Body of a worker thread: runs queued work, highest priority
+   first, forever. */
+static void worker_loop(void* worker_) {
+  struct worker* self = worker_;
+
+  self->thread = thread_current();
+  for (;;) {
+    enum intr_level old_level;
+    struct work* w = NULL;
+    int64_t wait;
+    int p;
+
+    sema_down(&work_avail);
+
+    old_level = intr_disable();
+    for (p = 0; p < WORK_PRI_CNT; p++)
+      if (!list_empty(&queues[p])) {
+        w = list_entry(list_pop_front(&queues[p]), struct work, elem);
+        break;
+      }
+    if (w == NULL) {
+      /* Cancelled after it was queued. */
+      intr_set_level(old_level);
+      continue;
+    }
+    w->pending = false;
+    self->current = w;
+    wait = timer_ns() - w->queued_ns;
+    work_cnt[p]++;
+    wait_ns_total[p] += wait;
+    if (wait > wait_ns_max[p])
+      wait_ns_max[p] = wait;
+    intr_set_level(old_level);
+
+    /* W may be freed or queued again once FUNC starts. */
+    w->func(w->aux);
+
+    old_level = intr_disable();
+    self->current = NULL;
+    while (!list_empty(&flush_waiters))
+      sema_up(&list_entry(list_pop_front(&flush_waiters), struct flush_waiter, elem)->semaphore);
+    intr_set_level(old_level);
+  }
+}
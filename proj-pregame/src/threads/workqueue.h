@@ -0,0 +1,42 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Priorities of queued work.  Workers always take the oldest
+   work of the highest priority. */
+enum work_priority {
+  WORK_HIGH,   /* Latency-sensitive, e.g. waking a waiting process. */
+  WORK_NORMAL, /* Ordinary deferred work. */
+  WORK_LOW,    /* Background work, e.g. read-ahead or cleanup. */
+  WORK_PRI_CNT
+};
+
+/* Deferred work.  Once queued, FUNC is called with AUX by one of
+   the kernel's worker threads, in thread context with interrupts
+   on, so it may sleep.  A work is queued at most once at a time,
+   and FUNC may free the work or queue it again. */
+typedef void work_func(void* aux);
+struct work {
+  struct list_elem elem;       /* Element in a priority queue. */
+  work_func* func;             /* Function to call. */
+  void* aux;                   /* Argument to FUNC. */
+  enum work_priority priority; /* Queue to run from. */
+  bool pending;                /* Queued or delayed and not yet run? */
+  int64_t queued_ns;           /* timer_ns() when queued. */
+  struct timer_event timer;    /* For work_queue_delayed(). */
+};
+
+void workqueue_init(void);
+void workqueue_print_stats(void);
+
+void work_init(struct work*, work_func*, void* aux, enum work_priority);
+bool work_queue(struct work*);
+bool work_queue_delayed(struct work*, int64_t ticks);
+bool work_cancel(struct work*);
+void work_flush(struct work*);
+
+#endif /* threads/workqueue.h */
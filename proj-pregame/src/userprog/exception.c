@@ -190,17 +190,27 @@ static void page_fault(struct intr_frame* f) {
       
 
 #ifdef VM
+      /* 同一进程的线程共享页目录和辅助页表，缺页处理要串行化。
+         拿到锁后再检查一次：别的线程可能已经把这一页装好了 */
+      lock_acquire(&pcb->vm_lock);
+      if(pagedir_get_page(pcb->pagedir, fault_addr) != NULL){
+         lock_release(&pcb->vm_lock);
+         return;
+      }
+
       /* 懒加载页 */
       if(pagedir_is_lazy(pcb->pagedir, fault_addr)){
          handle_lazy_load(pcb, fault_addr);
+         lock_release(&pcb->vm_lock);
          return;
       }
 
       /* 判断并处理栈拓展 */
-      else if(stack_extensible(pcb, fault_addr, user_esp))
+      else if(stack_extensible(pcb, fault_addr, user_esp)){
+         lock_release(&pcb->vm_lock);
          return;
-      else{}
-      
+      }
+      lock_release(&pcb->vm_lock);
 #endif
 
       /* 访问到无效地址 */
@@ -214,12 +224,14 @@ static void page_fault(struct intr_frame* f) {
 
 /* 处理懒加载的页，先获取一块用户池的页，然后根据不同情况操作 */
 static void handle_lazy_load(struct process* pcb, void* fault_addr){
-   void *kaddr = palloc_get_page(PAL_USER);
+   void *uaddr = pg_round_down(fault_addr);
+   struct page* page = pages_get(&pcb->pt, pagedir_get_avl(pcb->pagedir, fault_addr), uaddr);
+
+   /* 全零页直接取预先清零的页，缺页处理只需建立映射 */
+   void *kaddr = palloc_get_page(page->type == ZERO ? PAL_USER | PAL_ZERO : PAL_USER);
    if(kaddr == NULL)
       PANIC(" DEBUG ");
 
-   void *uaddr = pg_round_down(fault_addr);
-   struct page* page = pages_get(&pcb->pt, pagedir_get_avl(pcb->pagedir, fault_addr), uaddr);
    if(page->type == SWAP)
       swap_in(kaddr, page->pos);
    else if(page->type == FILE || page->type == MMAP){
@@ -230,9 +242,7 @@ static void handle_lazy_load(struct process* pcb, void* fault_addr){
          PANIC(" DEBUG ");
       memset(kaddr + read_bytes, 0, zero_bytes);
    }
-   else if(page->type == ZERO)
-      memset(kaddr, 0, PGSIZE);
-   else  
+   else if(page->type != ZERO)
       PANIC(" NO WAY ");
 
    size_t avl = pagedir_get_avl(pcb->pagedir, uaddr);
@@ -0,0 +1,114 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+
+/* Sleeping threads are kept in a fixed hash table of wait
+   queues, keyed by the page directory of their process and the
+   user address they wait on, so that the same address in two
+   processes never shares a queue. */
+#define FUTEX_BUCKETS 64
+
+struct futex_bucket {
+  struct lock lock;     /* Protects WAITERS. */
+  struct list waiters;  /* List of struct futex_waiter. */
+};
+
+/* A thread sleeping in futex_wait(), on its own stack. */
+struct futex_waiter {
+  uint32_t* pd;             /* Page directory of the process. */
+  int32_t* uaddr;           /* User address waited on. */
+  struct semaphore woken;   /* Upped by futex_wake(). */
+  struct list_elem elem;    /* Element in bucket's WAITERS. */
+};
+
+static struct futex_bucket buckets[FUTEX_BUCKETS];
+
+/* Returns the bucket for UADDR in page directory PD. */
+static struct futex_bucket* bucket_for(uint32_t* pd, int32_t* uaddr) {
+  uintptr_t key[2] = {(uintptr_t)pd, (uintptr_t)uaddr};
+  return &buckets[hash_bytes(key, sizeof key) % FUTEX_BUCKETS];
+}
+
+/* Initializes the futex wait queues. */
+void futex_init(void) {
+  int i;
+
+  for (i = 0; i < FUTEX_BUCKETS; i++) {
+    lock_init(&buckets[i].lock);
+    list_init(&buckets[i].waiters);
+  }
+}
+
+/* If the user word at UADDR still holds EXPECTED, sleeps until a
+   futex_wake() on UADDR and returns 0.  Returns -1 at once if it
+   does not, or if the current process is exiting.  UADDR must be
+   a valid, aligned user address. */
+int futex_wait(int32_t* uaddr, int32_t expected) {
+  struct process* pcb = thread_current()->pcb;
+  struct futex_bucket* b = bucket_for(pcb->pagedir, uaddr);
+  struct futex_waiter w;
+
+  /* Checking the word and queueing under the bucket lock means a
+     waker that changes the word first cannot miss us. */
+  lock_acquire(&b->lock);
+  if (*uaddr != expected || pcb->exiting) {
+    lock_release(&b->lock);
+    return -1;
+  }
+  w.pd = pcb->pagedir;
+  w.uaddr = uaddr;
+  sema_init(&w.woken, 0);
+  list_push_back(&b->waiters, &w.elem);
+  lock_release(&b->lock);
+
+  sema_down(&w.woken);
+  return 0;
+}
+
+/* Wakes up to CNT threads of the current process sleeping on
+   UADDR, oldest first.  Returns the number woken. */
+int futex_wake(int32_t* uaddr, int cnt) {
+  uint32_t* pd = thread_current()->pcb->pagedir;
+  struct futex_bucket* b = bucket_for(pd, uaddr);
+  struct list_elem* e;
+  int woken = 0;
+
+  lock_acquire(&b->lock);
+  for (e = list_begin(&b->waiters); e != list_end(&b->waiters) && woken < cnt;) {
+    struct futex_waiter* w = list_entry(e, struct futex_waiter, elem);
+    e = list_next(e);
+    if (w->pd == pd && w->uaddr == uaddr) {
+      list_remove(&w->elem);
+      sema_up(&w->woken);
+      woken++;
+    }
+  }
+  lock_release(&b->lock);
+  return woken;
+}
+
+/* Wakes every thread sleeping on any address in page directory
+   PD, so that the threads of an exiting process can leave it. */
+void futex_wake_process(uint32_t* pd) {
+  int i;
+
+  for (i = 0; i < FUTEX_BUCKETS; i++) {
+    struct futex_bucket* b = &buckets[i];
+    struct list_elem* e;
+
+    lock_acquire(&b->lock);
+    for (e = list_begin(&b->waiters); e != list_end(&b->waiters);) {
+      struct futex_waiter* w = list_entry(e, struct futex_waiter, elem);
+      e = list_next(e);
+      if (w->pd == pd) {
+        list_remove(&w->elem);
+        sema_up(&w->woken);
+      }
+    }
+    lock_release(&b->lock);
+  }
+}
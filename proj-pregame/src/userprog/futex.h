@@ -0,0 +1,16 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdint.h>
+
+/* Fast user-space mutexes.  User locks and semaphores live in
+   user memory and are changed with atomic instructions; a thread
+   only enters the kernel to sleep on a word that is not what it
+   wants, or to wake the threads sleeping on it. */
+
+void futex_init(void);
+int futex_wait(int32_t* uaddr, int32_t expected);
+int futex_wake(int32_t* uaddr, int cnt);
+void futex_wake_process(uint32_t* pd);
+
+#endif /* userprog/futex.h */
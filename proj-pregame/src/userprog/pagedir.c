@@ -2,9 +2,13 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include "devices/lapic.h"
+#include "threads/cpu.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #ifdef VM
 #include "vm/frame.h"
 #include "vm/page.h"
@@ -264,6 +268,8 @@ void pagedir_set_lazy(uint32_t* pd, const void* vpage, bool lazy) {
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void pagedir_activate(uint32_t* pd) {
+  enum intr_level old_level;
+
   if (pd == NULL)
     pd = init_page_dir;
 
@@ -273,7 +279,14 @@ void pagedir_activate(uint32_t* pd) {
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
      Address of the Page Directory". */
   /* 这里写入cr3的同时，也会刷新TLB */
+  /* Record PD for invalidate_pagedir() on other CPUs.  Both are
+     done with interrupts off, so that another CPU that changes
+     PD's page tables either sees it here or changed them before
+     we load it. */
+  old_level = intr_disable();
+  cpu_current()->active_pd = pd;
   asm volatile("movl %0, %%cr3" : : "r"(vtop(pd)) : "memory");
+  intr_set_level(old_level);
 }
 
 /* Returns the currently active page directory. */
@@ -294,13 +307,44 @@ uint32_t* active_pd(void) {
 
    This function invalidates the TLB if PD is the active page
    directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   the TLB, so there is no need to invalidate anything.)
+
+   Threads of one process share PD, so it may also be active on
+   other CPUs.  Each of those is sent a TLB shootdown IPI, and we
+   wait until all of them have flushed, so that a frame that was
+   unmapped can be reused as soon as we return.  The wait is done
+   with interrupts on, since the other CPUs need intr_lock to
+   take the IPI. */
 static void invalidate_pagedir(uint32_t* pd) {
-  if (active_pd() == pd) {
+  struct cpu* self;
+  unsigned targets = 0;
+  enum intr_level old_level;
+  int i;
+
+  old_level = intr_disable();
+  self = cpu_current();
+  if (self->active_pd == pd) {
     /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
          "Translation Lookaside Buffers (TLBs)". */
     pagedir_activate(pd);
   }
+  for (i = 0; i < cpu_cnt; i++) {
+    struct cpu* c = &cpus[i];
+    if (c != self && c->active_pd == pd) {
+      c->tlb_flush = true;
+      lapic_send_ipi(c->apic_id, LAPIC_TLB_VEC);
+      targets |= 1u << i;
+    }
+  }
+  intr_set_level(old_level);
+
+  if (targets == 0)
+    return;
+  ASSERT(old_level == INTR_ON);
+  for (i = 0; i < cpu_cnt; i++)
+    if (targets & (1u << i))
+      while (cpus[i].tlb_flush)
+        barrier();
 }
 
 /* 在地址UPAGE基础上，直到地址所在页未被加载前，一直向下查找到最后一个已加载页 */
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
@@ -16,6 +17,7 @@
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -28,7 +30,14 @@ extern struct list all_list;
 static thread_func start_process NO_RETURN;
 static thread_func start_pthread NO_RETURN;
 static bool load(const char* comd, void (**eip)(void), void** esp);
-bool setup_thread(void (**eip)(void), void** esp);
+static bool setup_thread(stub_fun sf, pthread_fun tf, void* arg, void (**eip)(void), void** esp,
+                         int* slot);
+static void process_exit_status(int32_t status, bool report) NO_RETURN;
+static void process_leave(void) NO_RETURN;
+static void process_teardown(struct process* pcb);
+static void process_init_threads(struct process* pcb);
+static struct pthread_info* pthread_info_find(struct process* pcb, tid_t tid);
+static void pthread_info_exit(struct process* pcb, tid_t tid);
 
 static struct process* process_get_parent(struct process* c);
 static struct child_info* process_get_child(struct process* p, pid_t cpid);
@@ -38,6 +47,9 @@ static int fd_tb_offer(void);
 static void fd_tb_init(struct process* pcb);
 static void process_close_file(struct process* pcb, struct file* file);
 
+/* 子进程信息的对象缓存 */
+static struct kmem_cache* child_cache;
+
 /* Initializes user programs in the system by ensuring the main
    thread has a minimal PCB so that it can execute and wait for
    the first user process. Any additions to the PCB should be also
@@ -47,6 +59,8 @@ void userprog_init(void) {
   struct thread* t = thread_current();
   bool success;
 
+  child_cache = kmem_cache_create("child_info", sizeof(struct child_info), NULL);
+
   /* Allocate process control block
      It is imoprtant that this is a call to calloc and not malloc,
      so that t->pcb->pagedir is guaranteed to be NULL (the kernel's
@@ -59,6 +73,8 @@ void userprog_init(void) {
     //t->pcb->pagedir = init_page_dir;
     t->pcb->pagedir = init_page_dir;
     t->pcb->main_thread = thread_current();
+    t->pcb->pid = t->tid;
+    process_init_threads(t->pcb);
     t->pcb->parent = 0;
     t->pcb->waiting = 0;
     strlcpy(t->pcb->process_name, t->name, sizeof t->name);
@@ -74,7 +90,8 @@ void userprog_init(void) {
 bool process_init(struct thread *t){
   /* Allocate process control block */
   struct process* new_pcb = calloc(sizeof(struct process), 1);;   //这里的process在内核池
-  bool success = new_pcb != NULL;
+  struct pthread_info* main_info = malloc(sizeof *main_info);
+  bool success = new_pcb != NULL && main_info != NULL;
   struct process *p = thread_current()->pcb;
 
   /* Initialize process control block */
@@ -85,8 +102,18 @@ bool process_init(struct thread *t){
     t->pcb = new_pcb;
     // Continue initializing the PCB as normal
     t->pcb->main_thread = t;
+    t->pcb->pid = t->tid;
     strlcpy(t->pcb->process_name, t->name, sizeof t->name);
 
+    /* 主线程也可以被join */
+    process_init_threads(t->pcb);
+    main_info->tid = t->tid;
+    main_info->stack_slot = -1;
+    main_info->dead = false;
+    main_info->joined = false;
+    sema_init(&main_info->exited, 0);
+    list_push_back(&t->pcb->threads, &main_info->elem);
+
     list_init(&t->pcb->children);          
     sema_init(&t->pcb->sema, 0);
     t->pcb->parent = get_pid(p);
@@ -95,6 +122,7 @@ bool process_init(struct thread *t){
     if(p->dir)
       t->pcb->dir = dir_reopen(p->dir);
 #ifdef VM
+    lock_init(&t->pcb->vm_lock);
     t->pcb->pt.pages = malloc(PGSIZE);
     t->pcb->pt.pages_size = PGSIZE;
     t->pcb->mmap_list = calloc(sizeof(struct mmap), 10);
@@ -103,8 +131,12 @@ bool process_init(struct thread *t){
     success = child_add(p, t->pcb);
     if(!success){
       free(t->pcb);
+      free(main_info);
       t->pcb = NULL;
     }
+  } else {
+    free(new_pcb);
+    free(main_info);
   }
 
 
@@ -147,7 +179,7 @@ pid_t process_execute(const char* comd) {
   struct file* file = filesys_open(NULL, file_name);
   if(file == NULL)
     return -1;
-  free(file);
+  file_close(file);
 
   /* Create a new thread to execute FILE_NAME. */
   tid = thread_create(file_name, PRI_DEFAULT, start_process, fn_copy);
@@ -225,32 +257,108 @@ int process_wait(pid_t child_pid) {
   p->waiting = 0;
   int status = ci->status;
   list_remove(&ci->elem);
-  free(ci);
+  kmem_cache_free(child_cache, ci);
   return status;
 }
 
 /* 错误退出 */
 void process_error_exit(){
-  printf("%s: exit(%d)\n", thread_current()->pcb->process_name, -1);
-  process_exit(-1);
+  process_exit_report(-1);
 }
 
-/* Free the current process's resources. */
-void process_exit(int32_t status) {
+/* Exits the current process with STATUS, unless another thread
+   got there first.  The current thread leaves the process at
+   once; the others leave the next time they would return to user
+   mode, and the last one to leave frees the process. */
+void process_exit(int32_t status) { process_exit_status(status, false); }
+
+/* Like process_exit(), but also prints the "NAME: exit(STATUS)"
+   message if this thread is the one that exits the process. */
+void process_exit_report(int32_t status) { process_exit_status(status, true); }
+
+/* Does the work of process_exit() and process_exit_report().
+   Which thread exits the process, and so prints the message if
+   REPORT, is decided under the process lock. */
+static void process_exit_status(int32_t status, bool report) {
   struct thread* cur = thread_current();
-  uint32_t* pd;
+  struct process* pcb = cur->pcb;
 
   /* If this thread does not have a PCB, don't worry */
-  if (cur->pcb == NULL) {
+  if (pcb == NULL) {
     thread_exit();
     NOT_REACHED();
   }
 
+  bool first;
+
+  lock_acquire(&pcb->lock);
+  first = !pcb->exiting;
+  if (first) {
+    pcb->exiting = true;
+    pcb->exit_status = status;
+    if (report)
+      printf("%s: exit(%d)\n", pcb->process_name, status);
+  }
+  lock_release(&pcb->lock);
+
+  /* 睡在用户锁上的线程也要醒来离开 */
+  if (first)
+    futex_wake_process(pcb->pagedir);
+  process_leave();
+}
+
+/* Called on the way back to user mode, possibly with interrupts
+   off.  If the current thread's process is exiting, leaves it
+   instead of returning. */
+void process_exit_if_killed(void) {
+  struct process* pcb = thread_current()->pcb;
+
+  if (pcb != NULL && pcb->exiting) {
+    intr_enable();
+    process_leave();
+  }
+}
+
+/* Takes the current thread out of its process and exits it.  The
+   last thread to leave frees the process. */
+static void process_leave(void) {
+  struct thread* cur = thread_current();
+  struct process* pcb = cur->pcb;
+  bool last;
+
+  lock_acquire(&pcb->lock);
+  pthread_info_exit(pcb, cur->tid);
+  last = --pcb->thread_cnt == 0;
+  if (!last) {
+    if (pcb->thread_cnt == 1)
+      cond_signal(&pcb->threads_done, &pcb->lock);
+
+    /* 最后离开的线程随时可能销毁页目录，先切回内核页目录 */
+    cur->pcb = NULL;
+    process_activate();
+  }
+  lock_release(&pcb->lock);
+
+  /* 释放文件锁 */
+  filesys_release_lock();
+
+  if (last)
+    process_teardown(pcb);
+  thread_exit();
+}
+
+/* Frees process PCB, which the current thread is the last to
+   leave, and reports its exit status to its parent. */
+static void process_teardown(struct process* pcb) {
+  struct thread* cur = thread_current();
+  int32_t status = pcb->exit_status;
+  uint32_t* pd;
+
 
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   /* 这里就重置页目录，要确保重置后的操作不会访问用户空间 */
-  pd = cur->pcb->pagedir;
+  pd = pcb->pagedir;
   if (pd != NULL) {
     /* Correct ordering here is crucial.  We must set
          cur->pcb->pagedir to NULL before switching page directories,
@@ -259,21 +367,21 @@ void process_exit(int32_t status) {
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
-    cur->pcb->pagedir = NULL;
+    pcb->pagedir = NULL;
     pagedir_activate(NULL);
     pagedir_destroy(pd);
   }
 
   /* 允许可执行程序被访问 */
-  if(cur->pcb->fd_tb[2] != NULL){
-    file_allow_write(cur->pcb->fd_tb[2]);
+  if(pcb->fd_tb[2] != NULL){
+    file_allow_write(pcb->fd_tb[2]);
   }
   
 
   /* 找到父母进程，保存退出信息 */
-  struct process *p = process_get_parent(cur->pcb);
+  struct process *p = process_get_parent(pcb);
   if(p != NULL){
-    struct child_info* c = process_get_child(p, get_pid(cur->pcb));
+    struct child_info* c = process_get_child(p, get_pid(pcb));
     if(c == NULL)
       PANIC("DEBUG : NO WAY");
 
@@ -282,19 +390,13 @@ void process_exit(int32_t status) {
   }
 
   /* 释放pcb*/
-  pid_t cur_pit = get_pid(cur->pcb); 
-  struct process* pcb_to_free = cur->pcb;
+  pid_t cur_pit = get_pid(pcb); 
   cur->pcb = NULL;
-  process_free(pcb_to_free);
+  process_free(pcb);
 
   /* 让等待的父母进程运行 */
-  if(p->waiting == cur_pit)
+  if(p != NULL && p->waiting == cur_pit)
     sema_up(&p->sema);
-
-  /* 释放文件锁 */
-  filesys_release_lock();
-
-  thread_exit();
 }
 
 /* Sets up the CPU for running user code in the current
@@ -770,72 +872,223 @@ static bool install_page(void* upage, void* kpage, bool writable) {
 bool is_main_thread(struct thread* t, struct process* p) { return p->main_thread == t; }
 
 /* Gets the PID of a process */
-pid_t get_pid(struct process* p) { return (pid_t)p->main_thread->tid; }
+pid_t get_pid(struct process* p) { return p->pid; }
+
+/* Returns the user address of the bottom of thread stack SLOT.
+   Each thread gets one page, below the MAX_STACK_PAGES that the
+   main thread's stack may grow into. */
+static void* thread_stack_page(int slot) {
+  return (uint8_t*)PHYS_BASE - (MAX_STACK_PAGES + 1 + slot) * PGSIZE;
+}
 
 /* Creates a new stack for the thread and sets up its arguments.
    Stores the thread's entry point into *EIP and its initial stack
-   pointer into *ESP. Handles all cleanup if unsuccessful. Returns
-   true if successful, false otherwise.
+   pointer into *ESP, and the stack slot it took into *SLOT.
+   Returns true if successful, false otherwise.
+
+   Runs in the creating thread, with the process lock held.  A
+   slot's page stays mapped after its thread exits, for the next
+   thread that takes the slot to reuse. */
+static bool setup_thread(stub_fun sf, pthread_fun tf, void* arg, void (**eip)(void), void** esp,
+                         int* slot) {
+  struct process* pcb = thread_current()->pcb;
+  uint32_t* top;
+  int i;
 
-   This function will be implemented in Project 2: Multithreading. For
-   now, it does nothing. You may find it necessary to change the
-   function signature. */
-bool setup_thread(void (**eip)(void) UNUSED, void** esp UNUSED) { return false; }
+  ASSERT(lock_held_by_current_thread(&pcb->lock));
+
+  /* 找最低的空闲槽位，退出线程的栈会被复用 */
+  for (i = 0; i < MAX_THREADS; i++)
+    if (!pcb->stack_busy[i])
+      break;
+  if (i == MAX_THREADS)
+    return false;
+
+  if (!pcb->stack_mapped[i]) {
+    uint8_t* kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+    if (kpage == NULL)
+      return false;
+    if (!install_page(thread_stack_page(i), kpage, true)) {
+      palloc_free_page(kpage);
+      return false;
+    }
+#ifdef VM
+    pages_reg(pcb, thread_stack_page(i), SWAP, false);
+#endif
+    pcb->stack_mapped[i] = true;
+  }
+  pcb->stack_busy[i] = true;
+  *slot = i;
+
+  /* 模拟调用 sf(tf, arg)：进入函数时 esp + 4 要16字节对齐 */
+  top = (uint32_t*)((uint8_t*)thread_stack_page(i) + PGSIZE);
+  top[-3] = (uint32_t)arg;
+  top[-4] = (uint32_t)tf;
+  top[-5] = 0;
+  *esp = &top[-5];
+  *eip = (void (*)(void))sf;
+  return true;
+}
+
+/* Where a new user thread starts running. */
+struct pthread_start {
+  void (*eip)(void); /* User entry point, the stub. */
+  void* esp;         /* Initial user stack pointer. */
+};
 
 /* Starts a new thread with a new user stack running SF, which takes
    TF and ARG as arguments on its user stack. This new thread may be
    scheduled (and may even exit) before pthread_execute () returns.
    Returns the new thread's TID or TID_ERROR if the thread cannot
-   be created properly.
+   be created properly. */
+tid_t pthread_execute(stub_fun sf, pthread_fun tf, void* arg) {
+  struct process* pcb = thread_current()->pcb;
+  struct pthread_start* start = malloc(sizeof *start);
+  struct pthread_info* info = malloc(sizeof *info);
+  tid_t tid = TID_ERROR;
+  int slot;
+
+  if (start == NULL || info == NULL)
+    goto fail;
+
+  /* 拿着锁创建，新线程要等我们登记完它才能退出 */
+  lock_acquire(&pcb->lock);
+  if (pcb->exiting || !setup_thread(sf, tf, arg, &start->eip, &start->esp, &slot)) {
+    lock_release(&pcb->lock);
+    goto fail;
+  }
+  tid = thread_create_in(pcb, pcb->process_name, thread_get_priority(), start_pthread, start);
+  if (tid == TID_ERROR) {
+    pcb->stack_busy[slot] = false;
+    lock_release(&pcb->lock);
+    goto fail;
+  }
+  info->tid = tid;
+  info->stack_slot = slot;
+  info->dead = false;
+  info->joined = false;
+  sema_init(&info->exited, 0);
+  list_push_back(&pcb->threads, &info->elem);
+  pcb->thread_cnt++;
+  lock_release(&pcb->lock);
+  return tid;
 
-   This function will be implemented in Project 2: Multithreading and
-   should be similar to process_execute (). For now, it does nothing.
-   */
-tid_t pthread_execute(stub_fun sf UNUSED, pthread_fun tf UNUSED, void* arg UNUSED) { return -1; }
+fail:
+  free(start);
+  free(info);
+  return TID_ERROR;
+}
 
-/* A thread function that creates a new user thread and starts it
-   running. Responsible for adding itself to the list of threads in
-   the PCB.
+/* A thread function that starts a new user thread running, on
+   the stack that setup_thread() prepared. */
+static void start_pthread(void* start_) {
+  struct pthread_start* start = start_;
+  struct intr_frame if_;
+
+  memset(&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = start->eip;
+  if_.esp = start->esp;
+  free(start);
 
-   This function will be implemented in Project 2: Multithreading and
-   should be similar to start_process (). For now, it does nothing. */
-static void start_pthread(void* exec_ UNUSED) {}
+  asm volatile("movl %0, %%esp; jmp intr_exit" : : "g"(&if_) : "memory");
+  NOT_REACHED();
+}
 
 /* Waits for thread with TID to die, if that thread was spawned
    in the same process and has not been waited on yet. Returns TID on
    success and returns TID_ERROR on failure immediately, without
-   waiting.
+   waiting. */
+tid_t pthread_join(tid_t tid) {
+  struct thread* cur = thread_current();
+  struct process* pcb = cur->pcb;
+  struct pthread_info* info;
 
-   This function will be implemented in Project 2: Multithreading. For
-   now, it does nothing. */
-tid_t pthread_join(tid_t tid UNUSED) { return -1; }
+  lock_acquire(&pcb->lock);
+  info = pthread_info_find(pcb, tid);
+  if (info == NULL || info->joined || tid == cur->tid) {
+    lock_release(&pcb->lock);
+    return TID_ERROR;
+  }
+  info->joined = true;
+  lock_release(&pcb->lock);
 
-/* Free the current thread's resources. Most resources will
-   be freed on thread_exit(), so all we have to do is deallocate the
-   thread's userspace stack. Wake any waiters on this thread.
+  sema_down(&info->exited);
 
-   The main thread should not use this function. See
-   pthread_exit_main() below.
+  lock_acquire(&pcb->lock);
+  list_remove(&info->elem);
+  lock_release(&pcb->lock);
+  free(info);
+  return tid;
+}
 
-   This function will be implemented in Project 2: Multithreading. For
-   now, it does nothing. */
-void pthread_exit(void) {}
+/* Exits the current thread, which must not be the main thread.
+   Its user stack is kept for the next thread to reuse, and the
+   rest goes with thread_exit().  Wakes any joiner. */
+void pthread_exit(void) {
+  ASSERT(!is_main_thread(thread_current(), thread_current()->pcb));
+  process_leave();
+}
 
 /* Only to be used when the main thread explicitly calls pthread_exit.
-   The main thread should wait on all threads in the process to
-   terminate properly, before exiting itself. When it exits itself, it
-   must terminate the process in addition to all necessary duties in
-   pthread_exit.
+   Wakes any joiner, waits for every other thread in the process to
+   exit, and then exits the process with status 0, unless one of
+   those threads exited it with another status first. */
+void pthread_exit_main(void) {
+  struct thread* cur = thread_current();
+  struct process* pcb = cur->pcb;
 
-   This function will be implemented in Project 2: Multithreading. For
-   now, it does nothing. */
-void pthread_exit_main(void) {}
+  lock_acquire(&pcb->lock);
+  pthread_info_exit(pcb, cur->tid);
+  while (pcb->thread_cnt > 1)
+    cond_wait(&pcb->threads_done, &pcb->lock);
+  lock_release(&pcb->lock);
+
+  process_exit_report(0);
+}
+
+/* Initializes the thread bookkeeping of PCB for its main thread. */
+static void process_init_threads(struct process* pcb) {
+  lock_init(&pcb->lock);
+  list_init(&pcb->threads);
+  cond_init(&pcb->threads_done);
+  pcb->thread_cnt = 1;
+  pcb->exiting = false;
+}
+
+/* Returns the pthread_info of thread TID in PCB, or a null
+   pointer if it has none.  PCB's lock must be held. */
+static struct pthread_info* pthread_info_find(struct process* pcb, tid_t tid) {
+  struct list_elem* e;
+
+  for (e = list_begin(&pcb->threads); e != list_end(&pcb->threads); e = list_next(e)) {
+    struct pthread_info* info = list_entry(e, struct pthread_info, elem);
+    if (info->tid == tid)
+      return info;
+  }
+  return NULL;
+}
+
+/* Marks thread TID of PCB as exited: frees its stack slot and
+   wakes its joiner.  PCB's lock must be held. */
+static void pthread_info_exit(struct process* pcb, tid_t tid) {
+  struct pthread_info* info = pthread_info_find(pcb, tid);
+
+  if (info == NULL || info->dead)
+    return;
+  info->dead = true;
+  if (info->stack_slot >= 0)
+    pcb->stack_busy[info->stack_slot] = false;
+  sema_up(&info->exited);
+}
 
 
 
 /* 添加子进程 */
 bool child_add(struct process* p, struct process* c){
-  struct child_info* ci = (struct child_info*)malloc(sizeof(struct child_info));
+  struct child_info* ci = kmem_cache_alloc(child_cache);
   if(ci == NULL)
     return false;
   
@@ -853,7 +1106,7 @@ static struct process* process_get_parent(struct process* c){
   for(e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e)){
     struct thread *t= list_entry(e, struct thread, allelem);
     struct process *p = t->pcb;
-    if(ppid == get_pid(p))
+    if(p != NULL && ppid == get_pid(p))
       return p;
   }
   return NULL;
@@ -883,9 +1136,13 @@ static void process_free(struct process* p){
 
     struct child_info* ci = list_entry(ce, struct child_info, elem);
     list_remove(ce);
-    free(ci);
+    kmem_cache_free(child_cache, ci);
   }
 
+  /* 清理没被join的线程信息 */
+  while(!list_empty(&p->threads))
+    free(list_entry(list_pop_front(&p->threads), struct pthread_info, elem));
+
   /* 关闭所有已打开文件 */
   int len = sizeof(p->fd_tb)/sizeof(p->fd_tb[0]);
   for(int i = 2; i < len; i++){
@@ -910,7 +1167,7 @@ static void process_free(struct process* p){
   free(p);
 }
 
-/* 申请一个fd */
+/* 申请一个fd，满了返回-1 */
 static int fd_tb_offer(){
   struct process* cur = thread_current()->pcb;
   int len = sizeof(cur->fd_tb)/sizeof(cur->fd_tb[0]);
@@ -918,8 +1175,7 @@ static int fd_tb_offer(){
     if(cur->fd_tb[i] == NULL)
       return i;
   }
-  PANIC(" DEBUG ");
-  //return -1;
+  return -1;
 }
 
 int file_get_fd(struct file* file){
@@ -949,7 +1205,22 @@ struct file* process_open_file(const char* name){
 
   struct process* cur = thread_current()->pcb;
   struct file* file = filesys_open(cur->dir, name);
-  cur->fd_tb[fd_tb_offer()] = file;
+  int fd;
+
+  if(file == NULL)
+    return NULL;
+
+  /* 同一进程的线程共享fd_tb */
+  lock_acquire(&cur->lock);
+  fd = fd_tb_offer();
+  if(fd >= 0)
+    cur->fd_tb[fd] = file;
+  lock_release(&cur->lock);
+
+  if(fd < 0){
+    file_close(file);
+    return NULL;
+  }
   return file;
 }
 
@@ -15,7 +15,7 @@
 // These defines will be used in Project 2: Multithreading
 #define MAX_STACK_PAGES (1 << 11)
 #define MAX_THREADS 127
-#define MAX_OPEN_FILE 10
+#define MAX_OPEN_FILE 128
 
 /* PIDs and TIDs are the same type. PID should be
    the TID of the main thread of the process */
@@ -32,6 +32,17 @@ struct process {
   uint32_t* pagedir;          /* Page directory. */
   char process_name[16];      /* Name of the main thread */
   struct thread* main_thread; /* Pointer to main thread */
+  pid_t pid;                  /* 主线程的tid，主线程离开后仍然有效 */
+
+  /* 用户线程 */
+  struct lock lock;                /* 保护下面的成员和fd_tb的分配 */
+  struct list threads;             /* 还没被join的线程的pthread_info */
+  int thread_cnt;                  /* 还没离开进程的线程数 */
+  struct condition threads_done;   /* thread_cnt降到1时通知 */
+  bool stack_mapped[MAX_THREADS];  /* 线程栈槽位已经映射了页 */
+  bool stack_busy[MAX_THREADS];    /* 线程栈槽位正在被使用 */
+  bool exiting;                    /* 有线程调用了exit，其他线程回到用户态前离开 */
+  int32_t exit_status;             /* 进程的退出码 */
 
   /* 等待机制 */
   struct semaphore sema;        /* 该进程等待结束的锁*/
@@ -49,6 +60,7 @@ struct process {
 
 #ifdef VM
    /* 进程的辅助页表 */
+   struct lock vm_lock;    /* 串行化缺页处理和对pt、mmap_list的修改 */
    struct ptable pt;
 
    /* 文件映射mmap */
@@ -65,6 +77,16 @@ struct child_info{
    struct list_elem elem;
 };
 
+/* 保存同一进程中一个用户线程的信息，直到被join或进程结束 */
+struct pthread_info{
+   tid_t tid;
+   int stack_slot;             /* 线程栈槽位，主线程为-1 */
+   bool dead;                  /* 线程已经退出 */
+   bool joined;                /* 已经有线程在join它 */
+   struct semaphore exited;    /* 线程退出时up */
+   struct list_elem elem;
+};
+
 
 
 
@@ -78,8 +100,10 @@ bool process_init(struct thread*);
 pid_t process_execute(const char* file_name);
 int process_wait(pid_t);
 void process_exit(int32_t);
+void process_exit_report(int32_t);
 void process_activate(void);
 void process_error_exit(void);
+void process_exit_if_killed(void);
 
 bool is_main_thread(struct thread*, struct process*);
 pid_t get_pid(struct process*);
@@ -1,6 +1,7 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
 #include <syscall-nr.h>
+#include <time.h>
 #include "lib/kernel/console.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
@@ -9,10 +10,13 @@
 #include "threads/thread.h"
 #include "threads/malloc.h"
 #include "threads/vaddr.h"
+#include "userprog/futex.h"
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
 #include "devices/shutdown.h"
 #include "devices/input.h"
+#include "devices/rtc.h"
+#include "devices/timer.h"
 #include "string.h"
 #ifdef VM
 #include "vm/frame.h"
@@ -51,13 +55,22 @@ static void syscall_handler(struct intr_frame*);
 static char* string_check(char *str);
 static bool write_read_check(char *str, size_t len);
 static void check_out_bound(uint32_t* args, int num);
+static int32_t* futex_check(int32_t* uaddr);
+static struct file* fd_get(struct process* pcb, int fd);
 
 #ifdef VM
 static void lock_buffer(char* buffer, size_t len);  
 static void release_buffer(char* buffer, size_t len);
 #endif
 
-void syscall_init(void) { intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall"); }
+/* CLOCK_REALTIME 的起点：启动时的RTC秒数减去当时的单调时间 */
+static int64_t realtime_base_ns;
+
+void syscall_init(void) {
+  intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
+  realtime_base_ns = (int64_t)rtc_get_time() * NSEC_PER_SEC - timer_ns();
+  futex_init();
+}
 
 /* 这里的args数组最多个有4变量，取决于系统调用类型，详见src/lib/user/syscall.c*/
 static void syscall_handler(struct intr_frame* f UNUSED) {
@@ -71,8 +84,8 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     check_out_bound(args,2);
 
     f->eax = args[1];
-    printf("%s: exit(%d)\n", pcb->process_name, args[1]);
-    process_exit(args[1]);
+    /* 只有真正让进程退出的线程会打印退出信息 */
+    process_exit_report(args[1]);
   }
   
   else if(args[0] == SYS_HALT){
@@ -118,15 +131,12 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
   else if(args[0] == SYS_FILESIZE){
     check_out_bound(args,2);
 
-    int fd = (int)args[1];
-    if(fd >= 0 && fd <= 10){
-      struct file *file = pcb->fd_tb[fd];
-      if(file == NULL) 
-        f->eax = -1;
-      else
-        f->eax = file_length(file);
-    }else
+    struct file *file = fd_get(pcb, (int)args[1]);
+    if(file == NULL) 
       f->eax = -1;
+    else
+      f->eax = file_length(file);
+    file_close(file);
   }
 
   else if(args[0] == SYS_READ){
@@ -135,7 +145,7 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     int fd = (int)args[1];
     off_t len = (off_t)args[3];
     char* buffer = (char*)args[2];
-    bool flag = write_read_check(buffer, len) && (fd >= 0 && fd < 10);
+    bool flag = write_read_check(buffer, len) && (fd >= 0 && fd < MAX_OPEN_FILE);
 
 #ifdef VM
     lock_buffer(buffer, len);
@@ -152,12 +162,13 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
       if(i == len) f->eax = len;
     }else if (fd > 1 && flag){
       /* 这里没有检查权限！ */
-      struct file *file = pcb->fd_tb[fd];
+      struct file *file = fd_get(pcb, fd);
       if(file != NULL){
         f->eax = file_read(file, buffer, len);   
       }
       else
         f->eax = -1;
+      file_close(file);
       
     }else
       f->eax = -1;
@@ -173,7 +184,7 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     char *buffer = (char*)args[2];
     int fd = (int)args[1];
     off_t len = (off_t)args[3];
-    bool flag = write_read_check(buffer, len) && (fd >= 0 && fd < 10);
+    bool flag = write_read_check(buffer, len) && (fd >= 0 && fd < MAX_OPEN_FILE);
 
 #ifdef VM
     lock_buffer(buffer, len);
@@ -183,12 +194,13 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
       putbuf(buffer, len);              
     }else if(fd > 1 && flag){
       /* 这里没有检查权限！ */
-      struct file *file = pcb->fd_tb[fd];
+      struct file *file = fd_get(pcb, fd);
       if(file != NULL){
         f->eax = file_write(file, buffer, len);   
       }
       else
         f->eax = -1;
+      file_close(file);
 
     }else
       f->eax = -1;
@@ -201,29 +213,23 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
   else if(args[0] == SYS_SEEK){
     check_out_bound(args,3);
 
-    int fd = (int)args[1];
     off_t pos = (off_t)args[2];
-
-    if(fd >=0 && fd < 10){
-      struct file *file = pcb->fd_tb[fd];
-      if(file != NULL){
-        file_seek(file, pos);                
-      }   
-    } 
+    struct file *file = fd_get(pcb, (int)args[1]);
+    if(file != NULL){
+      file_seek(file, pos);                
+    }   
+    file_close(file);
   }
 
   else if(args[0] == SYS_TELL){
     check_out_bound(args,2);
 
-    int fd = (int)args[1];
-    if(fd >= 0 && fd < 10){
-      struct file *file = pcb->fd_tb[fd];
-      if(file != NULL)
-        f->eax = file_tell(file);
-      else 
-        f->eax = -1;
-    }else 
+    struct file *file = fd_get(pcb, (int)args[1]);
+    if(file != NULL)
+      f->eax = file_tell(file);
+    else 
       f->eax = -1;
+    file_close(file);
 
   }
 
@@ -231,12 +237,13 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     check_out_bound(args,2);
 
     int fd = (int)args[1];
-    if(fd >= 0 && fd < 10){
+    if(fd >= 0 && fd < MAX_OPEN_FILE){
+      lock_acquire(&pcb->lock);
       struct file* file = pcb->fd_tb[fd];
-      if(file != NULL){
+      pcb->fd_tb[fd] = NULL;
+      lock_release(&pcb->lock);
+      if(file != NULL)
         file_close(file);
-        pcb->fd_tb[fd] = NULL;
-      }
     }
   }
 
@@ -248,12 +255,17 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     void* uaddr = (void*)args[2];
 
     if(uaddr > (void*)0x8408000 && uaddr < (void*)PHYS_BASE && !pg_ofs(uaddr)){
-      if(fd > 1){
-        struct file* file = file_reopen(pcb->fd_tb[fd]);
+      struct file* open_file = fd > 1 ? fd_get(pcb, fd) : NULL;
+      if(open_file != NULL){
+        struct file* file = file_reopen(open_file);
+        file_close(open_file);
+        /* 和缺页处理互斥地修改辅助页表 */
+        lock_acquire(&pcb->vm_lock);
         if(!mmap_init(pcb, file, uaddr))
           f->eax = -1;
         else
           f->eax = mmap_alloc(pcb, file, uaddr);
+        lock_release(&pcb->vm_lock);
       }else
         f->eax = -1;
     }else
@@ -265,7 +277,9 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     check_out_bound(args,2);
 
     int mt = (int)args[1];
+    lock_acquire(&pcb->vm_lock);
     mmap_close(pcb, mt);
+    lock_release(&pcb->vm_lock);
   }
 
 #endif
@@ -290,18 +304,21 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     char *buffer = (char*)args[2];
     int fd = (int)args[1];
     /* 检查缓冲区和fd */
-    bool flag = write_read_check(buffer, READDIR_MAX_LEN) && (fd >= 2 && fd < 10);
+    bool flag = write_read_check(buffer, READDIR_MAX_LEN) && (fd >= 2 && fd < MAX_OPEN_FILE);
     if(!flag) 
       return;
     /* 检查文件是否存在已经是否为目录 */
-    struct file* file = pcb->fd_tb[fd];
+    struct file* file = fd_get(pcb, fd);
     struct dir* dir;
     flag = (file != NULL && (dir = dir_open_file(file)) != NULL ) ;
-    if(!flag)
+    if(!flag){
+      file_close(file);
       return;
+    }
     /* 执行readdir */
     f->eax = dir_readdir(dir, buffer);
     dir_close_file(dir, file);
+    file_close(file);
   }
 
   else if(args[0] == SYS_ISDIR){
@@ -310,12 +327,13 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     f->eax = -1;
     struct file* file;
     int fd = (int)args[1];
-    bool flag = (fd >= 2 && fd < 10);
+    bool flag = (fd >= 2 && fd < MAX_OPEN_FILE);
     if(flag){
-      file = pcb->fd_tb[fd];
+      file = fd_get(pcb, fd);
       if(file){
         f->eax = dir_is(file_get_inode(file));
       }
+      file_close(file);
     }
   }
 
@@ -325,14 +343,69 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     f->eax = -1;
     struct file* file;
     int fd = (int)args[1];
-    bool flag = (fd >= 2 && fd < 10);
+    bool flag = (fd >= 2 && fd < MAX_OPEN_FILE);
     if(flag){
-      file = pcb->fd_tb[fd];
+      file = fd_get(pcb, fd);
       if(file){
         f->eax = (file_get_inode(file)->sector);
       }
+      file_close(file);
     }
   }
+
+  else if(args[0] == SYS_CLOCK_GETTIME){
+    check_out_bound(args,3);
+
+    int clock = (int)args[1];
+    struct timespec* ts = (struct timespec*)args[2];
+    write_read_check((char*)ts, sizeof *ts);
+
+    f->eax = -1;
+    int64_t ns = timer_ns();
+    if(clock == CLOCK_REALTIME)
+      ns += realtime_base_ns;
+    else if(clock != CLOCK_MONOTONIC)
+      return;
+    ts->tv_sec = ns / NSEC_PER_SEC;
+    ts->tv_nsec = ns % NSEC_PER_SEC;
+    f->eax = 0;
+  }
+
+  else if(args[0] == SYS_PT_CREATE){
+    check_out_bound(args,4);
+
+    f->eax = pthread_execute((stub_fun)args[1], (pthread_fun)args[2], (void*)args[3]);
+  }
+
+  else if(args[0] == SYS_PT_EXIT){
+    struct thread* t = thread_current();
+    if(is_main_thread(t, pcb))
+      pthread_exit_main();
+    else
+      pthread_exit();
+  }
+
+  else if(args[0] == SYS_PT_JOIN){
+    check_out_bound(args,2);
+
+    f->eax = pthread_join((tid_t)args[1]);
+  }
+
+  else if(args[0] == SYS_GET_TID){
+    f->eax = thread_current()->tid;
+  }
+
+  else if(args[0] == SYS_FUTEX_WAIT){
+    check_out_bound(args,3);
+
+    f->eax = futex_wait(futex_check((int32_t*)args[1]), (int32_t)args[2]);
+  }
+
+  else if(args[0] == SYS_FUTEX_WAKE){
+    check_out_bound(args,3);
+
+    f->eax = futex_wake(futex_check((int32_t*)args[1]), (int)args[2]);
+  }
 }
 
 
@@ -374,6 +447,30 @@ static bool write_read_check(char *str, size_t len){
   return false; 
 }
 
+/* 检查futex地址：非空、4字节对齐、在用户空间。
+   先读一次，无效地址在这里就缺页退出，而不是在futex持锁的时候 */
+static int32_t* futex_check(int32_t* uaddr){
+  if(uaddr == NULL || (uintptr_t)uaddr % sizeof *uaddr != 0)
+    process_error_exit();
+  write_read_check((char*)uaddr, sizeof *uaddr);
+  (void)*(volatile int32_t*)uaddr;
+  return uaddr;
+}
+
+/* 取出fd对应的文件并持有一个引用，用完要file_close()。
+   fd_tb被同一进程的线程共享，持锁查找，这样别的线程close
+   之后，文件也要等这里用完才会被释放。fd无效时返回NULL */
+static struct file* fd_get(struct process* pcb, int fd){
+  struct file* file;
+
+  if(fd < 0 || fd >= MAX_OPEN_FILE)
+    return NULL;
+  lock_acquire(&pcb->lock);
+  file = file_dup(pcb->fd_tb[fd]);
+  lock_release(&pcb->lock);
+  return file;
+}
+
 /* 栈是否越界 */
 static void check_out_bound(uint32_t* args, int num){
   if(is_kernel_vaddr(args + num))
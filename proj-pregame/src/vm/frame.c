@@ -41,7 +41,8 @@ static void clock_run(void);
 
 /* 初始化页帧表 */
 void frame_table_init(size_t user_pages){
-    lock_init(&frame_lock);
+    lock_init_adaptive(&frame_lock);
+    lock_set_name(&frame_lock, "frame table");
 
     size_t haved = 1024 * 1024 / PGSIZE;
     ker_user_line = init_ram_pages - user_pages;
@@ -71,14 +71,15 @@ void mmap_close(struct process* pcb, int m_t){
       struct page* page = pages_get(&pcb->pt, pagedir_get_avl(pcb->pagedir, upage), upage);
       void* kpage = pagedir_get_page(pcb->pagedir, upage);        /* kpage != NULL 说明在物理页中*/
       ASSERT(page->type == MMAP);
+      /* Unmap the page on every CPU before its frame is freed. */
+      pagedir_set_lazy(pcb->pagedir, upage, false);
+      pagedir_clear_page(pcb->pagedir, upage);
       if(kpage && pagedir_is_dirty(pcb->pagedir, upage)){
         file_seek(page->file, page->pos);
         file_write(page->file, kpage, page->read_bytes);
         /* 释放页帧 */
         palloc_free_page(kpage);
       }
-      pagedir_set_lazy(pcb->pagedir, upage, false);
-      pagedir_clear_page(pcb->pagedir, upage);
       upage += PGSIZE;
     } 
 
@@ -34,7 +34,8 @@ void swap_init(void){
     if (free_map == NULL)
         PANIC("bitmap creation failed--file system device is too large");
     
-    lock_init(&swap_lock);
+    lock_init_adaptive(&swap_lock);
+    lock_set_name(&swap_lock, "swap");
 }
 
 
@@ -57,7 +58,7 @@ int32_t swap_out(void* kaddr){
     ASSERT(is_kernel_vaddr(kaddr));
     lock_acquire(&swap_lock);
 
-    size_t swap_idx = bitmap_scan_and_flip(free_map, 0, 1, false);
+    size_t swap_idx = bitmap_scan_and_flip_next(free_map, 1, false);
     for(int i = 0; i < PAGE_SECTORS; i++)
         block_write(swap_device, swap_idx * PAGE_SECTORS + i, kaddr + i * BLOCK_SECTOR_SIZE);
 